@@ -23,12 +23,14 @@
 #define GAMMAPAD_VERBOSE_LOGGING 1
 #endif
 
-/* Logging macro for Force Feedback if verbose logging is enabled. */
-#if GAMMAPAD_VERBOSE_LOGGING
-  #define LOG_FF(fmt, args...) fprintf(stderr, fmt, ## args)
-#else
-  #define LOG_FF(fmt, args...) /* no-op */
-#endif
+#include "gammapad_log.h"
+
+/*
+ * Logging macro for Force Feedback. Goes through the async logger at
+ * DEBUG level; GAMMAPAD_VERBOSE_LOGGING only picks the default FF level,
+ * it can be changed at runtime with "log ff <level>".
+ */
+#define LOG_FF(fmt, args...) GP_LOG(GP_LOG_FF, GP_LOG_DEBUG, fmt, ## args)
 
 /*
  * Sleep in milliseconds.
@@ -48,6 +50,27 @@ static inline unsigned long long getTimeMs(void)
     return (unsigned long long)tv.tv_sec * 1000ULL + (tv.tv_usec / 1000ULL);
 }
 
+/*
+ * Monotonic time in nanoseconds (for deadlines and latency measurements).
+ */
+static inline unsigned long long getMonotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/*
+ * GpPollSource: what the main loop puts in epoll_event.data.ptr.
+ * Each readable fd dispatches straight to its own handler, so the cost
+ * per wakeup does not depend on how many fds are registered.
+ */
+struct GpPollSource {
+    int fd;
+    void (*onEvent)(struct GpPollSource* src, unsigned int events);
+    void* ctx;
+};
+
 /*
  * Extern: controllerFd is defined in gammapad_main.c
  * So that all other files can refer to it for EVIOCRMFF, etc.
@@ -55,7 +78,8 @@ static inline unsigned long long getTimeMs(void)
 extern int controllerFd;
 
 /*
- * Also expose g_physicalFd so we can read absmin/absmax from the captured device.
+ * Also expose g_physicalFd: the first captured device (the one whose
+ * virtual pad owns force feedback).
  */
 extern int g_physicalFd;
 
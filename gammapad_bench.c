@@ -0,0 +1,360 @@
+/*****************************************************
+ * gammapad_bench.c
+ *
+ * Synthetic load through the real forwarding pipeline (make bench).
+ *
+ * N fake devices feed gp_device_pump()/forward_physical_event() exactly
+ * like evdev nodes would, and every pad writes its frames to a pipe or
+ * socketpair sink instead of uinput (see "Sources and sinks" in
+ * gammapad_capture.h). A generator thread produces:
+ *   - sticks:  one ABS_X + ABS_Y frame per device at --stick-hz
+ *   - buttons: bursts of --burst press/release frames, --burst-hz times a
+ *              second, back to back
+ * the main thread runs the pipeline (edge-triggered epoll, like
+ * gammapad_main.c) and a consumer thread drains the sinks.
+ *
+ * Every generated frame changes the pad state, so frame k of a source
+ * comes out as frame k of its sink: latency = sink read - source write.
+ *
+ * Usage: gammapad_bench [--devices=N] [--seconds=S] [--stick-hz=HZ]
+ *                       [--burst=FRAMES] [--burst-hz=HZ]
+ *                       [--transport=pipe|socketpair] [--trace[=FILE]]
+ *
+ * --trace turns the stage tracepoints on (TRACE=1 builds) and prints their
+ * percentiles, plus a Chrome trace in FILE; run once with and once without
+ * to see what tracing costs.
+ *****************************************************/
+
+#define _GNU_SOURCE  /* pipe2 */
+#include "gammapad.h"
+#include "gammapad_capture.h"
+#include "gammapad_trace.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#define BENCH_RING        (1 << 16)    /* send timestamps kept per device */
+#define BENCH_MAX_SAMPLES (1 << 22)
+
+struct BenchDev {
+    int srcWrite, srcRead;          /* generator => pipeline */
+    int sinkWrite, sinkRead;        /* pipeline => consumer  */
+    struct GpDevice* dev;
+    struct GpPad pad;
+    struct GpPollSource pollSrc;
+    unsigned long long sent;        /* frames written (generator)  */
+    unsigned long long received;    /* frames read back (consumer) */
+    unsigned long long* sendNs;     /* [BENCH_RING] */
+    int buttonState;
+    int closed;
+};
+
+static struct BenchDev g_bench[GP_MAX_DEVICES];
+static int    g_devices   = 1;
+static int    g_seconds   = 5;
+static int    g_stickHz   = 1000;
+static int    g_burst     = 8;
+static int    g_burstHz   = 10;
+static int    g_socketpair = 0;
+static int    g_trace      = 0;
+static const char* g_tracePath;
+
+static double* g_samples;           /* frame latencies, us (consumer) */
+static unsigned long g_sampleCount;
+
+static unsigned long long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static int makeChannel(int* readEnd, int* writeEnd)
+{
+    int fds[2];
+    if (g_socketpair) {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0) return -1;
+    } else {
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) return -1;
+    }
+    *readEnd  = fds[0];
+    *writeEnd = fds[1];
+    return 0;
+}
+
+/*
+ * sendFrame => one frame from the generator. The write end is blocking
+ * so a slow pipeline shows up as latency, not as lost frames.
+ */
+static void sendFrame(struct BenchDev* b, struct input_event* evs, int count)
+{
+    /* Stamped like evdev does (CLOCK_REALTIME), for the trace read stage. */
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    for (int i = 0; i < count; i++) {
+        evs[i].input_event_sec  = rt.tv_sec;
+        evs[i].input_event_usec = rt.tv_nsec / 1000;
+    }
+    b->sendNs[b->sent & (BENCH_RING - 1)] = nowNs();
+    b->sent++;
+    if (write(b->srcWrite, evs, count * sizeof(evs[0])) < 0) {
+        perror("[Bench] source write");
+    }
+}
+
+static void setEvent(struct input_event* ev, __u16 type, __u16 code, __s32 value)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->type  = type;
+    ev->code  = code;
+    ev->value = value;
+}
+
+static void* generatorThread(void* arg)
+{
+    (void)arg;
+    unsigned long long periodNs = 1000000000ULL / (unsigned long long)g_stickHz;
+    unsigned long long ticks    = (unsigned long long)g_seconds * (unsigned long long)g_stickHz;
+    unsigned long long burstEvery = g_burstHz > 0 ? (unsigned long long)(g_stickHz / g_burstHz) : 0;
+    struct input_event evs[3];
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (unsigned long long t = 0; t < ticks; t++) {
+        for (int d = 0; d < g_devices; d++) {
+            struct BenchDev* b = &g_bench[d];
+            __s32 v = (__s32)((t * 37 + 1) % 65535) - 32767;  /* never repeats tick to tick */
+            setEvent(&evs[0], EV_ABS, ABS_X, v);
+            setEvent(&evs[1], EV_ABS, ABS_Y, -v);
+            setEvent(&evs[2], EV_SYN, SYN_REPORT, 0);
+            sendFrame(b, evs, 3);
+
+            if (burstEvery && t % burstEvery == 0) {
+                for (int i = 0; i < g_burst; i++) {
+                    b->buttonState ^= 1;
+                    setEvent(&evs[0], EV_KEY, BTN_SOUTH, b->buttonState);
+                    setEvent(&evs[1], EV_SYN, SYN_REPORT, 0);
+                    sendFrame(b, evs, 2);
+                }
+            }
+        }
+
+        next.tv_nsec += (long)periodNs;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    for (int d = 0; d < g_devices; d++) {
+        close(g_bench[d].srcWrite);   /* EOF => the pipeline lets go of it */
+        g_bench[d].srcWrite = -1;
+    }
+    return NULL;
+}
+
+static void* consumerThread(void* arg)
+{
+    (void)arg;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    for (int d = 0; d < g_devices; d++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &g_bench[d] };
+        epoll_ctl(ep, EPOLL_CTL_ADD, g_bench[d].sinkRead, &ev);
+    }
+
+    int open = g_devices;
+    struct input_event buf[GP_READ_BATCH];
+    while (open > 0) {
+        struct epoll_event events[GP_MAX_DEVICES];
+        int n = epoll_wait(ep, events, GP_MAX_DEVICES, 1000);
+        for (int i = 0; i < n; i++) {
+            struct BenchDev* b = (struct BenchDev*)events[i].data.ptr;
+            ssize_t r = read(b->sinkRead, buf, sizeof(buf));
+            if (r == 0) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, b->sinkRead, NULL);
+                open--;
+                continue;
+            }
+            if (r < 0) continue;
+
+            unsigned long long now = nowNs();
+            size_t count = (size_t)r / sizeof(buf[0]);
+            for (size_t k = 0; k < count; k++) {
+                if (buf[k].type != EV_SYN || buf[k].code != SYN_REPORT) continue;
+                unsigned long long sent = b->sendNs[b->received & (BENCH_RING - 1)];
+                b->received++;
+                if (g_sampleCount < BENCH_MAX_SAMPLES) {
+                    g_samples[g_sampleCount++] = (double)(now - sent) / 1e3;
+                }
+            }
+        }
+    }
+    close(ep);
+    return NULL;
+}
+
+static void onSource(struct GpPollSource* src, unsigned int events)
+{
+    (void)events;
+    struct BenchDev* b = (struct BenchDev*)src->ctx;
+    if (gp_device_pump(b->dev) < 0) {
+        close(b->dev->fd);
+        b->dev->fd = -1;
+        b->closed = 1;
+    }
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* v, unsigned long n, double q)
+{
+    if (!n) return 0;
+    unsigned long i = (unsigned long)(q * n + 0.5);
+    return v[i ? (i > n ? n : i) - 1 : 0];
+}
+
+static int setupDevice(int d)
+{
+    static const __u16 keys[] = { BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_START, BTN_SELECT };
+    static const __u16 axes[] = { ABS_X, ABS_Y, ABS_RX, ABS_RY };
+    struct BenchDev* b = &g_bench[d];
+    char name[32];
+
+    if (makeChannel(&b->srcRead, &b->srcWrite) < 0 || makeChannel(&b->sinkRead, &b->sinkWrite) < 0) {
+        perror("[Bench] channel");
+        return -1;
+    }
+    /* Generator blocks on a full source; the pipeline never blocks on a sink. */
+    fcntl(b->srcWrite, F_SETFL, fcntl(b->srcWrite, F_GETFL) & ~O_NONBLOCK);
+    fcntl(b->sinkRead, F_SETFL, fcntl(b->sinkRead, F_GETFL) & ~O_NONBLOCK);
+
+    b->sendNs = calloc(BENCH_RING, sizeof(*b->sendNs));
+    b->dev = gp_device_alloc();
+    if (!b->sendNs || !b->dev) return -1;
+
+    snprintf(name, sizeof(name), "bench%d", d);
+    struct GpStreamCaps caps = {
+        .name = name, .keys = keys, .keyCount = (int)(sizeof(keys) / sizeof(keys[0])),
+        .axes = axes, .axisCount = (int)(sizeof(axes) / sizeof(axes[0])),
+        .absMin = -32768, .absMax = 32767,
+    };
+    if (gp_device_open_stream(b->dev, b->srcRead, &caps) < 0) return -1;
+
+    memset(&b->pad, 0, sizeof(b->pad));
+    b->pad.fd = b->sinkWrite;
+    gp_pad_attach_source(&b->pad, b->dev);
+
+    b->pollSrc.fd      = b->srcRead;
+    b->pollSrc.onEvent = onSource;
+    b->pollSrc.ctx     = b;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    for (int a = 1; a < argc; a++) {
+        if (!strncmp(argv[a], "--devices=", 10))        g_devices   = atoi(argv[a] + 10);
+        else if (!strncmp(argv[a], "--seconds=", 10))   g_seconds   = atoi(argv[a] + 10);
+        else if (!strncmp(argv[a], "--stick-hz=", 11))  g_stickHz   = atoi(argv[a] + 11);
+        else if (!strncmp(argv[a], "--burst=", 8))      g_burst     = atoi(argv[a] + 8);
+        else if (!strncmp(argv[a], "--burst-hz=", 11))  g_burstHz   = atoi(argv[a] + 11);
+        else if (!strcmp(argv[a], "--transport=socketpair")) g_socketpair = 1;
+        else if (!strncmp(argv[a], "--trace", 7) && (!argv[a][7] || argv[a][7] == '=')) {
+            g_trace = 1;
+            if (argv[a][7] == '=') g_tracePath = argv[a] + 8;
+        }
+        else if (strcmp(argv[a], "--transport=pipe")) {
+            fprintf(stderr, "Usage: %s [--devices=N] [--seconds=S] [--stick-hz=HZ] [--burst=FRAMES]"
+                            " [--burst-hz=HZ] [--transport=pipe|socketpair] [--trace[=FILE]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (g_devices < 1) g_devices = 1;
+    if (g_devices > GP_MAX_DEVICES) g_devices = GP_MAX_DEVICES;
+    if (g_stickHz < 1) g_stickHz = 1;
+    if (g_seconds < 1) g_seconds = 1;
+    if (g_burstHz > g_stickHz) g_burstHz = g_stickHz;
+
+    gp_log_init();
+    gp_log_set_level(GP_LOG_CAPTURE, GP_LOG_WARN);
+    gp_log_start();
+
+    if (g_trace && gp_trace_enable(1) < 0) {
+        fprintf(stderr, "[Bench] --trace: tracing is compiled out (make TRACE=1).\n");
+        g_trace = 0;
+    }
+
+    g_samples = malloc(BENCH_MAX_SAMPLES * sizeof(double));
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    for (int d = 0; d < g_devices; d++) {
+        if (setupDevice(d) < 0) {
+            fprintf(stderr, "[Bench] device %d setup failed.\n", d);
+            return 1;
+        }
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.ptr = &g_bench[d].pollSrc };
+        epoll_ctl(ep, EPOLL_CTL_ADD, g_bench[d].srcRead, &ev);
+    }
+
+    printf("[Bench] %d device(s), %d s, sticks %d Hz, bursts of %d at %d Hz, %s\n",
+           g_devices, g_seconds, g_stickHz, g_burst, g_burstHz, g_socketpair ? "socketpair" : "pipe");
+
+    pthread_t gen, con;
+    pthread_create(&con, NULL, consumerThread, NULL);
+    unsigned long long t0 = nowNs();
+    pthread_create(&gen, NULL, generatorThread, NULL);
+
+    /* The pipeline, as in gammapad_main.c. */
+    unsigned long long epollWaits = 0;
+    for (;;) {
+        int closed = 0;
+        for (int d = 0; d < g_devices; d++) closed += g_bench[d].closed;
+        if (closed == g_devices) break;
+
+        struct epoll_event events[GP_MAX_DEVICES];
+        int n = epoll_wait(ep, events, GP_MAX_DEVICES, 100);
+        epollWaits++;
+        for (int i = 0; i < n; i++) {
+            struct GpPollSource* src = (struct GpPollSource*)events[i].data.ptr;
+            src->onEvent(src, events[i].events);
+        }
+    }
+    unsigned long long elapsed = nowNs() - t0;
+
+    pthread_join(gen, NULL);
+    for (int d = 0; d < g_devices; d++) close(g_bench[d].sinkWrite);
+    pthread_join(con, NULL);
+    close(ep);
+
+    struct GpCaptureStats st;
+    gp_capture_stats(&st);
+    unsigned long long sent = 0, received = 0;
+    for (int d = 0; d < g_devices; d++) {
+        sent     += g_bench[d].sent;
+        received += g_bench[d].received;
+    }
+    double secs = (double)elapsed / 1e9;
+    double syscalls = (double)(st.reads + st.writes + epollWaits);
+
+    qsort(g_samples, g_sampleCount, sizeof(double), cmpDouble);
+    printf("[Bench] frames     sent=%llu forwarded=%llu (%.0f/s)\n", sent, received, received / secs);
+    printf("[Bench] events/s   %.0f in (%llu read() calls, %.1f events per read)\n",
+           st.events / secs, st.reads, st.reads ? (double)st.events / st.reads : 0.0);
+    printf("[Bench] syscalls   %.2f per frame (read %llu + write %llu + epoll_wait %llu)\n",
+           sent ? syscalls / sent : 0.0, st.reads, st.writes, epollWaits);
+    printf("[Bench] latency us p50=%.1f p99=%.1f p99.9=%.1f max=%.1f (n=%lu)\n",
+           percentile(g_samples, g_sampleCount, 0.50), percentile(g_samples, g_sampleCount, 0.99),
+           percentile(g_samples, g_sampleCount, 0.999),
+           g_sampleCount ? g_samples[g_sampleCount - 1] : 0.0, g_sampleCount);
+    if (g_trace) {
+        gp_trace_print(stdout);
+        if (g_tracePath && gp_trace_dump(g_tracePath) < 0) perror("[Bench] trace dump");
+    }
+
+    gp_log_stop();
+    return sent == received ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+/*****************************************************
+ * gammapad_calib.c
+ *
+ * Calibration tables + the interactive "calibrate" session.
+ * See gammapad_calib.h.
+ *****************************************************/
+
+#include "gammapad_calib.h"
+#include "gammapad_capture.h"
+#include "gammapad_profile.h"
+#include "gammapad_inputdefs.h"
+#include <math.h>
+
+#define CAL_MIN_SPAN 8      /* smaller travel => not moved (or a hat), not saved */
+
+int gp_cal_rule_set(struct GpCalRule* rules, int* count, const struct GpCalRule* rule)
+{
+    for (int i = 0; i < *count; i++) {
+        struct GpCalRule* r = &rules[i];
+        if (r->code != rule->code) continue;
+        if (rule->set & GP_CAL_SET_RANGE) {
+            r->min    = rule->min;
+            r->center = rule->center;
+            r->max    = rule->max;
+        }
+        if (rule->set & GP_CAL_SET_CURVE) {
+            r->curve      = rule->curve;
+            r->trigger    = rule->trigger;
+            r->expo       = rule->expo;
+            r->pointCount = rule->pointCount;
+            memcpy(r->px, rule->px, sizeof(r->px));
+            memcpy(r->py, rule->py, sizeof(r->py));
+        }
+        r->set |= rule->set;
+        return 0;
+    }
+    if (*count >= GP_CAL_MAX_RULES) return -1;
+    rules[(*count)++] = *rule;
+    return 0;
+}
+
+/*
+ * response => the rule's curve at deflection n (0..1).
+ */
+static float response(const struct GpCalRule* r, float n)
+{
+    if (!(r->set & GP_CAL_SET_CURVE)) return n;
+
+    switch (r->curve) {
+    case GP_CAL_EXPO:
+        return (1.0f - r->expo) * n + r->expo * n * n * n;
+    case GP_CAL_POINTS: {
+        float x0 = 0.0f, y0 = 0.0f;
+        for (int i = 0; i <= r->pointCount; i++) {
+            float x1 = i < r->pointCount ? r->px[i] : 1.0f;
+            float y1 = i < r->pointCount ? r->py[i] : 1.0f;
+            if (n <= x1) {
+                return x1 > x0 ? y0 + (y1 - y0) * (n - x0) / (x1 - x0) : y1;
+            }
+            x0 = x1;
+            y0 = y1;
+        }
+        return 1.0f;
+    }
+    default:
+        return n;
+    }
+}
+
+/*
+ * calibrated => canonical value of raw v. Sticks scale each side of the
+ * center on its own, so an off-center rest still reaches both edges.
+ */
+static __s32 calibrated(const struct GpCalRule* r, int min, int center, int max, int v)
+{
+    if (center == min) {
+        float n = (float)(v - min) / (float)(max - min);
+        if (n < 0.0f) n = 0.0f;
+        if (n > 1.0f) n = 1.0f;
+        return (__s32)lroundf(response(r, n) * GP_CAL_RANGE);
+    }
+    float n;
+    if (v >= center) n = max > center ? (float)(v - center) / (float)(max - center) : 0.0f;
+    else             n = (float)(center - v) / (float)(center - min);
+    if (n > 1.0f) n = 1.0f;
+    __s32 out = (__s32)lroundf(response(r, n) * GP_CAL_RANGE);
+    return v < center ? -out : out;
+}
+
+void gp_calib_free(struct GpCalib* c)
+{
+    for (int i = 0; i < c->count; i++) free(c->axes[i].lut);
+    memset(c, 0, sizeof(*c));
+    memset(c->slot, -1, sizeof(c->slot));
+}
+
+static int buildAxis(struct GpCalib* c, const struct GpCalRule* r,
+                     int* absMin, int* absMax, int* absFuzz, int* absFlat)
+{
+    int code = r->code;
+    if (code > ABS_MAX || c->count >= GP_CAL_MAX_AXES) return -1;
+    if (absMax[code] <= absMin[code]) return -1;           /* not discovered */
+
+    int min, center, max;
+    if (r->set & GP_CAL_SET_RANGE) {
+        min    = r->min;
+        center = r->center;
+        max    = r->max;
+    } else {
+        min    = absMin[code];
+        max    = absMax[code];
+        center = r->trigger ? min : min + (max - min) / 2;
+    }
+    if (max <= min || center < min || center > max) return -1;
+
+    struct GpCalAxis* a = &c->axes[c->count];
+    memset(a, 0, sizeof(*a));
+    unsigned int span = (unsigned int)(max - min);
+    while ((span >> a->shift) + 2 > GP_CAL_LUT_MAX + 2) a->shift++;
+    unsigned int entries = (span >> a->shift) + 2;
+    a->lut = malloc(entries * sizeof(*a->lut));
+    if (!a->lut) return -1;
+
+    for (unsigned int i = 0; i < entries; i++) {
+        long long v = (long long)min + ((long long)i << a->shift);
+        a->lut[i] = calibrated(r, min, center, max, v > max ? max : (int)v);
+    }
+    a->code   = (__u16)code;
+    a->min    = min;
+    a->max    = max;
+    a->outMin = calibrated(r, min, center, max, min);
+    a->outMax = calibrated(r, min, center, max, max);
+
+    /* From here on the device forwards canonical values. */
+    int half = center == min ? max - min : (center - min > max - center ? center - min : max - center);
+    absFuzz[code] = (int)((long long)absFuzz[code] * GP_CAL_RANGE / half);
+    absFlat[code] = (int)((long long)absFlat[code] * GP_CAL_RANGE / half);
+    absMin[code]  = center == min ? 0 : -GP_CAL_RANGE;
+    absMax[code]  = GP_CAL_RANGE;
+
+    c->slot[code] = (signed char)c->count;
+    return c->count++;
+}
+
+int gp_calib_build(struct GpCalib* c, const struct GpCalRule* rules, int ruleCount,
+                   int* absMin, int* absMax, int* absFuzz, int* absFlat)
+{
+    gp_calib_free(c);
+    for (int i = 0; i < ruleCount; i++) {
+        if (buildAxis(c, &rules[i], absMin, absMax, absFuzz, absFlat) < 0) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Calib] axis %d: not present or bad range, left raw.\n",
+                   rules[i].code);
+        }
+    }
+    return c->count;
+}
+
+/* --- interactive session --- */
+
+struct CalObs {
+    int   seen;
+    __s32 min, max, last;
+};
+
+int g_gpCalibrating = 0;
+static struct CalObs g_obs[GP_MAX_DEVICES][ABS_MAX + 1];
+
+void gp_calib_observe(int device, unsigned int code, __s32 value)
+{
+    if (device < 0 || device >= GP_MAX_DEVICES || code > ABS_MAX) return;
+    struct CalObs* o = &g_obs[device][code];
+    if (!o->seen || value < o->min) o->min = value;
+    if (!o->seen || value > o->max) o->max = value;
+    o->last = value;
+    o->seen = 1;
+}
+
+void gp_calib_start(void)
+{
+    memset(g_obs, 0, sizeof(g_obs));
+    g_gpCalibrating = 1;
+}
+
+void gp_calib_cancel(void)
+{
+    g_gpCalibrating = 0;
+}
+
+static int moved(const struct CalObs* o)
+{
+    return o->seen && o->max - o->min >= CAL_MIN_SPAN;
+}
+
+void gp_calib_status(FILE* out)
+{
+    fprintf(out, "[Calib] %s\n", g_gpCalibrating ? "recording" : "not running");
+    for (int d = 0; d < gp_device_count() && d < GP_MAX_DEVICES; d++) {
+        for (int code = 0; code <= ABS_MAX; code++) {
+            const struct CalObs* o = &g_obs[d][code];
+            if (!o->seen) continue;
+            const char* name = gp_code_name(EV_ABS, code);
+            fprintf(out, "[Calib] device %d %-10s min=%d max=%d now=%d%s\n", d, name ? name : "?",
+                    o->min, o->max, o->last, moved(o) ? "" : " (not moved)");
+        }
+    }
+}
+
+/*
+ * writeDevice => the .cal for one device's vendor/product. Returns axes
+ * written, 0 if none moved, -1 on error.
+ */
+static int writeDevice(const struct GpDevice* dev)
+{
+    const struct CalObs* obs = g_obs[dev->index];
+    int axes = 0;
+    for (int code = 0; code <= ABS_MAX; code++) axes += moved(&obs[code]);
+    if (!axes) return 0;
+
+    char path[512];
+    gp_profile_path(&dev->id, "cal", path, sizeof(path));
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[Calib] '%s' => %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "# GammaPad calibration of '%s' (calibrate save)\n", dev->inputName);
+    for (int code = 0; code <= ABS_MAX; code++) {
+        const struct CalObs* o = &obs[code];
+        if (!moved(o)) continue;
+        int center = o->last;
+        if (center - o->min <= (o->max - o->min) / 10) center = o->min;     /* trigger at rest */
+        const char* name = gp_code_name(EV_ABS, code);
+        if (name) fprintf(f, "calib %s min=%d center=%d max=%d\n", name, o->min, center, o->max);
+        else      fprintf(f, "calib %d min=%d center=%d max=%d\n", code, o->min, center, o->max);
+    }
+    if (fclose(f) != 0) return -1;
+    GP_LOG(GP_LOG_CMD, GP_LOG_INFO, "[Calib] device %d => %d axes in '%s'\n", dev->index, axes, path);
+    return axes;
+}
+
+int gp_calib_save(void)
+{
+    if (!g_gpCalibrating) return -1;
+    g_gpCalibrating = 0;
+
+    int written = 0;
+    for (int d = 0; d < gp_device_count() && d < GP_MAX_DEVICES; d++) {
+        if (writeDevice(gp_device_at(d)) > 0) written++;
+    }
+    return written;
+}
@@ -0,0 +1,131 @@
+#ifndef GAMMAPAD_CALIB_H
+#define GAMMAPAD_CALIB_H
+
+#include "gammapad.h"
+#include <linux/input.h>
+
+/*
+ * gammapad_calib.h
+ *
+ * Axis calibration. A calibrated axis goes through a table, built once
+ * when the device is opened, that centers it, normalizes it to the
+ * canonical range and applies its response curve. The event path does a
+ * table lookup instead of floating-point math.
+ *
+ * Canonical ranges, also what the virtual pad advertises for those axes:
+ *   sticks   => -GP_CAL_RANGE..GP_CAL_RANGE, rest at 0
+ *   triggers => 0..GP_CAL_RANGE (center == min)
+ *
+ * Both sources are per vendor/product, in the profile dir (gammapad_profile.h):
+ *   Vendor_vvvv_Product_pppp.cal => written by "calibrate save"
+ *       calib <sc> min=N center=N max=N
+ *   Vendor_vvvv_Product_pppp.gp  => response curves, by hand
+ *       curve <sc> linear [trigger]
+ *       curve <sc> expo=P [trigger]           P% cubic blend, 0..100
+ *       curve <sc> points=X:Y,X:Y,... [trigger]
+ *                                             deflection in => out, in percent;
+ *                                             0:0 and 100:100 are implied
+ * An axis with a curve but no calib line uses its discovered range, with
+ * the center in the middle ('trigger' => at the minimum). An axis with
+ * neither is forwarded raw, as before.
+ *
+ * Tables hold one __s32 per raw value for ranges up to GP_CAL_LUT_MAX.
+ * Wider ranges (16-bit sticks) keep every 2^shift-th value and
+ * interpolate between neighbours in fixed point.
+ *
+ * Interactive calibration, from the console:
+ *   calibrate start   => record every raw EV_ABS value, per device
+ *   (move every stick and trigger through its full travel, let go)
+ *   calibrate save    => extremes become min/max, the released value the
+ *                        center; writes the .cal of every device moved
+ *   calibrate status | cancel
+ * A center within 10% of the minimum is taken as a trigger's rest
+ * (center = min). The new tables apply the next time the device is
+ * opened (replug or restart), because the pad's ranges may change.
+ */
+
+#define GP_CAL_RANGE      32767
+#define GP_CAL_LUT_MAX    4096      /* direct table up to this many raw values */
+#define GP_CAL_MAX_RULES  16
+#define GP_CAL_MAX_AXES   16
+#define GP_CAL_MAX_POINTS 8
+
+enum {
+    GP_CAL_SET_RANGE = 1 << 0,      /* calib line: min/center/max */
+    GP_CAL_SET_CURVE = 1 << 1       /* curve line */
+};
+
+enum GpCalCurve {
+    GP_CAL_LINEAR = 0,
+    GP_CAL_EXPO,
+    GP_CAL_POINTS
+};
+
+struct GpCalRule {
+    __u16 code;
+    int   set;                      /* GP_CAL_SET_* */
+    int   min, center, max;
+    int   curve;                    /* enum GpCalCurve */
+    int   trigger;                  /* curve only: rests at the minimum */
+    float expo;                     /* 0..1 */
+    int   pointCount;
+    float px[GP_CAL_MAX_POINTS];    /* 0..1, increasing */
+    float py[GP_CAL_MAX_POINTS];
+};
+
+struct GpCalAxis {
+    __u16  code;
+    int    min, max;                /* raw range covered by the table */
+    int    shift;                   /* raw values per entry = 1 << shift */
+    __s32  outMin, outMax;          /* below min / above max */
+    __s32* lut;
+};
+
+struct GpCalib {
+    int count;
+    struct GpCalAxis axes[GP_CAL_MAX_AXES];
+    signed char slot[ABS_MAX + 1];  /* code => index in axes, -1 => raw */
+};
+
+/* Add or merge (calib + curve) the rule for rule->code. Returns 0, or -1 when full. */
+int  gp_cal_rule_set(struct GpCalRule* rules, int* count, const struct GpCalRule* rule);
+
+/*
+ * gp_calib_build => tables for every rule whose axis the device has
+ * (c must be zeroed or previously built; old tables are freed). Rewrites
+ * the axis' entries in absMin/absMax to the canonical range and scales
+ * absFuzz/absFlat to match. Returns the number of calibrated axes.
+ */
+int  gp_calib_build(struct GpCalib* c, const struct GpCalRule* rules, int ruleCount,
+                    int* absMin, int* absMax, int* absFuzz, int* absFlat);
+void gp_calib_free(struct GpCalib* c);
+
+/* Event path: raw value => calibrated value (raw when not calibrated). */
+static inline __s32 gp_calib_map(const struct GpCalib* c, unsigned int code, __s32 v)
+{
+    if (!c->count || code > ABS_MAX || c->slot[code] < 0) return v;
+    const struct GpCalAxis* a = &c->axes[(int)c->slot[code]];
+    if (v <= a->min) return a->outMin;
+    if (v >= a->max) return a->outMax;
+
+    unsigned int off = (unsigned int)(v - a->min);
+    unsigned int i   = off >> a->shift;
+    if (!a->shift) return a->lut[i];
+    __s32 lo = a->lut[i];
+    __s32 hi = a->lut[i + 1];
+    return lo + (__s32)(((long long)(hi - lo) * (off & ((1u << a->shift) - 1))) >> a->shift);
+}
+
+/* Interactive session (main thread). */
+extern int g_gpCalibrating;
+#define GP_CALIB_ON() __builtin_expect(g_gpCalibrating, 0)
+
+void gp_calib_observe(int device, unsigned int code, __s32 value);
+void gp_calib_start(void);
+void gp_calib_cancel(void);
+void gp_calib_status(FILE* out);
+
+/* Write the .cal files. Returns devices written, or -1 if no session is running. */
+int  gp_calib_save(void);
+
+#endif /* GAMMAPAD_CALIB_H */
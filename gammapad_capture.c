@@ -1,4 +1,10 @@
 #include "gammapad_capture.h"
+#include "gammapad_profile.h"
+#include "gammapad_sysfs.h"
+#include "gammapad_timer.h"
+#include "gammapad_record.h"
+#include "gammapad_trace.h"
+#include <poll.h>
 #include <sys/epoll.h>
 #include <linux/input.h>
 #include <errno.h>
@@ -7,292 +13,128 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-
-/* We'll rely on the global 'controllerFd' declared in gammapad_main.c. */
-extern int controllerFd;
-
-/*
- * We'll store:
- *   - The identified driver path (e.g. "/sys/bus/platform/drivers/retrogame_joypad")
- *   - The real device name (e.g. "singleadc-joypad")
- *   - Whether we successfully identified them => gHasDriver=1
- */
-static char g_driverPath[256];
-static char g_deviceName[256];
-static int  gHasDriver = 0; // Whether we identified a driver
-
-/*
- * We'll store discovered scancodes for EV_KEY and EV_ABS, plus min/max.
- */
-int g_discoveredKeys[KEY_MAX+1];
-int g_discoveredAxes[ABS_MAX+1];
-static int g_physicalAbsMin[ABS_MAX+1];
-static int g_physicalAbsMax[ABS_MAX+1];
+#include <limits.h>
 
 /*
- * scancode => final code if .kl says so; fallback is same scancode if not mapped.
+ * Every captured device gets a GpDevice slot (see gammapad_capture.h).
+ * The table only changes from the main loop (slots that never got a pad
+ * are reused), and stays valid for the destructor, which releases each
+ * device at exit.
  */
-int g_keyMap[KEY_MAX+1];
-int g_absMap[ABS_MAX+1];
+static struct GpDevice g_devices[GP_MAX_DEVICES];
+static int g_deviceCount = 0;
+static unsigned char g_slotFree[GP_MAX_DEVICES];   /* given back by gp_device_free() */
 
 /*
- * We'll also store the device path in g_physicalDevicePath
- * so we can remove it in the destructor.
+ * Scratch builder used while opening a device; the compiled result lives
+ * in GpDevice.routes. Setup only runs on the main thread.
  */
-static char g_physicalDevicePath[256];
+static struct GpRouteBuilder g_routeBuilder;
 
-/*
- * Accessors used by gammapad_controller.c => get raw min/max
- */
-int getPhysicalAbsMin(int scancode)
+struct GpDevice* gp_device_alloc(void)
 {
-    if (scancode < 0 || scancode > ABS_MAX) return -32768;
-    return g_physicalAbsMin[scancode];
+    struct GpDevice* dev = NULL;
+    for (int i = 0; i < g_deviceCount && !dev; i++) {
+        if (g_slotFree[i]) dev = &g_devices[i];
+    }
+    if (!dev) {
+        if (g_deviceCount >= GP_MAX_DEVICES) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR,
+                "[GammaPadCapture] Too many devices (max %d).\n", GP_MAX_DEVICES);
+            return NULL;
+        }
+        dev = &g_devices[g_deviceCount++];
+    }
+    int index = (int)(dev - g_devices);
+    memset(dev, 0, sizeof(*dev));
+    dev->fd    = -1;
+    dev->index = index;
+    g_slotFree[index] = 0;
+    return dev;
 }
 
-int getPhysicalAbsMax(int scancode)
+void gp_device_free(struct GpDevice* dev)
 {
-    if (scancode < 0 || scancode > ABS_MAX) return 32767;
-    return g_physicalAbsMax[scancode];
+    if (!dev || dev->pad) return;
+    close_physical_device(dev);
+    gp_route_table_free(&dev->routes);
+    gp_calib_free(&dev->calib);
+    dev->path[0]   = 0;
+    dev->hasDriver = 0;
+    g_slotFree[dev->index] = 1;
+    while (g_deviceCount > 0 && g_slotFree[g_deviceCount - 1]) {
+        g_slotFree[--g_deviceCount] = 0;
+    }
 }
 
-/****************************************************************************
- * readLinkFully:
- *   Runs "readlink -f <somePath>", capturing the fully resolved path into
- *   outBuf. If successful, outBuf might look like:
- *       "/sys/devices/platform/singleadc-joypad/input/input183"
- * Return 0 on success, -1 on failure.
- ****************************************************************************/
-static int readLinkFully(const char* path, char* outBuf, size_t outSize)
+int gp_device_count(void)
 {
-    if (!path || !outBuf || outSize < 2) return -1;
-
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "readlink -f '%s' 2>/dev/null", path);
-
-    FILE* fp = popen(cmd, "r");
-    if (!fp) {
-        return -1;
-    }
-
-    char line[1024];
-    if (!fgets(line, sizeof(line), fp)) {
-        pclose(fp);
-        return -1;
-    }
-    pclose(fp);
-
-    // strip newline
-    char* nl = strchr(line, '\n');
-    if (nl) *nl = 0;
-
-    if (!line[0]) return -1;
-    snprintf(outBuf, outSize, "%s", line);
-    return 0;
+    return g_deviceCount;
 }
 
-/****************************************************************************
- * skipDotSlashes:
- *   Helper to skip leading "../" or "./" from a path so we can build
- *   an absolute path under /sys/... if needed.
- ****************************************************************************/
-static const char* skipDotSlashes(const char* str)
+struct GpDevice* gp_device_at(int index)
 {
-    while (str[0] == '.') {
-        if (str[1] == '/') {
-            str += 2; // skip "./"
-        } else if (str[1] == '.' && str[2] == '/') {
-            str += 3; // skip "../"
-        } else {
-            break;
-        }
-    }
-    while (*str == '/') {
-        ++str; // skip any leading slashes
-    }
-    return str;
+    if (index < 0 || index >= g_deviceCount) return NULL;
+    return &g_devices[index];
 }
 
-/****************************************************************************
- * tryLsDriverPath:
- *   We'll do "ls -l /sys/class/input/<evName>/device/<subdir>driver"
- *   to parse if it points to e.g. "../../bus/platform/drivers/retrogame_joypad".
- *   Then store that as outDriverPath => "/sys/bus/platform/drivers/retrogame_joypad"
- ****************************************************************************/
-static int tryLsDriverPath(const char* evName,
-                           const char* subdir,
-                           char* outDriverPath, size_t dpSize)
+/*
+ * resetAxes => forget the ranges and absinfo of a previous open.
+ */
+static void resetAxes(struct GpDevice* dev)
 {
-    if (!evName || !outDriverPath) return -1;
-
-    char driverLink[512];
-    snprintf(driverLink, sizeof(driverLink),
-             "/sys/class/input/%s/device/%sdriver", evName, subdir);
-
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "ls -l '%s' 2>/dev/null", driverLink);
-
-    FILE* fp = popen(cmd, "r");
-    if (!fp) return -1;
-
-    char line[1024];
-    if (!fgets(line, sizeof(line), fp)) {
-        pclose(fp);
-        return -1;
-    }
-    pclose(fp);
-
-    /* Example:
-       "lrwxrwxrwx 1 root root 0 2023-12-01 12:00 driver -> ../../bus/platform/drivers/retrogame_joypad"
-    */
-    const char* arrow = strstr(line, "-> ");
-    if (!arrow) return -1;
-    arrow += 3; // skip "-> "
-
-    const char* pathPart = skipDotSlashes(arrow);
-    snprintf(outDriverPath, dpSize, "/sys/%s", pathPart);
-
-    char* nl = strchr(outDriverPath, '\n');
-    if (nl) *nl = 0;
-
-    return 0;
+    memset(dev->absMin, 0, sizeof(dev->absMin));
+    memset(dev->absMax, 0, sizeof(dev->absMax));
+    memset(dev->absFuzz, 0, sizeof(dev->absFuzz));
+    memset(dev->absFlat, 0, sizeof(dev->absFlat));
+    memset(dev->absRes, 0, sizeof(dev->absRes));
 }
 
-/****************************************************************************
- * climbUpIfInInputSubdir:
- *   If resolved is something like:
- *       "/sys/devices/platform/singleadc-joypad/input/input183"
- *   and we see that it ends with "input/input<number>", we'll cut that
- *   portion so that we revert to "/sys/devices/platform/singleadc-joypad".
- ****************************************************************************/
-static void climbUpIfInInputSubdir(char* resolved)
-{
-    if (!resolved || !resolved[0]) return;
-    char* p = strstr(resolved, "/input/input");
-    if (!p) return;
-    *p = '\0';
-}
-
-/****************************************************************************
- * identifyDriverAndDevice:
- *   eventNode might be "/dev/input/event4" => evBase = "event4"
- *   1) We parse out the driver path from device/driver or device/device/driver
- *   2) We readlink -f /sys/class/input/<evBase>/device => e.g.
- *       "/sys/devices/platform/singleadc-joypad/input/input183"
- *      Then we detect the "/input/input" suffix -> cut it => 
- *       "/sys/devices/platform/singleadc-joypad"
- *      Then parse final slash => "singleadc-joypad"
- ****************************************************************************/
-static int identifyDriverAndDevice(const char* eventNode,
-                                   char* outDriverPath, size_t dpSize,
-                                   char* outDeviceName, size_t dnSize)
-{
-    if (!eventNode || !outDriverPath || !outDeviceName) return -1;
-
-    const char* evBase = strrchr(eventNode, '/');
-    if (!evBase) evBase = eventNode; 
-    else evBase++;
-
-    /* Step 1: Try to get the driver path. */
-    if (tryLsDriverPath(evBase, "", outDriverPath, dpSize) < 0) {
-        // fallback => device/device/driver
-        if (tryLsDriverPath(evBase, "device/", outDriverPath, dpSize) < 0) {
-            return -1;
-        }
-    }
-
-    /* Step 2: readlink -f => e.g. "/sys/class/input/<evBase>/device" */
-    char deviceSymlink[512];
-    snprintf(deviceSymlink, sizeof(deviceSymlink),
-             "/sys/class/input/%s/device", evBase);
-
-    char resolved[512];
-    if (readLinkFully(deviceSymlink, resolved, sizeof(resolved)) < 0) {
-        return -1;
+/*
+ * buildCalib => lookup tables for the profile's calib/curve axes. Comes
+ * before buildFilter, which then works on the canonical ranges.
+ */
+static void buildCalib(struct GpDevice* dev)
+{
+    int n = gp_calib_build(&dev->calib, g_routeBuilder.calib, g_routeBuilder.calibCount,
+                           dev->absMin, dev->absMax, dev->absFuzz, dev->absFlat);
+    if (n > 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] device #%d => %d calibrated axes.\n",
+            dev->index, n);
     }
-
-    climbUpIfInInputSubdir(resolved);
-
-    const char* lastSlash = strrchr(resolved, '/');
-    if (!lastSlash) return -1;
-    lastSlash++;
-    if (!*lastSlash) return -1;
-
-    snprintf(outDeviceName, dnSize, "%s", lastSlash);
-
-    fprintf(stderr,
-        "[GammaPadCapture] driverPath='%s', deviceName='%s'\n",
-        outDriverPath, outDeviceName);
-
-    return 0;
 }
 
 /*
- * We'll do unbind 3 times, then bind 3 times, each step 1 second apart,
- * writing directly to /sys/bus/platform/drivers/<driver>/unbind etc.
+ * buildFilter => the profile's filter/stick rules for this device's axes.
  */
-static void unbindAndRebind(void)
+static void buildFilter(struct GpDevice* dev)
 {
-    if (!gHasDriver) {
-        fprintf(stderr, "[GammaPadCapture] No valid driver to unbind.\n");
-        return;
-    }
-    if (!g_driverPath[0] || !g_deviceName[0]) {
-        fprintf(stderr, "[GammaPadCapture] Missing driver/device for unbind.\n");
-        return;
-    }
-
-    fprintf(stderr,
-        "[GammaPadCapture] We'll unbind 3 times, then bind 3 times, each step 1 sec apart.\n"
-        " driverPath='%s', deviceName='%s'\n",
-        g_driverPath, g_deviceName);
-
-    // 1) Unbind 3 times
-    for (int i = 1; i <= 3; i++) {
-        char unbindPath[512];
-        snprintf(unbindPath, sizeof(unbindPath), "%s/unbind", g_driverPath);
-
-        fprintf(stderr, "[GammaPadCapture] [unbind #%d] Opening '%s' for write.\n", i, unbindPath);
-
-        FILE* fUnbind = fopen(unbindPath, "w");
-        if (!fUnbind) {
-            fprintf(stderr, "[GammaPadCapture] [unbind #%d] Failed to open '%s': %s\n",
-                    i, unbindPath, strerror(errno));
-        } else {
-            fprintf(stderr, "[GammaPadCapture] [unbind #%d] Writing '%s'...\n", i, g_deviceName);
-            fprintf(fUnbind, "%s\n", g_deviceName);
-            fclose(fUnbind);
-        }
-        sleep(1);
+    int n = gp_filter_build(&dev->filter, g_routeBuilder.filters, g_routeBuilder.filterCount,
+                            dev->absMin, dev->absMax);
+    if (n > 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] device #%d => %d filtered axes.\n",
+            dev->index, n);
     }
+}
 
-    // 2) Bind 3 times
-    for (int i = 1; i <= 3; i++) {
-        char bindPath[512];
-        snprintf(bindPath, sizeof(bindPath), "%s/bind", g_driverPath);
-
-        fprintf(stderr, "[GammaPadCapture] [bind #%d] Opening '%s' for write.\n", i, bindPath);
-
-        FILE* fBind = fopen(bindPath, "w");
-        if (!fBind) {
-            fprintf(stderr, "[GammaPadCapture] [bind #%d] Failed to open '%s': %s\n",
-                    i, bindPath, strerror(errno));
-        } else {
-            fprintf(stderr, "[GammaPadCapture] [bind #%d] Writing '%s'...\n", i, g_deviceName);
-            fprintf(fBind, "%s\n", g_deviceName);
-            fclose(fBind);
-        }
-        sleep(1);
+/*
+ * buildRate => the profile's output rate limit (see GpPad).
+ */
+static void buildRate(struct GpDevice* dev)
+{
+    int hz = g_routeBuilder.outputRateHz;
+    dev->rateNs = hz > 0 ? 1000000000ULL / (unsigned long long)hz : 0;
+    if (hz > 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] device #%d => axis frames at most %d/s.\n",
+            dev->index, hz);
     }
-
-    fprintf(stderr, "[GammaPadCapture] Done unbind/rebind cycles.\n");
 }
 
 /*
  * We'll handle collisions here so that scancode=2 or scancode=5 overshadow scancode=9 or 10
  * if they map to the same final axis code, etc.
  */
-static void resolveAxisCollisions(void)
+void resolveAxisCollisions(const struct GpDevice* dev, struct GpRouteBuilder* b)
 {
     /*
      * We'll track which final axes are "taken," storing which scancode
@@ -312,11 +154,18 @@ static void resolveAxisCollisions(void)
     }
 
     for (int sc=0; sc<=ABS_MAX; sc++){
-        if (!g_discoveredAxes[sc]) continue;
-        int finalAxis = g_absMap[sc];
+        if (!gp_test_bit(b->absBits, sc)) continue;
+
+        /* Only plain axis => axis routes can collide; identity if no rule. */
+        int finalAxis = sc;
+        struct GpRoute* rule = gp_route_builder_find(b, EV_ABS, sc);
+        if (rule) {
+            if (rule->action != GP_ROUTE_ABS) continue;
+            finalAxis = rule->outCode;
+        }
         if (finalAxis<0 || finalAxis>ABS_MAX) continue;
 
-        int range = g_physicalAbsMax[sc] - g_physicalAbsMin[sc];
+        int range = dev->absMax[sc] - dev->absMin[sc];
         if (range < 0) range = -range;
 
         if (finalUsed[finalAxis].scancode < 0) {
@@ -336,31 +185,27 @@ static void resolveAxisCollisions(void)
                 // new sc is sc=2 or sc=5 => overshadow old sc
                 finalUsed[finalAxis].scancode = sc;
                 finalUsed[finalAxis].range    = range;
-                g_discoveredAxes[oldSc] = 0;
-                g_absMap[oldSc]         = -1;
-                fprintf(stderr,"[Capture] collision: finalAxis=%d oldSc=%d replaced by real trigger sc=%d\n",
+                gp_route_builder_set(b, EV_ABS, oldSc, GP_ROUTE_DROP, 0, 0);
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Capture] collision: finalAxis=%d oldSc=%d replaced by real trigger sc=%d\n",
                     finalAxis, oldSc, sc);
             }
             else if (isOldTrigger && !isNewTrigger) {
                 // old sc=2 or 5 => overshadow sc
-                g_discoveredAxes[sc] = 0;
-                g_absMap[sc]         = -1;
-                fprintf(stderr,"[Capture] collision: finalAxis=%d sc=%d overshadowed by old real trigger sc=%d\n",
+                gp_route_builder_set(b, EV_ABS, sc, GP_ROUTE_DROP, 0, 0);
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Capture] collision: finalAxis=%d sc=%d overshadowed by old real trigger sc=%d\n",
                     finalAxis, sc, oldSc);
             } else {
                 // both triggers or both not triggers => pick bigger range
                 if (range > oldRange) {
                     finalUsed[finalAxis].scancode = sc;
                     finalUsed[finalAxis].range    = range;
-                    g_discoveredAxes[oldSc] = 0;
-                    g_absMap[oldSc]         = -1;
-                    fprintf(stderr,"[Capture] collision: finalAxis=%d oldSc=%d replaced by sc=%d w/ bigger range\n",
+                    gp_route_builder_set(b, EV_ABS, oldSc, GP_ROUTE_DROP, 0, 0);
+                    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Capture] collision: finalAxis=%d oldSc=%d replaced by sc=%d w/ bigger range\n",
                         finalAxis, oldSc, sc);
                 } else {
                     // keep old => unmap sc
-                    g_discoveredAxes[sc] = 0;
-                    g_absMap[sc]         = -1;
-                    fprintf(stderr,"[Capture] collision: finalAxis=%d sc=%d overshadowed by old sc=%d w/ bigger range\n",
+                    gp_route_builder_set(b, EV_ABS, sc, GP_ROUTE_DROP, 0, 0);
+                    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Capture] collision: finalAxis=%d sc=%d overshadowed by old sc=%d w/ bigger range\n",
                         finalAxis, sc, oldSc);
                 }
             }
@@ -372,144 +217,815 @@ static void resolveAxisCollisions(void)
  * open_physical_device:
  *   1) parse the driver path & device name from sysfs
  *   2) open + grab the device
- *   3) parse .kl + discover keys+axes
+ *   3) parse .kl + GammaPad profile, discover keys+axes
  *   4) call resolveAxisCollisions() => ensure triggers not overshadowed
- *   5) store the path => destructor can remove it at exit
+ *   5) compile the routing table used by forward_physical_event()
+ *   6) store the path in the GpDevice => destructor can remove it at exit
  */
-int open_physical_device(const char* device_path)
+int open_physical_device(struct GpDevice* dev, const char* device_path)
 {
-    if (!device_path) return -1;
+    if (!dev || !device_path) return -1;
 
     int fd = open(device_path, O_RDWR | O_NONBLOCK);
     if (fd < 0) {
-        fprintf(stderr, "[GammaPadCapture] Failed to open %s: %s\n",
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] Failed to open %s: %s\n",
                 device_path, strerror(errno));
         return -1;
     }
+    dev->fd = fd;
 
-    if (identifyDriverAndDevice(
-            device_path,
-            g_driverPath, sizeof(g_driverPath),
-            g_deviceName, sizeof(g_deviceName))==0)
-    {
-        gHasDriver = 1;
+    struct GpSysfsInfo sys;
+    if (gp_sysfs_identify(device_path, &sys) == 0) {
+        snprintf(dev->driverPath, sizeof(dev->driverPath), "%s", sys.driverPath);
+        snprintf(dev->deviceName, sizeof(dev->deviceName), "%s", sys.deviceName);
+        dev->hasDriver = 1;
     } else {
-        fprintf(stderr,
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN,
             "[GammaPadCapture] Could not identify driver/device from sysfs for '%s', skipping unbind.\n",
             device_path);
-        gHasDriver = 0;
+        dev->hasDriver = 0;
     }
 
-    memset(g_physicalDevicePath,0,sizeof(g_physicalDevicePath));
-    strncpy(g_physicalDevicePath, device_path, sizeof(g_physicalDevicePath)-1);
+    snprintf(dev->path, sizeof(dev->path), "%s", device_path);
 
-    for (int i=0; i<=KEY_MAX; i++){
-        g_keyMap[i] = i;
-        g_discoveredKeys[i] = 0;
-    }
-    for (int i=0; i<=ABS_MAX; i++){
-        g_absMap[i] = i;
-        g_discoveredAxes[i] = 0;
-        g_physicalAbsMin[i] = 0;
-        g_physicalAbsMax[i] = 0;
-    }
+    memset(&dev->id, 0, sizeof(dev->id));
+    memset(dev->inputName, 0, sizeof(dev->inputName));
+    memset(dev->phys, 0, sizeof(dev->phys));
+    ioctl(fd, EVIOCGID, &dev->id);
+    ioctl(fd, EVIOCGNAME(sizeof(dev->inputName) - 1), dev->inputName);
+    ioctl(fd, EVIOCGPHYS(sizeof(dev->phys) - 1), dev->phys);
+    if (!dev->phys[0]) snprintf(dev->phys, sizeof(dev->phys), "%s", sys.phys);
+    snprintf(dev->uniq, sizeof(dev->uniq), "%s", sys.uniq);
+    snprintf(dev->bus, sizeof(dev->bus), "%s", sys.bus);
+
+    gp_route_builder_reset(&g_routeBuilder);
+    resetAxes(dev);
 
 #ifdef __ANDROID__
-    parse_android_keylayout_file_if_needed(fd);
+    parse_android_keylayout_file_if_needed(fd, &g_routeBuilder);
 #endif
+    /* GammaPad profile comes after the .kl so its rules win. */
+    gp_profile_load_for_device(fd, &g_routeBuilder);
 
-    discoverKeys(fd);
-    discoverAxes(fd);
-    resolveAxisCollisions();
+    discoverKeys(dev, &g_routeBuilder);
+    discoverAxes(dev, &g_routeBuilder);
+    if (g_gpRecording) {
+        gp_record_device(dev->index, dev->inputName, &dev->id, &g_routeBuilder, dev->absMin, dev->absMax);
+    }
+    resolveAxisCollisions(dev, &g_routeBuilder);
+
+    if (gp_route_table_build(&dev->routes, &g_routeBuilder) < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR,
+            "[GammaPadCapture] Could not build routing table for '%s'.\n", device_path);
+        close(fd);
+        dev->fd = -1;
+        dev->hasDriver = 0;  /* never captured => nothing to remove or rebind */
+        dev->path[0] = 0;
+        return -1;
+    }
+    buildCalib(dev);
+    buildFilter(dev);
+    buildRate(dev);
 
     if (ioctl(fd, EVIOCGRAB, 1) < 0) {
-        fprintf(stderr, "[GammaPadCapture] EVIOCGRAB on %s failed: %s\n",
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] EVIOCGRAB on %s failed: %s\n",
                 device_path, strerror(errno));
     }
 
-    fprintf(stderr,"[GammaPadCapture] open_physical_device => '%s' opened.\n", device_path);
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] open_physical_device => '%s' opened as device #%d.\n",
+        device_path, dev->index);
     return fd;
 }
 
 /*
- * forward_physical_event:
- *   Forwards EV_KEY/EV_ABS to the global 'controllerFd'.
- *   We do scancode => final code transform if .kl says so.
+ * finishStreamOpen => shared tail of the fd-backed opens: resolve axis
+ * collisions in g_routeBuilder and compile the routes.
+ */
+static int finishStreamOpen(struct GpDevice* dev)
+{
+    if (g_gpRecording) {
+        gp_record_device(dev->index, dev->inputName, &dev->id, &g_routeBuilder, dev->absMin, dev->absMax);
+    }
+    resolveAxisCollisions(dev, &g_routeBuilder);
+
+    if (gp_route_table_build(&dev->routes, &g_routeBuilder) < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR,
+            "[GammaPadCapture] Could not build routing table for '%s'.\n", dev->path);
+        dev->fd = -1;
+        dev->path[0] = 0;
+        return -1;
+    }
+    buildCalib(dev);
+    buildFilter(dev);
+    buildRate(dev);
+
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] '%s' (fd=%d) opened as device #%d.\n",
+        dev->path, dev->fd, dev->index);
+    return dev->fd;
+}
+
+int gp_device_open_stream(struct GpDevice* dev, int fd, const struct GpStreamCaps* caps)
+{
+    if (!dev || fd < 0 || !caps) return -1;
+
+    dev->fd        = fd;
+    dev->hasDriver = 0;   /* nothing to unbind/rebind at exit */
+    dev->id        = caps->id;
+    snprintf(dev->path, sizeof(dev->path), "stream:%s", caps->name ? caps->name : "?");
+    snprintf(dev->inputName, sizeof(dev->inputName), "%s", caps->name ? caps->name : "");
+    dev->phys[0] = dev->uniq[0] = dev->bus[0] = 0;
+
+    gp_route_builder_reset(&g_routeBuilder);
+    resetAxes(dev);
+    for (int i = 0; i < caps->keyCount; i++) {
+        if (caps->keys[i] <= KEY_MAX) gp_set_bit(g_routeBuilder.keyBits, caps->keys[i]);
+    }
+    for (int i = 0; i < caps->axisCount; i++) {
+        int code = caps->axes[i];
+        if (code > ABS_MAX) continue;
+        gp_set_bit(g_routeBuilder.absBits, code);
+        dev->absMin[code] = caps->absMin;
+        dev->absMax[code] = caps->absMax;
+    }
+    for (int i = 0; i < caps->profileCount; i++) {
+        if (gp_profile_parse_line(&g_routeBuilder, caps->profile[i]) < 0) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] '%s': cannot parse '%s'\n",
+                dev->path, caps->profile[i]);
+        }
+    }
+    return finishStreamOpen(dev);
+}
+
+int gp_device_open_replay(struct GpDevice* dev, int fd, const struct GpRecDevice* meta)
+{
+    if (!dev || fd < 0 || !meta) return -1;
+
+    dev->fd        = fd;
+    dev->hasDriver = 0;
+    dev->id        = meta->id;
+    snprintf(dev->path, sizeof(dev->path), "stream:%s", meta->name);
+    snprintf(dev->inputName, sizeof(dev->inputName), "%s", meta->name);
+    dev->phys[0] = dev->uniq[0] = dev->bus[0] = 0;
+
+    resetAxes(dev);
+    gp_rec_device_to_builder(meta, &g_routeBuilder, dev->absMin, dev->absMax);
+    for (int code = 0; code <= ABS_MAX; code++) {
+        /* No EVIOCGABS here => only the profile's absinfo lines. */
+        const struct GpAbsOverride* o = &g_routeBuilder.absOverride[code];
+        if (o->set & GP_ABS_SET_FUZZ) dev->absFuzz[code] = o->fuzz;
+        if (o->set & GP_ABS_SET_FLAT) dev->absFlat[code] = o->flat;
+        if (o->set & GP_ABS_SET_RES)  dev->absRes[code]  = o->resolution;
+    }
+    return finishStreamOpen(dev);
+}
+
+static struct GpCaptureStats g_stats;
+
+/*
+ * Tracepoints (gammapad_trace.h), main thread only: when the last read()
+ * returned, on both clocks (evdev stamps events with CLOCK_REALTIME), and
+ * the kernel timestamp of the frame being flushed, moved to CLOCK_MONOTONIC.
+ */
+static unsigned long long g_trReadNs;
+static unsigned long long g_trReadRealNs;
+static unsigned long long g_trKernelNs;
+
+static void traceRead(void)
+{
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    g_trReadNs     = getMonotonicNs();
+    g_trReadRealNs = (unsigned long long)rt.tv_sec * 1000000000ULL + (unsigned long long)rt.tv_nsec;
+}
+
+static void traceFrameRouted(const struct input_event* syn)
+{
+    g_trKernelNs = 0;
+    if (!g_trReadNs) return;
+
+    unsigned long long evNs = (unsigned long long)syn->input_event_sec * 1000000000ULL +
+                              (unsigned long long)syn->input_event_usec * 1000ULL;
+    if (evNs && evNs <= g_trReadRealNs && g_trReadRealNs - evNs < g_trReadNs) {
+        g_trKernelNs = g_trReadNs - (g_trReadRealNs - evNs);
+        gp_trace_span(GP_TR_READ, g_trKernelNs, g_trReadNs);
+    }
+    gp_trace_span(GP_TR_REMAP, g_trReadNs, getMonotonicNs());
+}
+
+static void traceFrameWritten(struct GpPad* pad, unsigned long long writeNs)
+{
+    unsigned long long now = getMonotonicNs();
+    gp_trace_span(GP_TR_COALESCE, pad->traceFirstNs, writeNs);
+    gp_trace_span(GP_TR_WRITE, writeNs, now);
+    if (g_trKernelNs) gp_trace_span(GP_TR_TOTAL, g_trKernelNs, now);
+    g_trKernelNs = 0;
+    pad->traceFirstNs = 0;
+}
+
+void gp_capture_stats(struct GpCaptureStats* out)
+{
+    if (out) *out = g_stats;
+}
+
+int gp_device_pump(struct GpDevice* dev)
+{
+    struct input_event evs[GP_READ_BATCH];
+
+    while (dev->fd >= 0) {
+        ssize_t n = read(dev->fd, evs, sizeof(evs));
+        g_stats.reads++;
+        dev->counters.reads++;
+        if (GP_TRACE_ON()) traceRead();
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return errno == ENODEV ? -1 : 0;
+        }
+        if (n == 0) return -1;  /* writer closed (pipe/socketpair source) */
+
+        size_t count = (size_t)n / sizeof(evs[0]);
+        g_stats.events += count;
+        dev->counters.eventsIn += count;
+        if (g_gpRecording) gp_record_events(dev->index, evs, count);
+        for (size_t i = 0; i < count; i++) {
+            forward_physical_event(dev, &evs[i]);
+        }
+        if (count < GP_READ_BATCH) return 0;
+    }
+    return 0;
+}
+
+/*
+ * close_physical_device => ungrab + close; the GpDevice keeps its sysfs
+ * identity so the destructor can still unbind/rebind it.
+ */
+void close_physical_device(struct GpDevice* dev)
+{
+    if (!dev || dev->fd < 0) return;
+    ioctl(dev->fd, EVIOCGRAB, 0);
+    close(dev->fd);
+    dev->fd = -1;
+}
+
+/*
+ * Frame accumulator:
+ *   Remapped events are buffered in the target pad until the physical
+ *   device sends its own SYN_REPORT, then the whole frame goes out to
+ *   pad->fd in one write() with a single SYN_REPORT at the end. This keeps
+ *   the physical frame boundaries intact, so one stick move stays one
+ *   frame on the virtual pad instead of one frame per axis.
+ *
+ *   The last slot is reserved for the trailing SYN_REPORT.
+ */
+static void flushFrame(struct GpPad* pad);
+
+/*
+ * frameAppend => queue one remapped event into the pending frame.
+ * An EV_ABS code that already appears in this frame just has its value
+ * replaced, since only the latest value matters at SYN time.
+ */
+static void frameAppend(struct GpPad* pad, __u16 type, __u16 code, __s32 value)
+{
+    if (type == EV_ABS) {
+        for (int i = 0; i < pad->frameCount; i++) {
+            if (pad->frame[i].type == EV_ABS && pad->frame[i].code == code) {
+                pad->frame[i].value = value;
+                pad->counters.coalesced++;
+                return;
+            }
+        }
+    }
+
+    if (pad->frameCount >= GP_FRAME_MAX_EVENTS - 1) {
+        /* Should never happen for a gamepad => flush early rather than lose events. */
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] frame overflow => flushing %d events early.\n",
+                pad->frameCount);
+        flushFrame(pad);
+    }
+
+    if (GP_TRACE_ON() && pad->frameCount == 0) pad->traceFirstNs = getMonotonicNs();
+    struct input_event* out = &pad->frame[pad->frameCount++];
+    memset(out, 0, sizeof(*out));
+    out->type  = type;
+    out->code  = code;
+    out->value = value;
+}
+
+/*
+ * rateDisarm => nothing held by the rate limiter any more: cancel its
+ * timer and forget the held frames' extent.
  */
-void forward_physical_event(const struct input_event* ev)
+static void rateDisarm(struct GpPad* pad)
 {
-    if (!ev) return;
-    if (controllerFd < 0) return;
+    if (pad->rateTimer) {
+        gp_timer_cancel(pad->rateTimer);
+        pad->rateTimer = 0;
+    }
+    pad->rateCommitted = 0;
+    pad->rateDueNs     = 0;
+}
 
-    if (ev->type == EV_KEY) {
-        int orig = ev->code;
-        if (orig < 0 || orig > KEY_MAX) return;
-        int mapped = g_keyMap[orig];
+/*
+ * flushFrame => terminate the pending frame with SYN_REPORT and write it
+ * in a single syscall. Empty frames (everything unmapped or pruned) are
+ * dropped entirely.
+ */
+static void flushFrame(struct GpPad* pad)
+{
+    if (pad->frameCount == 0) return;
+    rateDisarm(pad);
+
+    struct input_event* syn = &pad->frame[pad->frameCount];
+    memset(syn, 0, sizeof(*syn));
+    syn->type  = EV_SYN;
+    syn->code  = SYN_REPORT;
+    syn->value = 0;
+
+    size_t len = (size_t)(pad->frameCount + 1) * sizeof(struct input_event);
+    unsigned long long writeNs = GP_TRACE_ON() ? getMonotonicNs() : 0;
+    ssize_t n = write(pad->fd, pad->frame, len);
+    g_stats.writes++;
+    if (GP_TRACE_ON() && writeNs) traceFrameWritten(pad, writeNs);
+    if (pad->rateLimited) pad->rateLastNs = getMonotonicNs();
+    if (n < 0) {
+        if (errno == EAGAIN) pad->counters.writeEagain++;
+        else                 pad->counters.writeErrors++;
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[GammaPadCapture] frame write (%d events) => %s\n",
+                pad->frameCount, strerror(errno));
+    } else {
+        pad->counters.frames++;
+        pad->counters.eventsOut += (unsigned long long)pad->frameCount;
+    }
+    pad->frameCount = 0;
+}
 
-        fprintf(stderr,"[FWD] KEY scancode=%d => final=%d, value=%d\n",
-            orig, mapped, ev->value);
+/*
+ * rateFlush => timer of a held frame. A source in the middle of a frame
+ * has appended to it since; its SYN_REPORT writes everything instead.
+ */
+static void rateFlush(void* arg)
+{
+    struct GpPad* pad = (struct GpPad*)arg;
+    pad->rateTimer = 0;
+    if (pad->fd >= 0 && pad->frameCount == pad->rateCommitted) flushFrame(pad);
+}
 
-        struct input_event out[2];
-        memset(&out, 0, sizeof(out));
+/*
+ * rateHold => at a rate-limited source's SYN_REPORT: 1 => the frame stays
+ * pending until the timer, 0 => write it now (it has a button edge, the
+ * interval is over, or no timer could be armed).
+ */
+static int rateHold(const struct GpDevice* dev, struct GpPad* pad)
+{
+    if (pad->frameCount == 0) return 0;
+    for (int i = 0; i < pad->frameCount; i++) {
+        if (pad->frame[i].type == EV_KEY) return 0;
+    }
+    unsigned long long now = getMonotonicNs();
+    unsigned long long due = pad->rateLastNs + dev->rateNs;
+    if (now >= due) return 0;
+
+    /* Composite pads: the most demanding source's deadline wins. */
+    if (!pad->rateTimer || due < pad->rateDueNs) {
+        if (pad->rateTimer) gp_timer_cancel(pad->rateTimer);
+        pad->rateTimer = gp_timer_add_ns(due - now, rateFlush, pad);
+        if (pad->rateTimer < 0) {
+            pad->rateTimer = 0;
+            return 0;
+        }
+        pad->rateDueNs = due;
+    }
+    pad->rateCommitted = pad->frameCount;
+    pad->counters.rateHeld++;
+    return 1;
+}
+
+/*
+ * Composite pads:
+ *   Each output (type, code) a source can produce owns one merge slot,
+ *   and every route of every attached source carries that slot's index,
+ *   so merging costs no lookup on the event path. Merged values only go
+ *   into the frame when the pad's visible state actually changes:
+ *     EV_KEY => pressed while any source holds it (OR of 'holders')
+ *     EV_ABS => GP_AXIS_MERGE_LAST: whatever the source that moved last sent
+ *               GP_AXIS_MERGE_MAX:  value of the source furthest from its
+ *               center (ties => lowest source index, so it is deterministic)
+ *   Frames still follow the source's own SYN_REPORT, so one physical frame
+ *   from any source is one SYN frame on the composite pad.
+ */
+int gp_pad_enable_merge(struct GpPad* pad, int axisPolicy)
+{
+    if (!pad) return -1;
+    if (!pad->merge) {
+        pad->merge = calloc(1, sizeof(*pad->merge));
+        if (!pad->merge) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[GammaPadCapture] composite pad => allocation failed.\n");
+            return -1;
+        }
+    }
+    pad->merge->axisPolicy = axisPolicy;
+    return 0;
+}
+
+/*
+ * routeOutput => (type, code) a route writes on the pad.
+ */
+static void routeOutput(const struct GpRoute* r, __u16* type, __u16* code)
+{
+    *code = r->outCode;
+    *type = (r->action == GP_ROUTE_ABS || r->action == GP_ROUTE_KEY_TO_ABS) ? EV_ABS : EV_KEY;
+}
+
+static int mergeSlotFor(struct GpMerge* m, __u16 type, __u16 code)
+{
+    for (int i = 0; i < m->slotCount; i++) {
+        if (m->slots[i].type == type && m->slots[i].code == code) return i;
+    }
+    if (m->slotCount >= GP_MERGE_MAX_SLOTS) return -1;
+
+    struct GpMergeSlot* s = &m->slots[m->slotCount];
+    memset(s, 0, sizeof(*s));
+    s->type = type;
+    s->code = code;
+    for (int i = 0; i < GP_MAX_DEVICES; i++) s->mag[i] = -1; /* not reporting yet */
+    return m->slotCount++;
+}
 
-        out[0].type  = EV_KEY;
-        out[0].code  = mapped;
-        out[0].value = ev->value;
-        out[1].type  = EV_SYN;
-        out[1].code  = SYN_REPORT;
-        out[1].value = 0;
-        write(controllerFd, &out, sizeof(out));
+int gp_pad_attach_source(struct GpPad* pad, struct GpDevice* dev)
+{
+    if (!pad || !dev) return -1;
+    dev->pad = pad;
+    if (dev->rateNs) pad->rateLimited = 1;
+    if (!pad->merge) return 0;
+
+    int unmerged = 0;
+    GP_ROUTE_FOREACH(&dev->routes, r) {
+        __u16 type, code;
+        routeOutput(r, &type, &code);
+        int slot = mergeSlotFor(pad->merge, type, code);
+        if (slot < 0) {
+            r->mergeSlot = GP_MERGE_NONE;
+            unmerged++;
+        } else {
+            r->mergeSlot = (__u8)slot;
+        }
+    }
+    if (unmerged) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN,
+            "[GammaPadCapture] composite pad => %d outputs of device #%d pass through unmerged (slot table full).\n",
+            unmerged, dev->index);
     }
-    else if (ev->type == EV_ABS) {
-        int orig = ev->code;
-        if (orig < 0 || orig > ABS_MAX) return;
-        int mapped = g_absMap[orig];
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO,
+        "[GammaPadCapture] device #%d merged into composite pad (%d slots in use).\n",
+        dev->index, pad->merge->slotCount);
+    return 0;
+}
 
-        fprintf(stderr,"[FWD] ABS scancode=%d => final=%d, value=%d\n",
-            orig, mapped, ev->value);
+/*
+ * routeCenter => rest value of a source's contribution to an axis slot.
+ */
+static int routeCenter(const struct GpDevice* dev, const struct GpRoute* r)
+{
+    if (r->action == GP_ROUTE_ABS) {
+        return (dev->absMin[r->inCode] + dev->absMax[r->inCode]) / 2;
+    }
+    return 0;
+}
 
-        if (mapped < 0) {
-            // pruned from collision => do nothing
+static void mergeAppend(struct GpPad* pad, const struct GpDevice* dev, const struct GpRoute* r,
+                        __u16 type, __u16 code, __s32 value)
+{
+    struct GpMergeSlot* s = &pad->merge->slots[r->mergeSlot];
+    int src = dev->index;
+    __s32 out;
+
+    if (type == EV_KEY) {
+        if (value == 2) {
+            /* autorepeat => only meaningful if this source is the holder */
+            if (s->holders & (1u << src)) frameAppend(pad, type, code, value);
             return;
         }
+        if (value) s->holders |=  (1u << src);
+        else       s->holders &= ~(1u << src);
+        out = s->holders ? 1 : 0;
+    } else {
+        int mag = value - routeCenter(dev, r);
+        s->value[src] = value;
+        s->mag[src]   = (mag < 0) ? -mag : mag;
+
+        if (pad->merge->axisPolicy == GP_AXIS_MERGE_MAX) {
+            int best = src;
+            for (int i = 0; i < GP_MAX_DEVICES; i++) {
+                if (s->mag[i] > s->mag[best] || (s->mag[i] == s->mag[best] && i < best)) best = i;
+            }
+            out = s->value[best];
+        } else {
+            out = value;
+        }
+    }
 
-        struct input_event out[2];
-        memset(&out, 0, sizeof(out));
+    if (out == s->out) return;
+    s->out = out;
+    frameAppend(pad, type, code, out);
+}
 
-        out[0].type  = EV_ABS;
-        out[0].code  = mapped;
-        out[0].value = ev->value;
-        out[1].type  = EV_SYN;
-        out[1].code  = SYN_REPORT;
-        out[1].value = 0;
-        write(controllerFd, &out, sizeof(out));
+/*
+ * mergeInvalidate => a pending frame was thrown away, so the pad never saw
+ * the merged values recorded in 'out'. Force the next value through. The
+ * dropped events may have been presses or releases, so who holds a
+ * button is unknown too: start over with nobody.
+ */
+static void mergeInvalidate(struct GpPad* pad)
+{
+    if (!pad->merge) return;
+    for (int i = 0; i < pad->merge->slotCount; i++) {
+        struct GpMergeSlot* s = &pad->merge->slots[i];
+        s->out = INT_MIN;
+        if (s->type == EV_KEY) s->holders = 0;
+    }
+}
+
+/*
+ * padAppend => frameAppend, through the merge slot when the pad is composite.
+ */
+static void padAppend(struct GpPad* pad, const struct GpDevice* dev, const struct GpRoute* r,
+                      __u16 type, __u16 code, __s32 value)
+{
+    if (pad->merge && r->mergeSlot != GP_MERGE_NONE) {
+        mergeAppend(pad, dev, r, type, code, value);
+    } else {
+        frameAppend(pad, type, code, value);
     }
 }
 
 /*
- * destructor => remove node + unbind/rebind at program exit
+ * releaseOwn => gp_pad_release_source for a pad 'dev' has to itself: drop
+ * its half-read frame and put every output it routes back at rest.
+ */
+static void releaseOwn(struct GpPad* pad, struct GpDevice* dev)
+{
+    pad->frameCount = pad->rateCommitted;
+    GP_ROUTE_FOREACH(&dev->routes, r) {
+        switch (r->action) {
+        case GP_ROUTE_KEY:
+            frameAppend(pad, EV_KEY, r->outCode, 0);
+            break;
+        case GP_ROUTE_ABS:
+            frameAppend(pad, EV_ABS, r->outCode, routeCenter(dev, r));
+            break;
+        case GP_ROUTE_KEY_TO_ABS:
+            frameAppend(pad, EV_ABS, r->outCode, 0);
+            break;
+        case GP_ROUTE_ABS_TO_KEY:
+            if (r->state) frameAppend(pad, EV_KEY, r->outCode, 0);
+            r->state = 0;
+            break;
+        default:
+            break;
+        }
+    }
+    flushFrame(pad);
+}
+
+void gp_pad_release_source(struct GpPad* pad, struct GpDevice* dev)
+{
+    if (!pad || !dev || pad->fd < 0) return;
+    if (!pad->merge) {
+        releaseOwn(pad, dev);
+    } else {
+        GP_ROUTE_FOREACH(&dev->routes, r) {
+            if (r->mergeSlot == GP_MERGE_NONE) continue;
+            struct GpMergeSlot* s = &pad->merge->slots[r->mergeSlot];
+            if (s->type == EV_KEY) {
+                if (s->holders & (1u << dev->index)) {
+                    mergeAppend(pad, dev, r, EV_KEY, s->code, 0);
+                }
+            } else {
+                mergeAppend(pad, dev, r, EV_ABS, s->code, routeCenter(dev, r));
+                s->mag[dev->index] = -1; /* never wins GP_AXIS_MERGE_MAX again */
+            }
+            r->mergeSlot = GP_MERGE_NONE;
+        }
+        flushFrame(pad);
+    }
+    /*
+     * Nothing stays held for a reattach: a SYN_DROPPED there would keep
+     * the first rateCommitted events, stale by then.
+     */
+    rateDisarm(pad);
+    dev->frameDropped = 0;
+}
+
+/*
+ * applyFilter => at the device's SYN_REPORT, run the axes the filter held
+ * during the frame and route whatever changed into the pad frame.
+ */
+static void applyFilter(struct GpDevice* dev, struct GpPad* pad)
+{
+    unsigned long long t0 = GP_TRACE_ON() ? getMonotonicNs() : 0;
+    struct GpFilterOut out[GP_FILTER_MAX_AXES];
+    int held = __builtin_popcount(dev->filter.dirty);
+    int n = gp_filter_frame(&dev->filter, out);
+    if (n < held) dev->counters.filtered += (unsigned long long)(held - n);
+
+    for (int i = 0; i < n; i++) {
+        struct GpRoute* r = gp_route_lookup(&dev->routes, EV_ABS, out[i].code);
+        if (r) padAppend(pad, dev, r, EV_ABS, r->outCode, out[i].value);
+    }
+    if (GP_TRACE_ON() && t0) gp_trace_span(GP_TR_FILTER, t0, getMonotonicNs());
+}
+
+/*
+ * forward_physical_event:
+ *   Routes EV_KEY/EV_ABS through the device's compiled routing table (one
+ *   lookup, unrouted inputs dropped) into its pad's pending frame, and
+ *   flushes the frame on the physical SYN_REPORT. Calibrated axes go
+ *   through their lookup table first; axes with a filter rule are then
+ *   held until that SYN_REPORT and go through applyFilter().
+ *   Rate-limited sources may hold axis-only frames back (rateHold()).
+ *   SYN_DROPPED means the kernel buffer overran => the partial frame is
+ *   stale, so discard it and everything up to the next SYN_REPORT (frames
+ *   already held by the rate limiter are kept).
+ *   A composite pad has one pending frame for all its sources, and any
+ *   source's SYN_REPORT writes it. gp_device_pump() reads an evdev node
+ *   until the read comes back short, and evdev only hands out whole
+ *   frames, so a source is never left half-read between two pumps. A
+ *   pipe/socket source (gp_device_open_stream) can be: another source's
+ *   SYN_REPORT then writes the half it has and the rest follows in the
+ *   next frame. Likewise a SYN_DROPPED discards what every source has
+ *   pending.
+ */
+void forward_physical_event(struct GpDevice* dev, const struct input_event* ev)
+{
+    if (!dev || !ev) return;
+    struct GpPad* pad = dev->pad;
+    if (!pad || pad->fd < 0) return;
+
+    if (ev->type == EV_SYN) {
+        if (ev->code == SYN_REPORT) {
+            if (dev->frameDropped) {
+                dev->frameDropped = 0;
+                pad->frameCount   = pad->rateCommitted;
+                mergeInvalidate(pad);
+                return;
+            }
+            if (GP_TRACE_ON()) traceFrameRouted(ev);
+            if (dev->filter.dirty) applyFilter(dev, pad);
+            if (dev->rateNs && rateHold(dev, pad)) return;
+            flushFrame(pad);
+        } else if (ev->code == SYN_DROPPED) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] SYN_DROPPED on device #%d => discarding partial frame.\n",
+                dev->index);
+            dev->frameDropped = 1;
+            pad->frameCount   = pad->rateCommitted;
+            mergeInvalidate(pad);
+            gp_filter_drop(&dev->filter);
+        }
+        return;
+    }
+    if (dev->frameDropped) {
+        dev->counters.overrun++;
+        return;
+    }
+    if (GP_CALIB_ON() && ev->type == EV_ABS) gp_calib_observe(dev->index, ev->code, ev->value);
+
+    struct GpRoute* r = gp_route_lookup(&dev->routes, ev->type, ev->code);
+    if (!r) {
+        // unmapped, undiscovered or pruned from collision => do nothing
+        dev->counters.unmapped++;
+        return;
+    }
+
+    GP_LOG(GP_LOG_FWD, GP_LOG_DEBUG, "[FWD] dev=%d type=%d scancode=%d => action=%d final=%d, value=%d\n",
+        dev->index, ev->type, ev->code, r->action, r->outCode, ev->value);
+
+    switch (r->action) {
+    case GP_ROUTE_KEY:
+        padAppend(pad, dev, r, EV_KEY, r->outCode, ev->value);
+        break;
+    case GP_ROUTE_ABS: {
+        __s32 v = gp_calib_map(&dev->calib, ev->code, ev->value);
+        if (gp_filter_hold(&dev->filter, ev->code, v)) break;  /* => applyFilter() */
+        padAppend(pad, dev, r, EV_ABS, r->outCode, v);
+        break;
+    }
+    case GP_ROUTE_KEY_TO_ABS:
+        if (ev->value == 2) break; /* autorepeat => axis already there */
+        padAppend(pad, dev, r, EV_ABS, r->outCode, ev->value ? r->param : 0);
+        break;
+    case GP_ROUTE_ABS_TO_KEY: {
+        int pressed = (r->param >= 0) ? (ev->value >= r->param) : (ev->value <= r->param);
+        if (pressed != r->state) {
+            r->state = (__u8)pressed;
+            padAppend(pad, dev, r, EV_KEY, r->outCode, pressed);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/*
+ * Release: the captured nodes were removed from /dev/input, so at exit every
+ * device is unbound from its driver and bound again, which makes the kernel
+ * create a fresh node for whoever comes next. The cycles run concurrently
+ * through gammapad_rebind and finish as soon as sysfs says the kernel is
+ * done, instead of after a fixed delay.
+ */
+static int g_released = 0;
+
+static void onRebindDone(struct GpRebind* rb, void* arg)
+{
+    struct GpDevice* dev = (struct GpDevice*)arg;
+    GP_LOG(GP_LOG_CAPTURE, rb->state == GP_REBIND_DONE ? GP_LOG_INFO : GP_LOG_WARN,
+        "[GammaPadCapture] device #%d ('%s') rebind %s in %.1f ms.\n",
+        dev->index, dev->deviceName, gp_rebind_state_name(rb->state), gp_rebind_elapsed_ms(rb));
+}
+
+static int anyRebindActive(void)
+{
+    for (int i = 0; i < g_deviceCount; i++) {
+        if (gp_rebind_active(&g_devices[i].rebind)) return 1;
+    }
+    return 0;
+}
+
+int gp_capture_release_all(int timeoutMs)
+{
+    if (g_released) return 0;
+    g_released = 1;
+
+    unsigned long long startNs = getMonotonicNs();
+    unsigned long long deadline = startNs + (unsigned long long)timeoutMs * 1000000ULL;
+
+    for (int i = 0; i < g_deviceCount; i++) {
+        struct GpDevice* dev = &g_devices[i];
+        if (g_slotFree[i]) continue;
+        close_physical_device(dev);
+        if (!strncmp(dev->path, "stream:", 7)) continue;  /* no node, no driver */
+        if (dev->path[0]) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] release => remove node %s\n", dev->path);
+            if (unlink(dev->path) < 0 && errno != ENOENT) {
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] unlink '%s' => %s\n",
+                    dev->path, strerror(errno));
+            }
+        }
+        if (!dev->hasDriver || !dev->driverPath[0] || !dev->deviceName[0]) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] device #%d: no driver to rebind.\n", dev->index);
+            continue;
+        }
+        gp_rebind_start(&dev->rebind, dev->driverPath, dev->deviceName, onRebindDone, dev);
+    }
+
+    /* Pump the timers until every cycle is done or we run out of time. */
+    while (anyRebindActive()) {
+        unsigned long long now = getMonotonicNs();
+        if (now >= deadline) break;
+        struct pollfd pfd = { gp_timer_fd(), POLLIN, 0 };
+        int waitMs = (int)((deadline - now + 999999ULL) / 1000000ULL);
+        if (poll(&pfd, 1, waitMs) < 0 && errno != EINTR) break;
+        gp_timer_dispatch();
+    }
+
+    int failed = 0;
+    for (int i = 0; i < g_deviceCount; i++) {
+        struct GpRebind* rb = &g_devices[i].rebind;
+        if (gp_rebind_active(rb)) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] device #%d: rebind still %s at timeout.\n",
+                i, gp_rebind_state_name(rb->state));
+            gp_rebind_cancel(rb);
+            failed++;
+        } else if (rb->state == GP_REBIND_FAILED) {
+            failed++;
+        }
+    }
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] release of %d device(s) finished in %.1f ms (%d failed).\n",
+        g_deviceCount, (double)(getMonotonicNs() - startNs) / 1e6, failed);
+    return failed;
+}
+
+/*
+ * destructor => release anything main() did not (early exits), with a
+ * private timer if the main loop's is already gone.
  */
 __attribute__((destructor))
 static void onFinish(void)
 {
-    fprintf(stderr, "[GammaPadCapture] onFinish() => removing node + unbind/rebind.\n");
+    if (g_released || g_deviceCount == 0) return;
 
-    if (g_physicalDevicePath[0]) {
-        char rmCmd[300];
-        snprintf(rmCmd, sizeof(rmCmd), "rm -f '%s'", g_physicalDevicePath);
-        fprintf(stderr, "[GammaPadCapture] destructor => remove node => %s\n", rmCmd);
-        system(rmCmd);
-    }
-    unbindAndRebind();
+    int ownTimer = (gp_timer_fd() < 0);
+    if (ownTimer && gp_timer_init() < 0) return;
+    gp_capture_release_all(GP_RELEASE_TIMEOUT_MS);
+    if (ownTimer) gp_timer_shutdown();
 }
 
 #ifdef __ANDROID__
-void parse_android_keylayout_file_if_needed(int fd)
+void parse_android_keylayout_file_if_needed(int fd, struct GpRouteBuilder* b)
 {
-    fprintf(stderr, "[GammaPadCapture] parse_android_keylayout_file_if_needed: Attempting .kl parse...\n");
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] parse_android_keylayout_file_if_needed: Attempting .kl parse...\n");
     struct input_id id;
     if (ioctl(fd, EVIOCGID, &id) == 0) {
-        fprintf(stderr,"[GammaPadCapture] Vendor=0x%04x Product=0x%04x\n",
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] Vendor=0x%04x Product=0x%04x\n",
                 id.vendor, id.product);
 
         char klPath[256];
@@ -519,24 +1035,25 @@ void parse_android_keylayout_file_if_needed(int fd)
 
         FILE* f = fopen(klPath, "r");
         if (!f) {
-            fprintf(stderr,"[KL] No .kl found at %s\n", klPath);
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[KL] No .kl found at %s\n", klPath);
             return;
         }
-        fprintf(stderr,"[KL] Found .kl => %s, parsing...\n", klPath);
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[KL] Found .kl => %s, parsing...\n", klPath);
 
         char line[256];
         while (fgets(line, sizeof(line), f)) {
             char* nl = strchr(line,'\n');
             if (nl) *nl=0;
-            parseKeyLayoutLine(line);
+            parseKeyLayoutLine(b, line);
         }
         fclose(f);
     }
 }
 #else
-void parse_android_keylayout_file_if_needed(int fd)
+void parse_android_keylayout_file_if_needed(int fd, struct GpRouteBuilder* b)
 {
     (void)fd;
+    (void)b;
 }
 #endif
 
@@ -544,7 +1061,7 @@ void parse_android_keylayout_file_if_needed(int fd)
  * parseKeyLayoutLine => "no swapping" means:
  * LTRIGGER => ABS_BRAKE, RTRIGGER => ABS_GAS
  */
-void parseKeyLayoutLine(const char* line)
+void parseKeyLayoutLine(struct GpRouteBuilder* b, const char* line)
 {
     char type[32], sCode[32], name[32], rest[128];
     memset(type,0,sizeof(type));
@@ -564,14 +1081,18 @@ void parseKeyLayoutLine(const char* line)
             scancode = atoi(sCode);
         }
         if (scancode>=0 && scancode<=KEY_MAX) {
-            if (!strcasecmp(name,"BUTTON_A"))      g_keyMap[scancode]= BTN_A;
-            else if (!strcasecmp(name,"BUTTON_B")) g_keyMap[scancode]= BTN_B;
-            else if (!strcasecmp(name,"BUTTON_X")) g_keyMap[scancode]= BTN_X;
-            else if (!strcasecmp(name,"BUTTON_Y")) g_keyMap[scancode]= BTN_Y;
+            int finalKey = scancode;
+            if (!strcasecmp(name,"BUTTON_A"))      finalKey = BTN_A;
+            else if (!strcasecmp(name,"BUTTON_B")) finalKey = BTN_B;
+            else if (!strcasecmp(name,"BUTTON_X")) finalKey = BTN_X;
+            else if (!strcasecmp(name,"BUTTON_Y")) finalKey = BTN_Y;
             /* fallback => scancode=>scancode if not recognized */
 
-            fprintf(stderr,"[KL] 'key %s %s' => scancode=%d => final=%d\n",
-                sCode,name,scancode,g_keyMap[scancode]);
+            if (finalKey != scancode) {
+                gp_route_builder_set(b, EV_KEY, scancode, GP_ROUTE_KEY, finalKey, 0);
+            }
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[KL] 'key %s %s' => scancode=%d => final=%d\n",
+                sCode,name,scancode,finalKey);
         }
     }
     else if (!strcasecmp(type, "axis")) {
@@ -582,50 +1103,62 @@ void parseKeyLayoutLine(const char* line)
             scancode= atoi(sCode);
         }
         if (scancode>=0 && scancode<=ABS_MAX) {
-            if (!strcasecmp(name,"X"))         g_absMap[scancode] = ABS_X;
-            else if (!strcasecmp(name,"Y"))    g_absMap[scancode] = ABS_Y;
-            else if (!strcasecmp(name,"Z"))    g_absMap[scancode] = ABS_Z;
-            else if (!strcasecmp(name,"RZ"))   g_absMap[scancode] = ABS_RZ;
-            else if (!strcasecmp(name,"LTRIGGER")) g_absMap[scancode] = ABS_BRAKE;  // no swap
-            else if (!strcasecmp(name,"RTRIGGER")) g_absMap[scancode] = ABS_GAS;    // no swap
-            else if (!strcasecmp(name,"HAT_X"))     g_absMap[scancode] = ABS_HAT0X;
-            else if (!strcasecmp(name,"HAT_Y"))     g_absMap[scancode] = ABS_HAT0Y;
+            int finalAbs = scancode;
+            if (!strcasecmp(name,"X"))         finalAbs = ABS_X;
+            else if (!strcasecmp(name,"Y"))    finalAbs = ABS_Y;
+            else if (!strcasecmp(name,"Z"))    finalAbs = ABS_Z;
+            else if (!strcasecmp(name,"RZ"))   finalAbs = ABS_RZ;
+            else if (!strcasecmp(name,"LTRIGGER")) finalAbs = ABS_BRAKE;  // no swap
+            else if (!strcasecmp(name,"RTRIGGER")) finalAbs = ABS_GAS;    // no swap
+            else if (!strcasecmp(name,"HAT_X"))     finalAbs = ABS_HAT0X;
+            else if (!strcasecmp(name,"HAT_Y"))     finalAbs = ABS_HAT0Y;
             /* fallback => scancode => scancode */
 
-            fprintf(stderr,"[KL] 'axis %s %s' => scancode=%d => finalAbs=%d\n",
-                sCode,name,scancode,g_absMap[scancode]);
+            if (finalAbs != scancode) {
+                gp_route_builder_set(b, EV_ABS, scancode, GP_ROUTE_ABS, finalAbs, 0);
+            }
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[KL] 'axis %s %s' => scancode=%d => finalAbs=%d\n",
+                sCode,name,scancode,finalAbs);
         }
     }
 }
 
-void discoverKeys(int fd)
+void discoverKeys(struct GpDevice* dev, struct GpRouteBuilder* b)
 {
+    int fd = dev->fd;
     unsigned long keyBits[(KEY_MAX+1)/(8*sizeof(long))];
     memset(keyBits, 0, sizeof(keyBits));
 
     if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) < 0) {
-        fprintf(stderr, "[GammaPadCapture] discoverKeys: EVIOCGBIT(EV_KEY) => %s\n",
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] discoverKeys: EVIOCGBIT(EV_KEY) => %s\n",
                 strerror(errno));
         return;
     }
+    int countFound = scanKeyBits(b, keyBits);
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] discoverKeys => found %d key scancodes.\n", countFound);
+}
+
+int scanKeyBits(struct GpRouteBuilder* b, const unsigned long* keyBits)
+{
     int countFound=0;
     for (int code=0; code<=KEY_MAX; code++){
         int bitSet = (keyBits[code/(8*sizeof(long))] >> (code%(8*sizeof(long)))) & 1;
         if (bitSet) {
-            g_discoveredKeys[code] = 1;
+            gp_set_bit(b->keyBits, code);
             countFound++;
         }
     }
-    fprintf(stderr,"[GammaPadCapture] discoverKeys => found %d key scancodes.\n", countFound);
+    return countFound;
 }
 
-void discoverAxes(int fd)
+void discoverAxes(struct GpDevice* dev, struct GpRouteBuilder* b)
 {
+    int fd = dev->fd;
     unsigned long absBits[(ABS_MAX+1)/(8*sizeof(long))];
     memset(absBits, 0, sizeof(absBits));
 
     if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) < 0) {
-        fprintf(stderr, "[GammaPadCapture] discoverAxes: EVIOCGBIT(EV_ABS) => %s\n",
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] discoverAxes: EVIOCGBIT(EV_ABS) => %s\n",
                 strerror(errno));
         return;
     }
@@ -633,25 +1166,38 @@ void discoverAxes(int fd)
     for (int code=0; code<=ABS_MAX; code++){
         int bitSet = (absBits[code/(8*sizeof(long))] >> (code % (8*sizeof(long)))) & 1;
         if (!bitSet) {
-            g_discoveredAxes[code] = 0;
-            g_physicalAbsMin[code] = 0;
-            g_physicalAbsMax[code] = 0;
+            gp_clear_bit(b->absBits, code);
+            dev->absMin[code] = 0;
+            dev->absMax[code] = 0;
+            dev->absFuzz[code] = dev->absFlat[code] = dev->absRes[code] = 0;
             continue;
         }
-        g_discoveredAxes[code] = 1;
+        gp_set_bit(b->absBits, code);
         countFound++;
         struct input_absinfo info;
         if (ioctl(fd, EVIOCGABS(code), &info) == 0) {
-            g_physicalAbsMin[code] = info.minimum;
-            g_physicalAbsMax[code] = info.maximum;
-            fprintf(stderr,"[GammaPadCapture] discoverAxes: scancode=%d => min=%d, max=%d\n",
-                code, info.minimum, info.maximum);
+            dev->absMin[code] = info.minimum;
+            dev->absMax[code] = info.maximum;
+            dev->absFuzz[code] = info.fuzz;
+            dev->absFlat[code] = info.flat;
+            dev->absRes[code]  = info.resolution;
         } else {
-            g_physicalAbsMin[code] = -32768;
-            g_physicalAbsMax[code] = 32767;
-            fprintf(stderr,"[GammaPadCapture] discoverAxes: EVIOCGABS(%d) => fail %s\n",
+            dev->absMin[code] = -32768;
+            dev->absMax[code] = 32767;
+            dev->absFuzz[code] = dev->absFlat[code] = dev->absRes[code] = 0;
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadCapture] discoverAxes: EVIOCGABS(%d) => fail %s\n",
                 code, strerror(errno));
         }
+
+        /* Profile "absinfo" lines win over what the driver reports. */
+        const struct GpAbsOverride* o = &b->absOverride[code];
+        if (o->set & GP_ABS_SET_FUZZ) dev->absFuzz[code] = o->fuzz;
+        if (o->set & GP_ABS_SET_FLAT) dev->absFlat[code] = o->flat;
+        if (o->set & GP_ABS_SET_RES)  dev->absRes[code]  = o->resolution;
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO,
+            "[GammaPadCapture] discoverAxes: scancode=%d => min=%d, max=%d, fuzz=%d, flat=%d, res=%d%s\n",
+            code, dev->absMin[code], dev->absMax[code], dev->absFuzz[code], dev->absFlat[code],
+            dev->absRes[code], o->set ? " (profile)" : "");
     }
-    fprintf(stderr,"[GammaPadCapture] discoverAxes => found %d axis scancodes.\n", countFound);
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[GammaPadCapture] discoverAxes => found %d axis scancodes.\n", countFound);
 }
@@ -2,38 +2,242 @@
 #define GAMMAPAD_CAPTURE_H
 
 #include "gammapad.h"
+#include "gammapad_route.h"
+#include "gammapad_rebind.h"
 #include <linux/input.h>
 
+/*
+ * Up to GP_MAX_DEVICES physical nodes can be captured by one daemon.
+ * Each gets a GpDevice; each virtual controller is a GpPad.
+ */
+#define GP_MAX_DEVICES      16
+#define GP_FRAME_MAX_EVENTS 64
+
+/*
+ * gp_capture_release_all => close every device, remove its node and run
+ * the unbind/bind cycles concurrently so the kernel recreates the nodes.
+ * Pumps gammapad_timer for at most timeoutMs. Returns how many devices
+ * did not come back. Also run by a destructor if main() never called it.
+ */
+#define GP_RELEASE_TIMEOUT_MS 3000
+int  gp_capture_release_all(int timeoutMs);
+
+/*
+ * Composite pads: several devices feed one virtual controller. Every
+ * output code gets a merge slot (routes point at it via GpRoute.mergeSlot)
+ * holding enough per-source state to apply the conflict rules:
+ *   - buttons: OR of every source currently holding the button
+ *   - axes:    last writer wins, or the source furthest from its center
+ * The sources share the pad's pending frame, so a frame a stream source
+ * has only half delivered can be written by another source's SYN_REPORT
+ * (see forward_physical_event()).
+ */
+#define GP_MERGE_MAX_SLOTS 96
+
+enum GpAxisMerge {
+    GP_AXIS_MERGE_LAST = 0,
+    GP_AXIS_MERGE_MAX
+};
+
+struct GpMergeSlot {
+    __u16 type;
+    __u16 code;
+    __u32 holders;                  /* EV_KEY: bit per source index       */
+    __s32 out;                      /* value last written to the pad      */
+    __s32 value[GP_MAX_DEVICES];    /* EV_ABS: latest value per source    */
+    __s32 mag[GP_MAX_DEVICES];      /* EV_ABS: |value - center| per source */
+};
+
+struct GpMerge {
+    int axisPolicy;                 /* enum GpAxisMerge */
+    int slotCount;
+    struct GpMergeSlot slots[GP_MERGE_MAX_SLOTS];
+};
+
+/*
+ * Forwarding counters (gammapad_metrics), main thread only.
+ */
+struct GpPadCounters {
+    unsigned long long frames;      /* frames written                           */
+    unsigned long long eventsOut;   /* events written, SYN_REPORT not counted   */
+    unsigned long long coalesced;   /* EV_ABS updates folded into an earlier one
+                                       of the same frame                        */
+    unsigned long long rateHeld;    /* source frames held back by the rate
+                                       limiter and written with a later one     */
+    unsigned long long writeEagain; /* frames lost: uinput queue full           */
+    unsigned long long writeErrors; /* frames lost: any other write error       */
+};
+
+struct GpDeviceCounters {
+    unsigned long long reads;       /* read() calls                             */
+    unsigned long long eventsIn;    /* input_events read                        */
+    unsigned long long unmapped;    /* no route (unmapped or pruned) => dropped */
+    unsigned long long overrun;     /* dropped between SYN_DROPPED and SYN_REPORT */
+    unsigned long long filtered;    /* axis updates absorbed by gammapad_filter */
+};
+
+/*
+ * GpPad: one virtual controller on /dev/uinput, plus the frame being
+ * accumulated for it (see forward_physical_event()).
+ *
+ * Output rate limit: a source whose profile has "rate <hz>" does not get
+ * its axis-only frames written more than hz times a second. Such a frame
+ * stays pending at its SYN_REPORT, later frames fold into it (latest
+ * value per axis), and a gammapad_timer writes it when the interval since
+ * the pad's last write is over. A frame carrying an EV_KEY is written at
+ * its SYN_REPORT as usual, together with whatever axes were pending, so
+ * button latency does not change.
+ */
+struct GpPad {
+    int fd;
+    int hasFF;                                     /* this pad owns the FF/vibrator */
+    int frameCount;
+    struct input_event frame[GP_FRAME_MAX_EVENTS];
+    struct GpMerge* merge;                         /* non-NULL => composite pad */
+    unsigned long long traceFirstNs;               /* gammapad_trace: frame's first event */
+    int rateLimited;                               /* a source has a rate => track writes */
+    int rateTimer;                                 /* gammapad_timer id, 0 => none armed  */
+    int rateCommitted;                             /* events of the held (complete) frames */
+    unsigned long long rateLastNs;                 /* last write                          */
+    unsigned long long rateDueNs;                  /* when rateTimer fires                */
+    struct GpPadCounters counters;
+};
+
+/*
+ * GpDevice: everything we know about one captured physical node.
+ */
+struct GpDevice {
+    int  fd;                       /* -1 when not open                        */
+    int  index;                    /* slot in the device table                */
+    char path[256];                /* e.g. "/dev/input/event4"                */
+    char driverPath[256];          /* e.g. "/sys/bus/platform/drivers/retrogame_joypad" */
+    char deviceName[256];          /* e.g. "singleadc-joypad"                 */
+    int  hasDriver;                /* driverPath/deviceName identified        */
+
+    struct input_id id;            /* EVIOCGID/EVIOCGNAME/EVIOCGPHYS, used to */
+    char inputName[128];           /* recognise the device when it is         */
+    char phys[64];                 /* plugged back in (gammapad_hotplug)       */
+    char uniq[64];                 /* sysfs inputN/uniq                       */
+    char bus[32];                  /* subsystem of the bound device           */
+
+    int  absMin[ABS_MAX+1];        /* physical ranges of discovered axes,     */
+    int  absMax[ABS_MAX+1];        /* canonical once calibrated               */
+    int  absFuzz[ABS_MAX+1];       /* EVIOCGABS fuzz/flat/resolution, after   */
+    int  absFlat[ABS_MAX+1];       /* profile overrides; carried to the pad   */
+    int  absRes[ABS_MAX+1];        /* by create_virtual_controller()          */
+
+    struct GpRouteTable routes;    /* compiled (type, code) => output action  */
+    struct GpCalib  calib;         /* calibration tables of EV_ABS routes     */
+    struct GpFilter filter;        /* dead zones etc. of EV_ABS routes        */
+    int  frameDropped;             /* after SYN_DROPPED until next SYN_REPORT */
+    unsigned long long rateNs;     /* profile "rate": min write interval, 0 => off */
+
+    struct GpPad* pad;             /* where this device's frames go           */
+    struct GpDeviceCounters counters;
+    struct GpPollSource pollSrc;   /* epoll registration (data.ptr)           */
+    struct GpRebind rebind;        /* release at exit (gp_capture_release_all) */
+};
+
+/*
+ * Device table. gp_device_alloc() hands out the next free slot (or NULL
+ * once GP_MAX_DEVICES is reached). gp_device_free() gives back a slot
+ * that never got a pad, e.g. when the open or the pad creation failed.
+ */
+struct GpDevice* gp_device_alloc(void);
+void             gp_device_free(struct GpDevice* dev);
+int              gp_device_count(void);
+struct GpDevice* gp_device_at(int index);
+
 /*
  * Open the physical device for capturing, attempt to parse driver info,
- * parse .kl, discover scancodes, etc. Returns fd or -1 on error.
+ * parse .kl, discover scancodes, build the routing table, etc.
+ * Returns fd (also stored in dev->fd) or -1 on error.
  */
-int open_physical_device(const char* device_path);
+int  open_physical_device(struct GpDevice* dev, const char* device_path);
+void close_physical_device(struct GpDevice* dev);
 
 /*
- * Forwards relevant events (EV_KEY or EV_ABS) to the global 'controllerFd',
- * doing scancode => final code transforms if .kl says so.
+ * Sources and sinks:
+ *   A GpDevice reads struct input_event records from dev->fd and a GpPad
+ *   writes its frames to pad->fd. Both are plain fds, so besides evdev
+ *   and uinput they can be pipes or socketpairs (gammapad_bench, tests).
+ *
+ *   gp_device_open_stream() => capture from any such fd. Capabilities come
+ *                              from 'caps' instead of EVIOCGBIT/EVIOCGABS;
+ *                              no sysfs, grab or .kl, and no profile file:
+ *                              every listed code routes to itself unless
+ *                              caps->profile lines say otherwise.
+ *   gp_device_pump()        => read everything pending on dev->fd in
+ *                              batches and forward it. Returns 0 once
+ *                              drained, -1 if the source is gone (ENODEV,
+ *                              EOF).
  */
-void forward_physical_event(const struct input_event* ev);
+struct GpStreamCaps {
+    const char*     name;
+    struct input_id id;
+    const __u16*    keys;
+    int             keyCount;
+    const __u16*    axes;
+    int             axisCount;
+    int             absMin;         /* range of every axis */
+    int             absMax;
+    const char* const* profile;     /* gp_profile_parse_line() lines, or NULL */
+    int             profileCount;
+};
+
+#define GP_READ_BATCH 64
+
+int gp_device_open_stream(struct GpDevice* dev, int fd, const struct GpStreamCaps* caps);
 
 /*
- * In case other files need them, add function prototypes:
- * parse_android_keylayout_file_if_needed, parseKeyLayoutLine, discoverKeys, discoverAxes.
- * That way, the compiler knows their signatures *before* they're called in .c
+ * gp_device_open_replay() => like gp_device_open_stream(), with the route
+ * builder, ranges and identity of a recorded device (gammapad_record.h).
+ * Called again for the same dev it recompiles the routes in place.
  */
-#ifdef __ANDROID__
-void parse_android_keylayout_file_if_needed(int fd);
-#endif
+struct GpRecDevice;
+int gp_device_open_replay(struct GpDevice* dev, int fd, const struct GpRecDevice* meta);
+int gp_device_pump(struct GpDevice* dev);
 
-void parseKeyLayoutLine(const char* line);
+/* Syscall counters of the forwarding path (main thread). */
+struct GpCaptureStats {
+    unsigned long long reads;       /* read() calls on sources        */
+    unsigned long long events;      /* input_events read              */
+    unsigned long long writes;      /* frame write() calls on sinks   */
+};
+void gp_capture_stats(struct GpCaptureStats* out);
 
-void discoverKeys(int fd);
-void discoverAxes(int fd);
+/*
+ * Composite pads:
+ *   gp_pad_enable_merge()  => turn 'pad' into a composite pad (allocates merge state)
+ *   gp_pad_attach_source() => route 'dev' into 'pad', assigning merge slots
+ *                             for every output code the device can produce
+ *   gp_pad_release_source()=> drop everything 'dev' holds (e.g. on unplug)
+ *                             and flush the result as one frame; also works
+ *                             on a plain pad, whose outputs go back to rest
+ */
+int  gp_pad_enable_merge(struct GpPad* pad, int axisPolicy);
+int  gp_pad_attach_source(struct GpPad* pad, struct GpDevice* dev);
+void gp_pad_release_source(struct GpPad* pad, struct GpDevice* dev);
+
+/*
+ * Routes one event from 'dev' into dev->pad's frame, and writes the frame
+ * on the physical SYN_REPORT.
+ */
+void forward_physical_event(struct GpDevice* dev, const struct input_event* ev);
 
 /*
- * Accessors for raw min/max used by gammapad_controller.c
+ * In case other files need them, add function prototypes:
+ * parse_android_keylayout_file_if_needed, parseKeyLayoutLine, discoverKeys, discoverAxes,
+ * scanKeyBits (discoverKeys without the ioctl), resolveAxisCollisions.
+ * That way, the compiler knows their signatures *before* they're called in .c
  */
-int getPhysicalAbsMin(int scancode);
-int getPhysicalAbsMax(int scancode);
+void parse_android_keylayout_file_if_needed(int fd, struct GpRouteBuilder* b);
+
+void parseKeyLayoutLine(struct GpRouteBuilder* b, const char* line);
+
+void discoverKeys(struct GpDevice* dev, struct GpRouteBuilder* b);
+void discoverAxes(struct GpDevice* dev, struct GpRouteBuilder* b);
+int  scanKeyBits(struct GpRouteBuilder* b, const unsigned long* keyBits);
+void resolveAxisCollisions(const struct GpDevice* dev, struct GpRouteBuilder* b);
 
 #endif // GAMMAPAD_CAPTURE_H
@@ -1,5 +1,7 @@
 #include "gammapad.h"
 #include "gammapad_inputdefs.h"
+#include "gammapad_trace.h"
+#include "gammapad_calib.h"
 
 /* External function to schedule events (declared in gammapad_main.c). */
 extern void scheduleEvent(int code, int isKey, int value, unsigned long long durationMs);
@@ -24,6 +26,58 @@ void parseCommand(const char* line)
     if (!strcasecmp(cmd, "exit")) {
         return;
     }
+    GP_LOG(GP_LOG_CMD, GP_LOG_DEBUG, "[CMD] '%s'\n", line);
+
+    if (!strcasecmp(cmd, "log") && parts >= 3) {
+        /* log <capture|fwd|ff|cmd|all> <off|error|warn|info|debug> */
+        int lvl = gp_log_level_from_name(arg2);
+        int cat = strcasecmp(arg1, "all") ? gp_log_category_from_name(arg1) : -1;
+        if (lvl < 0 || (cat < 0 && strcasecmp(arg1, "all"))) {
+            GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[CMD] log: unknown category/level '%s %s'\n", arg1, arg2);
+            return;
+        }
+        gp_log_set_level(cat, lvl);
+        GP_LOG(GP_LOG_CMD, GP_LOG_INFO, "[CMD] log: %s => %s\n", arg1, arg2);
+        return;
+    }
+    if (!strcasecmp(cmd, "trace") && parts >= 2) {
+        /* trace <on|off|reset|stats|dump FILE> */
+        if (!strcasecmp(arg1, "stats")) {
+            gp_trace_print(stderr);
+        } else if (!strcasecmp(arg1, "reset")) {
+            gp_trace_reset();
+        } else if (!strcasecmp(arg1, "dump") && parts >= 3) {
+            int n = gp_trace_dump(arg2);
+            if (n < 0) GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[CMD] trace dump '%s' => %s\n", arg2, strerror(errno));
+            else       GP_LOG(GP_LOG_CMD, GP_LOG_INFO, "[CMD] trace dump => %d spans in '%s'\n", n, arg2);
+        } else if (!strcasecmp(arg1, "on") || !strcasecmp(arg1, "off")) {
+            if (gp_trace_enable(!strcasecmp(arg1, "on")) < 0) {
+                GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[CMD] trace: compiled out (build with make TRACE=1)\n");
+            }
+        } else {
+            GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[CMD] trace: unknown argument '%s'\n", arg1);
+        }
+        return;
+    }
+    if (!strcasecmp(cmd, "calibrate") && parts >= 2) {
+        /* calibrate <start|save|cancel|status> */
+        if (!strcasecmp(arg1, "start")) {
+            gp_calib_start();
+            GP_LOG(GP_LOG_CMD, GP_LOG_INFO, "[CMD] calibrate: move every stick and trigger to its limits, "
+                   "let go, then 'calibrate save'\n");
+        } else if (!strcasecmp(arg1, "save")) {
+            int n = gp_calib_save();
+            if (n < 0) GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[CMD] calibrate save: not started\n");
+            else       GP_LOG(GP_LOG_CMD, GP_LOG_INFO, "[CMD] calibrate save => %d devices, applied on next open\n", n);
+        } else if (!strcasecmp(arg1, "cancel")) {
+            gp_calib_cancel();
+        } else if (!strcasecmp(arg1, "status")) {
+            gp_calib_status(stderr);
+        } else {
+            GP_LOG(GP_LOG_CMD, GP_LOG_WARN, "[CMD] calibrate: unknown argument '%s'\n", arg1);
+        }
+        return;
+    }
     if (!strcasecmp(cmd, "press") && parts >= 2) {
         unsigned long long dur = 3000; // default
         if (parts >= 3) {
@@ -110,5 +164,7 @@ void parseCommand(const char* line)
             scheduleEvent(ABS_HAT0Y, 0, val, dur);
         }
     }
-    // else: unknown or incomplete command, ignore quietly
+    else {
+        GP_LOG(GP_LOG_CMD, GP_LOG_INFO, "[CMD] Unknown or incomplete command '%s'\n", line);
+    }
 }
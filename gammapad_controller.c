@@ -3,57 +3,91 @@
 #include <errno.h>
 #include <string.h>
 
-/* We'll rely on these externs from gammapad_capture.c */
-extern int g_discoveredKeys[KEY_MAX+1];
-extern int g_discoveredAxes[ABS_MAX+1];
-extern int g_keyMap[KEY_MAX+1];
-extern int g_absMap[ABS_MAX+1];
-extern int getPhysicalAbsMin(int scancode);
-extern int getPhysicalAbsMax(int scancode);
+/* Routing table + raw ranges from gammapad_capture.c */
+#include "gammapad_capture.h"
+#include "gammapad_ffmix.h"
 
-/* We'll read from g_physicalFd if it's open. */
-extern int g_physicalFd;
+/*
+ * routedAxisInfo => absinfo the virtual axis needs for everything routed
+ * into it by any of the pad's sources: the physical range for
+ * axis => axis routes, and 0..param for key => axis routes. fuzz and flat
+ * are the largest of the axis sources', so the noisiest one is still
+ * filtered; resolution is the first one reported.
+ * Returns 0 if nothing is routed to 'axis'.
+ */
+static int routedAxisInfo(struct GpDevice* const* devs, int count, int axis, struct input_absinfo* out)
+{
+    int found = 0;
+    struct input_absinfo info;
+    memset(&info, 0, sizeof(info));
+
+    for (int d = 0; d < count; d++) {
+        const struct GpDevice* dev = devs[d];
+        GP_ROUTE_FOREACH(&dev->routes, r) {
+            if (r->outCode != axis) continue;
+            int lo, hi;
+            if (r->action == GP_ROUTE_ABS) {
+                lo = dev->absMin[r->inCode];
+                hi = dev->absMax[r->inCode];
+                if (dev->absFuzz[r->inCode] > info.fuzz) info.fuzz = dev->absFuzz[r->inCode];
+                if (dev->absFlat[r->inCode] > info.flat) info.flat = dev->absFlat[r->inCode];
+                if (!info.resolution) info.resolution = dev->absRes[r->inCode];
+            } else if (r->action == GP_ROUTE_KEY_TO_ABS) {
+                lo = r->param < 0 ? r->param : 0;
+                hi = r->param > 0 ? r->param : 0;
+            } else {
+                continue;
+            }
+            if (!found || lo < info.minimum) info.minimum = lo;
+            if (!found || hi > info.maximum) info.maximum = hi;
+            found = 1;
+        }
+    }
+    if (!found) return 0;
+
+    /* uinput rejects fuzz/flat wider than the range. */
+    int range = info.maximum - info.minimum;
+    if (info.fuzz > range) info.fuzz = range;
+    if (info.flat > range) info.flat = range;
+    *out = info;
+    return 1;
+}
 
 /*
  * setAbsRange => fallback approach if axis wasn't discovered
  */
-static void setAbsRange(struct uinput_user_dev *uidev,
+static void setAbsRange(struct GpDevice* const* devs, int count, struct input_absinfo* abs,
                         int axis, int defMin, int defMax)
 {
-    /* We'll only do fallback if not discovered. We'll scan for scancodes that map to 'axis'. */
-    for(int sc=0; sc<=ABS_MAX; sc++){
-        if(g_discoveredAxes[sc]){
-            int finalAxis= g_absMap[sc];
-            if(finalAxis==axis){
-                // This axis is discovered => skip fallback
-                return;
-            }
-        }
+    /* We'll only do fallback if nothing in the routing tables feeds 'axis'. */
+    struct input_absinfo routed;
+    if (routedAxisInfo(devs, count, axis, &routed)) {
+        // This axis is routed => skip fallback
+        return;
     }
     // If we get here => axis not discovered => fallback
-    uidev->absmin[axis]= defMin;
-    uidev->absmax[axis]= defMax;
+    abs[axis].minimum= defMin;
+    abs[axis].maximum= defMax;
     LOG_FF("setAbsRange: fallback axis=%d => min=%d, max=%d\n", axis, defMin, defMax);
 }
 
 /*
- * enableDiscoveredKeys => scancode => final = g_keyMap[scancode],
- * then UI_SET_KEYBIT(final).
+ * enableDiscoveredKeys => every route whose output is a key
+ * (key => key, axis => key) gets UI_SET_KEYBIT(final).
  */
-static void enableDiscoveredKeys(int fd)
+static void enableDiscoveredKeys(struct GpDevice* const* devs, int count, int fd)
 {
     int countFound=0;
-    for(int sc=0; sc<=KEY_MAX; sc++){
-        if(g_discoveredKeys[sc]){
-            int finalKey= g_keyMap[sc];
-            if(ioctl(fd, UI_SET_KEYBIT, finalKey)<0){
-                LOG_FF("enableDiscoveredKeys: UI_SET_KEYBIT(%d) => %s\n",
-                       finalKey, strerror(errno));
-            } else {
-                LOG_FF("enableDiscoveredKeys: scancode=%d => final=%d\n",
-                       sc, finalKey);
-                countFound++;
-            }
+    for (int d=0; d<count; d++) GP_ROUTE_FOREACH(&devs[d]->routes, r) {
+        if(r->action!=GP_ROUTE_KEY && r->action!=GP_ROUTE_ABS_TO_KEY) continue;
+        int finalKey= r->outCode;
+        if(ioctl(fd, UI_SET_KEYBIT, finalKey)<0){
+            LOG_FF("enableDiscoveredKeys: UI_SET_KEYBIT(%d) => %s\n",
+                   finalKey, strerror(errno));
+        } else {
+            LOG_FF("enableDiscoveredKeys: type=%d scancode=%d => final=%d\n",
+                   r->inType, r->inCode, finalKey);
+            countFound++;
         }
     }
     if(!countFound){
@@ -63,32 +97,96 @@ static void enableDiscoveredKeys(int fd)
 }
 
 /*
- * enableDiscoveredAxes => scancode => final= g_absMap[scancode],
- * then UI_SET_ABSBIT(final).
+ * enableDiscoveredAxes => every route whose output is an axis
+ * (axis => axis, key => axis) gets UI_SET_ABSBIT(final).
  */
-static void enableDiscoveredAxes(int fd)
+static void enableDiscoveredAxes(struct GpDevice* const* devs, int count, int fd, unsigned long* enabled)
 {
     int countFound=0;
-    for(int sc=0; sc<=ABS_MAX; sc++){
-        if(g_discoveredAxes[sc]){
-            int finalAxis= g_absMap[sc];
-            if(ioctl(fd, UI_SET_ABSBIT, finalAxis)<0){
-                LOG_FF("enableDiscoveredAxes: UI_SET_ABSBIT(%d) => %s\n",
-                       finalAxis,strerror(errno));
-            } else {
-                LOG_FF("enableDiscoveredAxes: scancode=%d => finalAxis=%d\n",
-                       sc, finalAxis);
-                countFound++;
-            }
+    for (int d=0; d<count; d++) GP_ROUTE_FOREACH(&devs[d]->routes, r) {
+        if(r->action!=GP_ROUTE_ABS && r->action!=GP_ROUTE_KEY_TO_ABS) continue;
+        int finalAxis= r->outCode;
+        if(ioctl(fd, UI_SET_ABSBIT, finalAxis)<0){
+            LOG_FF("enableDiscoveredAxes: UI_SET_ABSBIT(%d) => %s\n",
+                   finalAxis,strerror(errno));
+        } else {
+            LOG_FF("enableDiscoveredAxes: type=%d scancode=%d => finalAxis=%d\n",
+                   r->inType, r->inCode, finalAxis);
+            gp_set_bit(enabled, finalAxis);
+            countFound++;
         }
     }
     if(!countFound){
         LOG_FF("enableDiscoveredAxes: none => fallback array.\n");
         gp_enable_gamepad_abs(fd);
+        for(size_t i=0; i<sizeof(GAMMAPAD_ABS_CODES)/sizeof(GAMMAPAD_ABS_CODES[0]); i++){
+            gp_set_bit(enabled, GAMMAPAD_ABS_CODES[i]);
+        }
     }
 }
 
-int create_virtual_controller(int* fd_out)
+/*
+ * setupDevice => identity and absinfo of the pad, before UI_DEV_CREATE.
+ * UI_DEV_SETUP + UI_ABS_SETUP carry the full absinfo (resolution
+ * included); kernels older than 4.5 only take the legacy
+ * uinput_user_dev write, which has no resolution.
+ */
+static int setupDevice(int fd, const char* name, const struct input_id* id, int ffMax,
+                       const struct input_absinfo* abs, const unsigned long* enabled)
+{
+#if defined(UI_DEV_SETUP) && defined(UI_ABS_SETUP)
+    struct uinput_setup setup;
+    memset(&setup,0,sizeof(setup));
+    snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "%s", name);
+    setup.id= *id;
+    setup.ff_effects_max= ffMax;
+
+    if(ioctl(fd, UI_DEV_SETUP, &setup)==0){
+        for(int axis=0; axis<=ABS_MAX; axis++){
+            if(!gp_test_bit(enabled, axis)) continue;
+            struct uinput_abs_setup as;
+            memset(&as,0,sizeof(as));
+            as.code= axis;
+            as.absinfo= abs[axis];
+            if(ioctl(fd, UI_ABS_SETUP, &as)<0){
+                LOG_FF("setupDevice: UI_ABS_SETUP(%d) => %s\n", axis, strerror(errno));
+            }
+        }
+        return 0;
+    }
+    if(errno!=EINVAL && errno!=ENOTTY){
+        LOG_FF("setupDevice: UI_DEV_SETUP => %s\n", strerror(errno));
+        return -1;
+    }
+    LOG_FF("setupDevice: UI_DEV_SETUP unsupported => legacy uinput_user_dev.\n");
+#endif
+
+    struct uinput_user_dev uidev;
+    memset(&uidev,0,sizeof(uidev));
+    snprintf(uidev.name, UINPUT_MAX_NAME_SIZE, "%s", name);
+    uidev.id= *id;
+    uidev.ff_effects_max= ffMax;
+    for(int axis=0; axis<=ABS_MAX; axis++){
+        uidev.absmin[axis]= abs[axis].minimum;
+        uidev.absmax[axis]= abs[axis].maximum;
+        uidev.absfuzz[axis]= abs[axis].fuzz;
+        uidev.absflat[axis]= abs[axis].flat;
+    }
+    if(write(fd, &uidev,sizeof(uidev))<0){
+        LOG_FF("setupDevice: write => %s\n",strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * create_virtual_controller => one virtual pad fed by 'count' devices
+ * (usually one; several for a composite pad; none => the fallback
+ * button/axis arrays). Its capabilities are the union of the sources'
+ * routes. Only the pad with withFF=1 advertises EV_FF, since the
+ * vibrator backend is global.
+ */
+int create_virtual_controller(struct GpDevice* const* devs, int count, int withFF, int* fd_out)
 {
     if(!fd_out)return -1;
 
@@ -100,60 +198,67 @@ int create_virtual_controller(int* fd_out)
 
     ioctl(fd, UI_SET_EVBIT, EV_KEY);
     ioctl(fd, UI_SET_EVBIT, EV_ABS);
-    ioctl(fd, UI_SET_EVBIT, EV_FF);
 
-    ioctl(fd, UI_SET_FFBIT, FF_RUMBLE);
-    ioctl(fd, UI_SET_FFBIT, FF_PERIODIC);
-    ioctl(fd, UI_SET_FFBIT, FF_CONSTANT);
-    ioctl(fd, UI_SET_FFBIT, FF_GAIN);
-    ioctl(fd, UI_SET_FFBIT, FF_RAMP);
-    ioctl(fd, UI_SET_FFBIT, FF_SPRING);
-    ioctl(fd, UI_SET_FFBIT, FF_DAMPER);
-    ioctl(fd, UI_SET_FFBIT, FF_INERTIA);
+    if(withFF){
+        ioctl(fd, UI_SET_EVBIT, EV_FF);
+
+        ioctl(fd, UI_SET_FFBIT, FF_RUMBLE);
+        ioctl(fd, UI_SET_FFBIT, FF_PERIODIC);
+        ioctl(fd, UI_SET_FFBIT, FF_SQUARE);
+        ioctl(fd, UI_SET_FFBIT, FF_TRIANGLE);
+        ioctl(fd, UI_SET_FFBIT, FF_SINE);
+        ioctl(fd, UI_SET_FFBIT, FF_SAW_UP);
+        ioctl(fd, UI_SET_FFBIT, FF_SAW_DOWN);
+        ioctl(fd, UI_SET_FFBIT, FF_CONSTANT);
+        ioctl(fd, UI_SET_FFBIT, FF_GAIN);
+        ioctl(fd, UI_SET_FFBIT, FF_AUTOCENTER);
+        ioctl(fd, UI_SET_FFBIT, FF_RAMP);
+        ioctl(fd, UI_SET_FFBIT, FF_SPRING);
+        ioctl(fd, UI_SET_FFBIT, FF_DAMPER);
+        ioctl(fd, UI_SET_FFBIT, FF_INERTIA);
+    }
 
     /* Dynamically discovered scancodes => final codes. */
-    enableDiscoveredKeys(fd);
-    enableDiscoveredAxes(fd);
+    unsigned long enabledAxes[GP_BITMAP_LONGS(ABS_MAX + 1)];
+    memset(enabledAxes,0,sizeof(enabledAxes));
+    enableDiscoveredKeys(devs, count, fd);
+    enableDiscoveredAxes(devs, count, fd, enabledAxes);
 
-    struct uinput_user_dev uidev;
-    memset(&uidev,0,sizeof(uidev));
+    char name[UINPUT_MAX_NAME_SIZE];
+    snprintf(name, sizeof(name), "GammaPad Virtual Controller");
+    if(count>0 && devs[0]->index>0){
+        /* Keep names unique so Android does not merge the pads. */
+        snprintf(name, sizeof(name), "GammaPad Virtual Controller %d", devs[0]->index+1);
+    }
+    struct input_id id= { .bustype= BUS_USB, .vendor= 0x045e, .product= 0x02fd, .version= 0x0003 };
 
-    snprintf(uidev.name, UINPUT_MAX_NAME_SIZE, "GammaPad Virtual Controller");
-    uidev.id.bustype= BUS_USB;
-    uidev.id.vendor= 0x045e;
-    uidev.id.product=0x02fd;
-    uidev.id.version=0x0003;
-    uidev.ff_effects_max= 32;
+    struct input_absinfo abs[ABS_MAX+1];
+    memset(abs,0,sizeof(abs));
 
     /*
      * fallback setAbsRange for typical axes => only if not discovered
      */
-    setAbsRange(&uidev, ABS_X,   -1800, 1800);
-    setAbsRange(&uidev, ABS_Y,   -1800, 1800);
-    setAbsRange(&uidev, ABS_Z,   -1800, 1800);
-    setAbsRange(&uidev, ABS_RZ,  -1800, 1800);
-    setAbsRange(&uidev, ABS_GAS,   0,   255);
-    setAbsRange(&uidev, ABS_BRAKE, 0,   255);
-    setAbsRange(&uidev, ABS_HAT0X, -1,  1);
-    setAbsRange(&uidev, ABS_HAT0Y, -1,  1);
+    setAbsRange(devs, count, abs, ABS_X,   -1800, 1800);
+    setAbsRange(devs, count, abs, ABS_Y,   -1800, 1800);
+    setAbsRange(devs, count, abs, ABS_Z,   -1800, 1800);
+    setAbsRange(devs, count, abs, ABS_RZ,  -1800, 1800);
+    setAbsRange(devs, count, abs, ABS_GAS,   0,   255);
+    setAbsRange(devs, count, abs, ABS_BRAKE, 0,   255);
+    setAbsRange(devs, count, abs, ABS_HAT0X, -1,  1);
+    setAbsRange(devs, count, abs, ABS_HAT0Y, -1,  1);
 
     /*
-     * Now override discovered scancodes => finalAxis with real min/max
+     * Now override routed axes with the real physical absinfo
      */
-    for(int sc=0; sc<=ABS_MAX; sc++){
-        if(g_discoveredAxes[sc]){
-            int finalAxis= g_absMap[sc];
-            int minVal= getPhysicalAbsMin(sc);
-            int maxVal= getPhysicalAbsMax(sc);
-            LOG_FF("create_virtual_controller: scancode=%d => finalAxis=%d => min=%d, max=%d\n",
-                sc, finalAxis, minVal, maxVal);
-            uidev.absmin[finalAxis]= minVal;
-            uidev.absmax[finalAxis]= maxVal;
+    for(int axis=0; axis<=ABS_MAX; axis++){
+        if(routedAxisInfo(devs, count, axis, &abs[axis])){
+            LOG_FF("create_virtual_controller: finalAxis=%d => min=%d, max=%d, fuzz=%d, flat=%d, res=%d\n",
+                axis, abs[axis].minimum, abs[axis].maximum, abs[axis].fuzz, abs[axis].flat,
+                abs[axis].resolution);
         }
     }
 
-    if(write(fd, &uidev,sizeof(uidev))<0){
-        LOG_FF("create_virtual_controller: write => %s\n",strerror(errno));
+    if(setupDevice(fd, name, &id, withFF ? GP_FF_MAX_EFFECTS : 0, abs, enabledAxes)<0){
         close(fd);
         return -1;
     }
@@ -3,7 +3,7 @@
  *****************************************************/
 
 #include "gammapad.h"
-#include <pthread.h>
+#include "gammapad_haptics.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -12,131 +12,213 @@
 #include <linux/input.h>
 #include <fcntl.h>
 
-/*
- * Maximum number of FF effects that can be stored
- */
-#define MAX_EFFECTS 32
-
 /*
  * Structure to store FF effect details
  */
 struct StoredEffect {
-    int used;               /* Whether this slot is in use */
-    int kernel_id;          /* Kernel-assigned FF effect ID */
-    unsigned int magnitude; /* 0..65535 */
-    unsigned int durationMs;/* Duration in ms (from effect->replay.length) */
+    int used;                 /* Whether this slot is in use */
+    struct GpFfParams params; /* What the mixer needs (gammapad_ffmix.h) */
+    struct ff_effect eff;     /* As uploaded, for passthrough */
     __u16 ffType;
 };
 
 /*
- * Global array of stored effects
+ * Stored effects, indexed by kernel_id: uinput hands out ids
+ * 0..ff_effects_max-1 and keeps them unique, so no search is needed.
  */
-static struct StoredEffect gEffects[MAX_EFFECTS];
+static struct StoredEffect gEffects[GP_FF_MAX_EFFECTS];
+
+static struct StoredEffect* effectFor(int kid)
+{
+    if (kid < 0 || kid >= GP_FF_MAX_EFFECTS) {
+        LOG_FF("[FF] kernel_id=%d out of range (max %d), ignoring.\n", kid, GP_FF_MAX_EFFECTS);
+        return NULL;
+    }
+    return &gEffects[kid];
+}
 
 /*
- * Path to the vibrator for device
- *
- * In this example, we treat VIB_PATH as controlling a single “hardware”
- * but in this project we might differentiate between Vibrator0 vs Vibrator1
- * if actually using different sysfs nodes. Here it’s a single path for both.
+ * Backends: where effects end up.
+ *   timed_output / leds => the haptics worker mixes them and pulses a
+ *                          sysfs vibrator (gammapad_haptics.c)
+ *   passthrough         => re-uploaded to the physical pad (g_physicalFd)
+ *                          with EVIOCSFF, so its own motors render them
  */
-static const char* VIB_PATH = "/sys/class/timed_output/vibrator/enable";
+struct GpFfBackend {
+    const char* name;
+    int  (*start)(struct GpHapticsConfig* cfg);
+    void (*stop)(void);
+    void (*upload)(int kid, const struct StoredEffect* se);  /* new or re-uploaded */
+    void (*erase)(int kid);
+    void (*play)(int kid, const struct StoredEffect* se, int count);
+    void (*stopEffect)(int kid);
+    void (*setGain)(unsigned int gain);
+    void (*setAutocenter)(unsigned int autocenter);
+};
+
+/* --- sysfs vibrator (haptics worker) --- */
+
+static int timedOutputStart(struct GpHapticsConfig* cfg)
+{
+    cfg->kind = GP_VIB_TIMED_OUTPUT;
+    return gp_haptics_start(cfg);
+}
+
+static int ledsStart(struct GpHapticsConfig* cfg)
+{
+    cfg->kind = GP_VIB_LEDS;
+    return gp_haptics_start(cfg);
+}
+
+static void vibUpload(int kid, const struct StoredEffect* se)
+{
+    /* Re-uploading a playing effect (games do this to change strength) => live update. */
+    gp_haptics_update(kid, &se->params);
+}
+
+static void vibErase(int kid)                         { gp_haptics_stop_effect(kid); }
+static void vibSetGain(unsigned int gain)             { gp_haptics_set_gain(gain); }
+static void vibSetAutocenter(unsigned int autocenter) { gp_haptics_set_autocenter(autocenter); }
+
+static void vibPlay(int kid, const struct StoredEffect* se, int count)
+{
+    if (gp_haptics_play(kid, &se->params, count) == 0) {
+        LOG_FF("[FF] Effect kernel_id=%d => queued x%d (type=%u, mag=%u/%u, dur=%u ms).\n",
+               kid, count, se->ffType, se->params.magnitude[GP_FF_STRONG],
+               se->params.magnitude[GP_FF_WEAK], se->params.durationMs);
+    }
+}
+
+/* --- evdev passthrough --- */
 
 /*
- * toggleMotorRepeatedly:
- * Toggles the motor based on 'magnitude' for 'durationMs' milliseconds.
- *
- * If magnitude >= 60000, attempt a "timed" approach by writing the entire
- * durationMs once (if supported). Otherwise, fallback to repeated short ~50ms
- * ON cycles until we reach the end time.
- *
- * For magnitude < 60000, do repeated ON->sleep->OFF toggles using a variable
- * sleep time derived from 'magnitude'.
- *
- * We also force the motor OFF first to avoid leftover vibrations from
- * previously started or stale effect data.
+ * Our kernel_id => the id the physical device gave the same effect (-1 =>
+ * not uploaded there). Effects die with the fd, so a new physical fd
+ * starts from scratch and everything is uploaded again.
  */
-static void toggleMotorRepeatedly(unsigned int durationMs, unsigned int magnitude)
+static int gPhysId[GP_FF_MAX_EFFECTS];
+static int gPassFd = -1;
+static unsigned int gPassGain = 0xffff;
+static unsigned int gPassAutocenter = 0;
+
+static void passWrite(__u16 code, __s32 value)
 {
-    if (!durationMs || !magnitude) return;
-
-    /* Force the vibrator OFF before we begin any new effect. */
-    {
-        FILE* fOff = fopen(VIB_PATH, "w");
-        if (fOff) {
-            fprintf(fOff, "0\n");
-            fclose(fOff);
-        }
+    struct input_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type  = EV_FF;
+    ev.code  = code;
+    ev.value = value;
+    if (gPassFd >= 0 && write(gPassFd, &ev, sizeof(ev)) < 0) {
+        LOG_FF("[FF] passthrough EV_FF code=%u value=%d => %s\n", code, value, strerror(errno));
     }
+}
 
-    unsigned long long start   = getTimeMs();
-    unsigned long long endTime = start + durationMs;
-
-    /*
-     * For toggling intervals, map magnitude (0..65535) to an
-     * approximate [10,000..150,000] range for sleep in microseconds.
-     */
-    unsigned int sleepUs = 150000 - (unsigned int)((400000.0 * magnitude) / 65535.0);
-    if (sleepUs < 10000) sleepUs = 10000; /* clamp to avoid too frequent toggles */
-
-    /*
-     * For simplicity, we illustrate one style: toggling ON->sleepUs->OFF
-     * repeatedly until the effect time is up.
-     */
-    while (getTimeMs() < endTime) {
-        /* Turn the motor ON. */
-        FILE* fOn = fopen(VIB_PATH, "w");
-        if (fOn) {
-            fprintf(fOn, "1\n");
-            fclose(fOn);
-        }
+static void passUpload(int kid, const struct StoredEffect* se)
+{
+    if (gPassFd < 0) return;  /* uploaded once a physical pad shows up */
+    if (se->eff.type == FF_PERIODIC && se->eff.u.periodic.waveform == FF_CUSTOM) {
+        /* custom_data points into the client that uploaded it => not ours to pass on */
+        LOG_FF("[FF] passthrough kid=%d: FF_CUSTOM waveform not supported.\n", kid);
+        return;
+    }
 
-        usleep(sleepUs);
+    struct ff_effect copy = se->eff;
+    copy.id = gPhysId[kid];   /* -1 => new, else update in place */
+    if (ioctl(gPassFd, EVIOCSFF, &copy) < 0) {
+        LOG_FF("[FF] passthrough upload kid=%d type=%u => %s\n", kid, copy.type, strerror(errno));
+        return;
+    }
+    gPhysId[kid] = copy.id;
+    LOG_FF("[FF] passthrough kid=%d => physical id=%d\n", kid, copy.id);
+}
 
-        /* Turn the motor OFF. */
-        FILE* fOff2 = fopen(VIB_PATH, "w");
-        if (fOff2) {
-            fprintf(fOff2, "0\n");
-            fclose(fOff2);
-        }
+static void passErase(int kid)
+{
+    if (gPassFd >= 0 && gPhysId[kid] >= 0) {
+        ioctl(gPassFd, EVIOCRMFF, gPhysId[kid]);
     }
+    gPhysId[kid] = -1;
 }
 
-/*
- * EffectThreadData:
- * Holds parameters for a single effect in a worker thread.
- */
-struct EffectThreadData {
-    unsigned int magnitude;
-    unsigned int durationMs;
-    __u16 ffType;
-};
+static void passPlay(int kid, const struct StoredEffect* se, int count)
+{
+    if (gPhysId[kid] < 0) passUpload(kid, se);
+    if (gPhysId[kid] < 0) return;
+    passWrite((__u16)gPhysId[kid], count);
+}
 
-/*
- * effectThreadFunc:
- * Spawns a new thread to run toggleMotorRepeatedly for the entire
- * requested duration, ignoring leftover or expiry logic.
- */
-static void* effectThreadFunc(void* arg)
+static void passStopEffect(int kid)
+{
+    if (kid < 0) {
+        for (int i = 0; i < GP_FF_MAX_EFFECTS; i++) passStopEffect(i);
+        return;
+    }
+    if (kid < GP_FF_MAX_EFFECTS && gPhysId[kid] >= 0) passWrite((__u16)gPhysId[kid], 0);
+}
+
+static void passSetGain(unsigned int gain)
+{
+    gPassGain = gain;
+    passWrite(FF_GAIN, (__s32)gain);
+}
+
+static void passSetAutocenter(unsigned int autocenter)
 {
-    struct EffectThreadData* ed = (struct EffectThreadData*)arg;
+    gPassAutocenter = autocenter;
+    passWrite(FF_AUTOCENTER, (__s32)autocenter);
+}
 
-    LOG_FF("[FF-Thread] Type=%u, Magnitude=%u, Duration=%u ms\n",
-           ed->ffType, ed->magnitude, ed->durationMs);
+/* Take over a (new) physical fd: nothing of ours lives on it yet. */
+static void passAttach(int fd)
+{
+    gPassFd = fd;
+    for (int i = 0; i < GP_FF_MAX_EFFECTS; i++) gPhysId[i] = -1;
+    if (fd < 0) return;
 
-    toggleMotorRepeatedly(ed->durationMs, ed->magnitude);
+    for (int i = 0; i < GP_FF_MAX_EFFECTS; i++) {
+        if (gEffects[i].used) passUpload(i, &gEffects[i]);
+    }
+    if (gPassGain != 0xffff) passWrite(FF_GAIN, (__s32)gPassGain);
+    if (gPassAutocenter)     passWrite(FF_AUTOCENTER, (__s32)gPassAutocenter);
+}
+
+static int passStart(struct GpHapticsConfig* cfg)
+{
+    (void)cfg;
+    passAttach(g_physicalFd);
+    return 0;
+}
 
-    free(ed);
-    return NULL;
+static void passStop(void)
+{
+    for (int i = 0; i < GP_FF_MAX_EFFECTS; i++) passErase(i);
+    gPassFd = -1;
 }
 
+static const struct GpFfBackend gBackends[] = {
+    { "timed_output", timedOutputStart, gp_haptics_stop, vibUpload, vibErase,
+      vibPlay, vibErase, vibSetGain, vibSetAutocenter },
+    { "leds", ledsStart, gp_haptics_stop, vibUpload, vibErase,
+      vibPlay, vibErase, vibSetGain, vibSetAutocenter },
+    { "passthrough", passStart, passStop, passUpload, passErase,
+      passPlay, passStopEffect, passSetGain, passSetAutocenter },
+};
+#define GP_FF_BACKEND_COUNT ((int)(sizeof(gBackends) / sizeof(gBackends[0])))
+
+static const struct GpFfBackend* gBackend = &gBackends[0];
+
 /*
  * storeUploadedEffect:
  * Called after UI_END_FF_UPLOAD to store effect data in gEffects[].
  *
- * IMPORTANT: We treat "weak_magnitude" as the LARGE motor (Vibrator1),
- * and "strong_magnitude" as the SMALL motor (Vibrator0). If both are
- * non-zero, we prioritize the large motor (the old “weak”).
+ * FF_RUMBLE keeps both motors: strong_magnitude on the strong channel,
+ * weak_magnitude on the weak one. Every other type has a single level,
+ * which goes on both. Per-motor scaling happens at render time
+ * (gammapad_haptics.c).
+ *
+ * Constant, ramp and periodic effects are compiled here, once, into
+ * envelope/waveform tables (gp_ffmix_compile), so playback never
+ * evaluates the waveform.
  */
 void storeUploadedEffect(struct ff_effect* eff)
 {
@@ -145,70 +227,22 @@ void storeUploadedEffect(struct ff_effect* eff)
     int kid = eff->id;
     LOG_FF("[FF] storeUploadedEffect => kernel_id=%d\n", kid);
 
-    /* Remove existing effect with same kernel_id if any. */
-    for (int i = 0; i < MAX_EFFECTS; i++) {
-        if (gEffects[i].used && (gEffects[i].kernel_id == kid)) {
-            LOG_FF("[FF] Overwriting existing effect kernel_id=%d in slot=%d\n",
-                   kid, i);
-            ioctl(controllerFd, EVIOCRMFF, kid); /* remove from kernel */
-            gEffects[i].used = 0;
-        }
+    struct StoredEffect* se = effectFor(kid);
+    if (!se) return;
+    if (se->used) {
+        LOG_FF("[FF] Overwriting existing effect kernel_id=%d\n", kid);
     }
 
-    /* Find a free slot or fallback to slot=0. */
-    int idx = -1;
-    for (int i = 0; i < MAX_EFFECTS; i++) {
-        if (!gEffects[i].used) {
-            idx = i;
-            break;
-        }
-    }
-    if (idx < 0) {
-        idx = 0;
-        if (gEffects[idx].used) {
-            if (ioctl(controllerFd, EVIOCRMFF, gEffects[idx].kernel_id) == 0) {
-                LOG_FF("[FF] Cleared effect in slot=0 (kid=%d)\n",
-                       gEffects[idx].kernel_id);
-            }
-            gEffects[idx].used = 0;
-        }
-    }
+    gp_ffmix_compile(eff, &se->params);
 
-    gEffects[idx].used      = 1;
-    gEffects[idx].kernel_id = kid;
-
-    /* Determine the magnitude based on effect->type, now swapped for rumble. */
     unsigned int mag = 0;
     switch (eff->type) {
     case FF_RUMBLE:
-    {
-        /*
-         * SWAPPED logic:
-         *  - weak_magnitude => small motor
-         *  - strong_magnitude => large motor
-         * We also do minimal scaling (we can adjust to taste).
-         */
-        unsigned int smallMotor = eff->u.rumble.weak_magnitude / 2;
-        unsigned int largeMotor = eff->u.rumble.strong_magnitude / 3;
-
-        /* If both present => pick largeMotor first. */
-        if (largeMotor > 0 && smallMotor > 0) {
-            mag = largeMotor;
-        } else if (largeMotor > 0) {
-            mag = largeMotor;
-        } else {
-            mag = smallMotor; /* fallback */
-        }
         break;
-    }
     case FF_CONSTANT:
-        mag = eff->u.constant.level;
-        break;
     case FF_PERIODIC:
-        mag = eff->u.periodic.magnitude;
-        break;
     case FF_RAMP:
-        mag = (eff->u.ramp.start_level + eff->u.ramp.end_level) / 2;
+        mag = se->params.shape.hold;  /* level when flat; see the shape otherwise */
         break;
     case FF_SPRING:
     case FF_DAMPER:
@@ -220,12 +254,35 @@ void storeUploadedEffect(struct ff_effect* eff)
         break;
     }
 
-    gEffects[idx].magnitude  = mag;
-    gEffects[idx].durationMs = eff->replay.length;
-    gEffects[idx].ffType     = eff->type;
+    if (eff->type == FF_RUMBLE) {
+        se->params.magnitude[GP_FF_STRONG] = eff->u.rumble.strong_magnitude;
+        se->params.magnitude[GP_FF_WEAK]   = eff->u.rumble.weak_magnitude;
+    } else {
+        se->params.magnitude[GP_FF_STRONG] = mag;
+        se->params.magnitude[GP_FF_WEAK]   = mag;
+    }
+
+    /* Condition effects are background forces; events preempt them first. */
+    unsigned char prio = GP_FF_PRIO_RUMBLE;
+    if (eff->type == FF_RAMP) prio = GP_FF_PRIO_RAMP;
+    if (eff->type == FF_SPRING || eff->type == FF_DAMPER || eff->type == FF_INERTIA) {
+        prio = GP_FF_PRIO_CONDITION;
+    }
+
+    se->used                = 1;
+    se->ffType              = eff->type;
+    se->params.durationMs   = eff->replay.length;
+    se->params.delayMs      = eff->replay.delay;
+    se->params.priority     = prio;
+    se->params.condition    = (prio == GP_FF_PRIO_CONDITION);
+    se->eff                 = *eff;
 
-    LOG_FF("[FF] Stored effect => slot=%d, mag=%u, dur=%u, type=%u\n",
-           idx, mag, eff->replay.length, eff->type);
+    LOG_FF("[FF] Stored effect => kid=%d, mag=%u/%u, dur=%u, delay=%u, type=%u%s\n",
+           kid, se->params.magnitude[GP_FF_STRONG], se->params.magnitude[GP_FF_WEAK],
+           eff->replay.length, eff->replay.delay, eff->type,
+           se->params.shape.shaped ? " (shaped)" : "");
+
+    gBackend->upload(kid, se);
 }
 
 /*
@@ -247,57 +304,113 @@ int dummy_upload_ff_effect(struct ff_effect* eff)
 int dummy_erase_ff_effect(int kernel_id)
 {
     LOG_FF("[FF] Erase effect => kernel_id=%d\n", kernel_id);
-    for (int i = 0; i < MAX_EFFECTS; i++) {
-        if (gEffects[i].used && gEffects[i].kernel_id == kernel_id) {
-            if (ioctl(controllerFd, EVIOCRMFF, kernel_id) == 0) {
-                LOG_FF("[FF] Freed slot for kernel_id=%d\n", kernel_id);
-            }
-            gEffects[i].used = 0;
-            break;
-        }
-    }
+    struct StoredEffect* se = effectFor(kernel_id);
+    if (!se || !se->used) return 0;
+
+    /* uinput already dropped it from the device; we only forget it. */
+    se->used = 0;
+    gBackend->erase(kernel_id);
     return 0;
 }
 
 /*
  * ff_play_effect:
- * Called on EV_FF code=<kid> value=1 => play, value=0 => stop.
+ * Called on EV_FF code=<kid> value=N => play N times, value=0 => stop.
  *
- * If doPlay==1 => spawn a new thread for the full effect duration.
- * If doPlay==0 => just log "stop" and do not forcibly kill threads.
+ * Both just queue a command for the haptics worker (gammapad_haptics.c),
+ * which owns the vibrator and the mixer; a stop takes effect right away.
  */
-void ff_play_effect(int kid, int doPlay)
+void ff_play_effect(int kid, int value)
 {
-    if (doPlay) {
-        /* find effect by kernel_id */
-        for (int i = 0; i < MAX_EFFECTS; i++) {
-            if (gEffects[i].used && gEffects[i].kernel_id == kid) {
-                /* Launch worker thread with updated magnitude/duration. */
-                struct EffectThreadData* ed = calloc(1, sizeof(*ed));
-                if (!ed) {
-                    LOG_FF("[FF] Allocation failed for kernel_id=%d\n", kid);
-                    return;
-                }
-                ed->magnitude  = gEffects[i].magnitude;
-                ed->durationMs = gEffects[i].durationMs;
-                ed->ffType     = gEffects[i].ffType;
-
-                pthread_t th;
-                if (pthread_create(&th, NULL, effectThreadFunc, ed) != 0) {
-                    LOG_FF("[FF] Thread creation failed for kernel_id=%d\n", kid);
-                    free(ed);
-                    gEffects[i].used = 0; /* discard data */
-                    return;
-                }
-                pthread_detach(th);
-                LOG_FF("[FF] Effect kernel_id=%d => playing in background.\n", kid);
-                return;
-            }
-        }
+    if (value <= 0) {
+        LOG_FF("[FF] Stop effect: kernel_id=%d\n", kid);
+        gBackend->stopEffect(kid);
+        return;
+    }
+
+    struct StoredEffect* se = effectFor(kid);
+    if (!se) return;
+    if (!se->used) {
         LOG_FF("[FF] No stored effect found for kernel_id=%d, ignoring.\n", kid);
+        return;
     }
-    else {
-        /* doPlay==0 => just log a "stop" without forcibly killing threads. */
-        LOG_FF("[FF] Stop effect: kernel_id=%d (not forcibly cancelled)\n", kid);
+    gBackend->play(kid, se, value);
+}
+
+/*
+ * ff_set_gain / ff_set_autocenter:
+ * EV_FF FF_GAIN / FF_AUTOCENTER, value 0..0xffff, applied by the mixer.
+ */
+void ff_set_gain(int value)
+{
+    LOG_FF("[FF] Gain => %d\n", value);
+    gBackend->setGain(value < 0 ? 0 : (unsigned int)value);
+}
+
+void ff_set_autocenter(int value)
+{
+    LOG_FF("[FF] Autocenter => %d\n", value);
+    gBackend->setAutocenter(value < 0 ? 0 : (unsigned int)value);
+}
+
+/*
+ * physicalHasFF => the device can render rumble itself.
+ */
+static int physicalHasFF(int fd)
+{
+    unsigned long bits[(FF_MAX + 8 * sizeof(unsigned long)) / (8 * sizeof(unsigned long))];
+    memset(bits, 0, sizeof(bits));
+    if (fd < 0 || ioctl(fd, EVIOCGBIT(EV_FF, sizeof(bits)), bits) < 0) return 0;
+    return (bits[FF_RUMBLE / (8 * sizeof(unsigned long))] >> (FF_RUMBLE % (8 * sizeof(unsigned long)))) & 1;
+}
+
+/*
+ * ff_backend_start:
+ * Pick and start the backend. name is timed_output, leds, passthrough or
+ * auto/NULL (passthrough if the physical pad has rumble motors, else leds
+ * if the leds-vibrator node exists, else timed_output). cfg (NULL =>
+ * defaults) holds the motor paths and tuning for the sysfs backends.
+ */
+int ff_backend_start(const char* name, const struct GpHapticsConfig* cfg)
+{
+    struct GpHapticsConfig hc;
+    if (cfg) hc = *cfg;
+    else     gp_haptics_config_default(&hc);
+
+    const struct GpFfBackend* be = NULL;
+
+    if (!name || !*name || !strcmp(name, "auto")) {
+        if (physicalHasFF(g_physicalFd))              be = &gBackends[2];
+        else if (!access(GP_VIB_LEDS_PATH, F_OK))     be = &gBackends[1];
+        else                                          be = &gBackends[0];
+    } else {
+        for (int i = 0; i < GP_FF_BACKEND_COUNT; i++) {
+            if (!strcmp(name, gBackends[i].name)) be = &gBackends[i];
+        }
+        if (!be) {
+            GP_LOG(GP_LOG_FF, GP_LOG_WARN, "[FF] Unknown backend '%s', using auto.\n", name);
+            return ff_backend_start(NULL, &hc);
+        }
     }
+
+    gBackend = be;
+    GP_LOG(GP_LOG_FF, GP_LOG_INFO, "[FF] Backend => %s\n", be->name);
+    return be->start(&hc);
+}
+
+void ff_backend_stop(void)
+{
+    gBackend->stop();
+}
+
+/*
+ * ff_physical_changed:
+ * g_physicalFd changed (device detached or reattached). Passthrough moves
+ * its effects to the new fd; the sysfs backends do not care.
+ */
+void ff_physical_changed(int fd)
+{
+    if (gBackend->start != passStart || fd == gPassFd) return;
+    LOG_FF("[FF] passthrough => physical fd %d\n", fd);
+    passAttach(fd);
 }
@@ -0,0 +1,286 @@
+/*****************************************************
+ * gammapad_ffmix.c
+ *
+ * Force-feedback effect mixer. See gammapad_ffmix.h.
+ *****************************************************/
+
+#include "gammapad.h"
+#include "gammapad_ffmix.h"
+#include <linux/input.h>
+#include <math.h>
+
+#define MS_TO_NS(ms) ((unsigned long long)(ms) * 1000000ULL)
+
+void gp_ffmix_init(struct GpFfMixer* m, int mode)
+{
+    memset(m, 0, sizeof(*m));
+    m->mode = mode;
+    m->gain = 0xffff;
+}
+
+/*
+ * toChannel => a signed 15-bit level (constant/ramp/periodic, envelope)
+ * on the 0..65535 scale of FF_RUMBLE magnitudes, sign kept.
+ */
+static int toChannel(int level)
+{
+    int v = (int)(((long long)level * 0xffff) / 0x7fff);
+    return v > 0xffff ? 0xffff : (v < -0xffff ? -0xffff : v);
+}
+
+/*
+ * envelopeAt => linux semantics: the level rises from attack_level over
+ * attack_length and falls to fade_level over the last fade_length ms.
+ */
+static int envelopeAt(const struct ff_envelope* e, int amp, unsigned int t, unsigned int length)
+{
+    if (e->attack_length && t < e->attack_length) {
+        int attack = toChannel(e->attack_level);
+        amp = attack + (int)(((long long)(amp - attack) * t) / e->attack_length);
+    }
+    if (length && e->fade_length && t + e->fade_length > length) {
+        unsigned int left = t < length ? length - t : 0;
+        int fade = toChannel(e->fade_level);
+        amp = fade + (int)(((long long)(amp - fade) * left) / e->fade_length);
+    }
+    amp = amp < 0 ? -amp : amp;
+    return amp > 0xffff ? 0xffff : amp;
+}
+
+/* waveAt => one waveform sample at x in [0, 1), -127..127. */
+static int waveAt(int waveform, double x)
+{
+    switch (waveform) {
+    case FF_SQUARE:   return x < 0.5 ? 127 : -127;
+    case FF_TRIANGLE: return (int)lround(127.0 * (x < 0.25 ? 4 * x : x < 0.75 ? 2 - 4 * x : 4 * x - 4));
+    case FF_SINE:     return (int)lround(127.0 * sin(2 * M_PI * x));
+    case FF_SAW_UP:   return (int)lround(127.0 * (2 * x - 1));
+    case FF_SAW_DOWN: return (int)lround(127.0 * (1 - 2 * x));
+    default:          return 127;
+    }
+}
+
+void gp_ffmix_compile(const struct ff_effect* eff, struct GpFfParams* p)
+{
+    struct GpFfShape* sh = &p->shape;
+    memset(sh, 0, sizeof(*sh));
+
+    const struct ff_envelope* env;
+    int from, to;
+    switch (eff->type) {
+    case FF_CONSTANT:
+        env  = &eff->u.constant.envelope;
+        from = to = toChannel(eff->u.constant.level);
+        break;
+    case FF_RAMP:
+        env  = &eff->u.ramp.envelope;
+        from = toChannel(eff->u.ramp.start_level);
+        to   = toChannel(eff->u.ramp.end_level);
+        break;
+    case FF_PERIODIC:
+        env  = &eff->u.periodic.envelope;
+        from = to = toChannel(eff->u.periodic.magnitude);
+        if (eff->u.periodic.waveform != FF_CUSTOM && eff->u.periodic.period) {
+            double phase = (eff->u.periodic.phase % 36000) / 36000.0;
+            for (int i = 0; i < GP_FF_WAVE_STEPS; i++) {
+                double x = fmod((i + 0.5) / GP_FF_WAVE_STEPS + phase, 1.0);
+                sh->wave[i] = (unsigned char)(waveAt(eff->u.periodic.waveform, x) + 127);
+            }
+            sh->waveStepNs = (unsigned int)((eff->u.periodic.period * 1000000ULL) / GP_FF_WAVE_STEPS);
+            sh->offset     = toChannel(eff->u.periodic.offset);
+        }
+        break;
+    default:
+        return;
+    }
+
+    /* With no length, the envelope is the attack only, then holds. */
+    unsigned int length = eff->replay.length;
+    unsigned int span   = length ? length : env->attack_length;
+    if (!length) to = from;  /* a ramp needs a length */
+
+    sh->hold = (unsigned short)envelopeAt(env, to, span, length);
+    int varies = 0;
+    if (span) {
+        for (int i = 0; i < GP_FF_ENV_STEPS; i++) {
+            unsigned int t = (unsigned int)(((2ULL * i + 1) * span) / (2 * GP_FF_ENV_STEPS));
+            int base = from + (int)(((long long)(to - from) * t) / span);
+            sh->env[i] = (unsigned short)envelopeAt(env, base, t, length);
+            if (sh->env[i] != sh->env[0]) varies = 1;
+        }
+        sh->envStepNs = (unsigned int)((span * 1000000ULL) / GP_FF_ENV_STEPS);
+    }
+    if (!varies) {
+        if (span) sh->hold = sh->env[0];
+        sh->envStepNs = 0;
+    }
+
+    /* Still flat => 'hold' is the whole effect. */
+    sh->shaped = (sh->envStepNs || sh->waveStepNs);
+}
+
+/*
+ * shapeLevel => level of a shaped voice 'elapsed' ns into its repetition;
+ * *nextNs gets the next sample boundary (>= one shape tick away).
+ */
+static unsigned int shapeLevel(const struct GpFfShape* sh, unsigned long long elapsed,
+                               unsigned long long* nextNs)
+{
+    unsigned long long next = 0;
+    int amp = sh->hold;
+
+    if (sh->envStepNs) {
+        unsigned long long i = elapsed / sh->envStepNs;
+        if (i < GP_FF_ENV_STEPS) {
+            amp  = sh->env[i];
+            next = (i + 1) * sh->envStepNs;
+        }
+    }
+    int level = amp;
+    if (sh->waveStepNs) {
+        unsigned long long w = elapsed / sh->waveStepNs;
+        unsigned long long wnext = (w + 1) * sh->waveStepNs;
+        level = (sh->offset < 0 ? -sh->offset : sh->offset) +
+                (amp * sh->wave[w & (GP_FF_WAVE_STEPS - 1)]) / 254;
+        if (!next || wnext < next) next = wnext;
+    }
+
+    unsigned long long tick = elapsed + MS_TO_NS(GP_FF_SHAPE_TICK_MS);
+    *nextNs = (next && next < tick) ? tick : next;
+    return (unsigned int)(level > 0xffff ? 0xffff : level);
+}
+
+static void retire(struct GpFfMixer* m, struct GpFfVoice* v)
+{
+    if (!v->active) return;
+    v->active = 0;
+    m->activeCount--;
+}
+
+/*
+ * pickVictim => lowest priority, then oldest. NULL if every scheduled
+ * voice outranks 'priority'.
+ */
+static struct GpFfVoice* pickVictim(struct GpFfMixer* m, unsigned int priority)
+{
+    struct GpFfVoice* victim = NULL;
+    for (int i = 0; i < GP_FF_MAX_EFFECTS; i++) {
+        struct GpFfVoice* v = &m->voices[i];
+        if (!v->active) continue;
+        if (!victim || v->p.priority < victim->p.priority ||
+            (v->p.priority == victim->p.priority && v->seq < victim->seq)) {
+            victim = v;
+        }
+    }
+    if (victim && victim->p.priority > priority) return NULL;
+    return victim;
+}
+
+int gp_ffmix_play(struct GpFfMixer* m, int kid, const struct GpFfParams* p, int repeat,
+                  unsigned long long nowNs)
+{
+    if (kid < 0 || kid >= GP_FF_MAX_EFFECTS || !p || repeat <= 0) return -1;
+
+    struct GpFfVoice* v = &m->voices[kid];
+    if (!v->active && m->activeCount >= GP_FF_MAX_VOICES) {
+        struct GpFfVoice* victim = pickVictim(m, p->priority);
+        if (!victim) {
+            LOG_FF("[FF-Mix] kid=%d (prio %u) rejected, %d voices outrank it\n",
+                   kid, p->priority, m->activeCount);
+            return -1;
+        }
+        LOG_FF("[FF-Mix] kid=%d preempts kid=%d\n", kid, (int)(victim - m->voices));
+        retire(m, victim);
+    }
+
+    if (!v->active) m->activeCount++;
+    v->active      = 1;
+    v->p           = *p;
+    v->repeatsLeft = repeat;
+    v->startNs     = nowNs + MS_TO_NS(p->delayMs);
+    v->seq         = ++m->seq;
+    return 0;
+}
+
+void gp_ffmix_update(struct GpFfMixer* m, int kid, const struct GpFfParams* p)
+{
+    if (kid < 0 || kid >= GP_FF_MAX_EFFECTS || !p) return;
+    struct GpFfVoice* v = &m->voices[kid];
+    if (v->active) v->p = *p;  /* the timeline keeps running */
+}
+
+void gp_ffmix_stop(struct GpFfMixer* m, int kid)
+{
+    if (kid < 0) {
+        for (int i = 0; i < GP_FF_MAX_EFFECTS; i++) retire(m, &m->voices[i]);
+        return;
+    }
+    if (kid < GP_FF_MAX_EFFECTS) retire(m, &m->voices[kid]);
+}
+
+void gp_ffmix_set_gain(struct GpFfMixer* m, unsigned int gain)
+{
+    m->gain = gain > 0xffff ? 0xffff : gain;
+}
+
+void gp_ffmix_set_autocenter(struct GpFfMixer* m, unsigned int autocenter)
+{
+    m->autocenter = autocenter > 0xffff ? 0xffff : autocenter;
+}
+
+unsigned int gp_ffmix_level(struct GpFfMixer* m, unsigned long long nowNs,
+                            unsigned int level[GP_FF_CHANNELS],
+                            unsigned long long* nextChangeNs)
+{
+    unsigned int mixed[GP_FF_CHANNELS] = { 0 };
+    unsigned long long next = 0;
+
+    for (int i = 0; i < GP_FF_MAX_EFFECTS && m->activeCount > 0; i++) {
+        struct GpFfVoice* v = &m->voices[i];
+        if (!v->active) continue;
+
+        /* Finished repetitions => next one (after its delay) or retire. */
+        while (v->p.durationMs && nowNs >= v->startNs + MS_TO_NS(v->p.durationMs)) {
+            if (--v->repeatsLeft <= 0) {
+                retire(m, v);
+                break;
+            }
+            v->startNs += MS_TO_NS(v->p.durationMs) + MS_TO_NS(v->p.delayMs);
+        }
+        if (!v->active) continue;
+
+        unsigned long long change;
+        if (nowNs < v->startNs) {
+            change = v->startNs;                 /* still in its delay */
+        } else {
+            unsigned long long shapeNext = 0;
+            unsigned int shaped = 0;
+            if (v->p.shape.shaped) {
+                shaped = shapeLevel(&v->p.shape, nowNs - v->startNs, &shapeNext);
+            }
+            for (int c = 0; c < GP_FF_CHANNELS; c++) {
+                unsigned int lv = v->p.shape.shaped ? shaped : v->p.magnitude[c];
+                if (v->p.condition && lv < m->autocenter) lv = m->autocenter;
+                if (m->mode == GP_FF_MIX_MAX) {
+                    if (lv > mixed[c]) mixed[c] = lv;
+                } else {
+                    mixed[c] += lv;
+                }
+            }
+            change = v->p.durationMs ? v->startNs + MS_TO_NS(v->p.durationMs) : 0;
+            if (shapeNext && (!change || v->startNs + shapeNext < change)) {
+                change = v->startNs + shapeNext;
+            }
+        }
+        if (change && (!next || change < next)) next = change;
+    }
+
+    unsigned int top = 0;
+    for (int c = 0; c < GP_FF_CHANNELS; c++) {
+        if (mixed[c] > 0xffff) mixed[c] = 0xffff;
+        level[c] = (unsigned int)(((unsigned long long)mixed[c] * m->gain) / 0xffff);
+        if (level[c] > top) top = level[c];
+    }
+    if (nextChangeNs) *nextChangeNs = next;
+    return top;
+}
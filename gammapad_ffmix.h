@@ -0,0 +1,139 @@
+#ifndef GAMMAPAD_FFMIX_H
+#define GAMMAPAD_FFMIX_H
+
+/*
+ * gammapad_ffmix.h
+ *
+ * Force-feedback effect mixer, run by the haptics worker on every tick.
+ *
+ * Voices are indexed directly by kernel effect id (uinput hands out ids
+ * 0..ff_effects_max-1), so play/stop/update are O(1). Each voice follows
+ * the kernel's replay rules: it starts replay.delay after the play
+ * request, lasts replay.length (0 => until stopped) and runs 'repeat'
+ * times, with the delay before every repetition.
+ *
+ * Every voice carries two channels, strong and weak (FF_RUMBLE's
+ * strong_magnitude / weak_magnitude; other effects put the same level on
+ * both). Each output channel (0..65535) is the sum (clamped) or the max of
+ * that channel over all voices currently sounding, scaled by FF_GAIN. Condition effects
+ * (spring/damper/inertia) play at least at FF_AUTOCENTER strength: a
+ * vibrator has no centering spring, so autocenter is rendered as the
+ * floor of those effects only.
+ *
+ * Constant, ramp and periodic effects are compiled once at upload
+ * (gp_ffmix_compile) into two small tables: the amplitude envelope over
+ * the effect's length (ramp + attack/fade) and one period of the
+ * waveform (phase already applied). Playing them is a table walk; the
+ * tables are resampled every GP_FF_SHAPE_TICK_MS at most. A vibrator has
+ * no direction, so waveforms are rendered unipolar: the trough is off and
+ * the crest is full amplitude (a square wave becomes a 50% on/off duty).
+ *
+ * At most GP_FF_MAX_VOICES effects are scheduled at once. A new play
+ * preempts the lowest-priority voice (oldest first among equals), or is
+ * rejected if every scheduled voice outranks it.
+ *
+ * Not thread-safe: owned by the haptics worker.
+ */
+
+#define GP_FF_MAX_EFFECTS 32    /* == ff_effects_max of the virtual pad */
+#define GP_FF_MAX_VOICES  8
+
+#define GP_FF_ENV_STEPS      32   /* envelope samples over the effect length */
+#define GP_FF_WAVE_STEPS     32   /* waveform samples per period, power of two */
+#define GP_FF_SHAPE_TICK_MS  2
+
+enum GpFfMixMode {
+    GP_FF_MIX_SUM = 0,
+    GP_FF_MIX_MAX
+};
+
+enum GpFfChannel {
+    GP_FF_STRONG = 0,
+    GP_FF_WEAK,
+    GP_FF_CHANNELS
+};
+
+enum GpFfPriority {
+    GP_FF_PRIO_CONDITION = 0,   /* spring/damper/inertia: background */
+    GP_FF_PRIO_RAMP,
+    GP_FF_PRIO_RUMBLE           /* rumble/constant/periodic: events  */
+};
+
+/*
+ * Compiled shape. Level at t (since the start of the repetition):
+ *   amp   = env[t / envStepNs], or hold once past the table
+ *   level = |offset| + amp * wave[(t / waveStepNs) % steps] / 254
+ * without a wave table, level = amp. The effect's signed 15-bit levels
+ * are scaled to the channel range at compile time, so a full-scale
+ * constant effect is as strong as a full FF_RUMBLE.
+ */
+struct GpFfShape {
+    unsigned char  shaped;      /* 0 => flat, use magnitude[] */
+    unsigned int   envStepNs;   /* 0 => amp is always 'hold' */
+    unsigned int   waveStepNs;  /* 0 => no waveform */
+    unsigned short hold;
+    int            offset;      /* 0..65535 scale, like hold */
+    unsigned short env[GP_FF_ENV_STEPS];
+    unsigned char  wave[GP_FF_WAVE_STEPS];  /* 0 (trough) .. 254 (crest) */
+};
+
+struct GpFfParams {
+    unsigned int   magnitude[GP_FF_CHANNELS];  /* 0..65535 */
+    unsigned int   durationMs;  /* 0 => until stopped */
+    unsigned int   delayMs;
+    unsigned char  priority;    /* enum GpFfPriority */
+    unsigned char  condition;   /* autocenter floor applies */
+    struct GpFfShape shape;     /* same level on both channels when shaped */
+};
+
+struct GpFfVoice {
+    int               active;
+    int               repeatsLeft;  /* including the current one */
+    unsigned long long startNs;     /* current repetition starts here */
+    unsigned long long seq;         /* play order, for preemption ties */
+    struct GpFfParams p;
+};
+
+struct GpFfMixer {
+    struct GpFfVoice voices[GP_FF_MAX_EFFECTS];
+    int          mode;              /* enum GpFfMixMode */
+    int          activeCount;
+    unsigned int gain;              /* 0..0xffff, FF_GAIN */
+    unsigned int autocenter;        /* 0..0xffff, FF_AUTOCENTER */
+    unsigned long long seq;
+};
+
+void gp_ffmix_init(struct GpFfMixer* m, int mode);
+
+/*
+ * gp_ffmix_compile => build p->shape for a constant/ramp/periodic effect
+ * (flat for everything else, and for shapes that turn out constant).
+ * Periodic phase is in hundredths of a degree; FF_CUSTOM plays flat.
+ */
+struct ff_effect;
+void gp_ffmix_compile(const struct ff_effect* eff, struct GpFfParams* p);
+
+/* Returns 0 if scheduled, -1 if rejected (bad id, repeat <= 0, outranked). */
+int  gp_ffmix_play(struct GpFfMixer* m, int kid, const struct GpFfParams* p, int repeat,
+                   unsigned long long nowNs);
+
+/* New parameters for a scheduled voice (re-upload while playing). */
+void gp_ffmix_update(struct GpFfMixer* m, int kid, const struct GpFfParams* p);
+
+/* Stop one voice, or all of them with kid < 0. */
+void gp_ffmix_stop(struct GpFfMixer* m, int kid);
+
+void gp_ffmix_set_gain(struct GpFfMixer* m, unsigned int gain);
+void gp_ffmix_set_autocenter(struct GpFfMixer* m, unsigned int autocenter);
+
+/*
+ * gp_ffmix_level => mixed level of every channel at nowNs (retiring
+ * finished voices and advancing repeats). *nextChangeNs gets the next time
+ * the set of sounding voices changes, or 0 if nothing is scheduled.
+ * Returns the highest channel level (0 => silent).
+ */
+unsigned int gp_ffmix_level(struct GpFfMixer* m, unsigned long long nowNs,
+                            unsigned int level[GP_FF_CHANNELS],
+                            unsigned long long* nextChangeNs);
+
+#endif /* GAMMAPAD_FFMIX_H */
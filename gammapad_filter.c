@@ -0,0 +1,359 @@
+/*****************************************************
+ * gammapad_filter.c
+ *
+ * Dead zones, hysteresis and unchanged-value suppression for axes.
+ * See gammapad_filter.h.
+ *****************************************************/
+
+#include "gammapad_filter.h"
+#include <limits.h>
+#include <math.h>
+
+/* The kernels match bit for bit only if no multiply-add gets fused (arm64). */
+#if defined(__clang__)
+  #pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+  #pragma GCC optimize("fp-contract=off")
+#endif
+
+#if GAMMAPAD_SIMD && defined(__SSE2__)
+  #include <emmintrin.h>
+  #define FILTER_SSE2 1
+#elif GAMMAPAD_SIMD && defined(__ARM_NEON) && defined(__aarch64__)
+  #include <arm_neon.h>
+  #define FILTER_NEON 1
+#endif
+
+int gp_filter_rule_set(struct GpFilterRule* rules, int* count, const struct GpFilterRule* rule)
+{
+    /* A new rule replaces every rule that shares an axis with it. */
+    int n = 0;
+    for (int i = 0; i < *count; i++) {
+        const struct GpFilterRule* r = &rules[i];
+        int overlap = r->code == rule->code || r->code == rule->pair ||
+                      (r->pair != GP_FILTER_NO_PAIR && (r->pair == rule->code || r->pair == rule->pair));
+        if (!overlap) rules[n++] = *r;
+    }
+    *count = n;
+    if (n >= GP_FILTER_MAX_RULES) return -1;
+    rules[(*count)++] = *rule;
+    return 0;
+}
+
+static int addAxis(struct GpFilter* f, const struct GpFilterRule* r, int code, int trigger,
+                   const int* absMin, const int* absMax)
+{
+    if (code > ABS_MAX || f->count >= GP_FILTER_MAX_AXES) return -1;
+    int min = absMin[code], max = absMax[code];
+    if (max <= min) return -1;         /* not discovered */
+
+    int i = f->count;
+    struct GpFilterAxis* a = &f->axes[i];
+    struct GpFilterLanes* l = &f->lanes;
+    a->code       = (__u16)code;
+    a->partner    = -1;
+    a->hysteresis = r->hysteresis;
+    a->out        = INT_MIN;
+    l->min[i]     = min;
+    l->max[i]     = max;
+    l->center[i]  = trigger ? min : min + (max - min) / 2;
+    l->half[i]    = trigger ? max - min : (max - min) / 2;
+    if (l->half[i] < 1) l->half[i] = 1;
+    l->inner[i]   = r->inner;
+    l->outer[i]   = r->outer;
+    l->raw[i]     = l->center[i];
+    f->slot[code] = (signed char)i;
+    return f->count++;
+}
+
+/* A lane without an axis computes a harmless 0, so kernels never need a tail. */
+static void resetLane(struct GpFilterLanes* l, int i)
+{
+    l->raw[i] = l->center[i] = l->min[i] = l->max[i] = 0;
+    l->half[i]  = 1;
+    l->inner[i] = 0.0f;
+    l->outer[i] = 1.0f;
+    l->stick[i] = 0;
+    l->pair[i]  = i;
+}
+
+int gp_filter_build(struct GpFilter* f, const struct GpFilterRule* rules, int ruleCount,
+                    const int* absMin, const int* absMax)
+{
+    memset(f, 0, sizeof(*f));
+    memset(f->slot, -1, sizeof(f->slot));
+    for (int i = 0; i < GP_FILTER_MAX_AXES; i++) resetLane(&f->lanes, i);
+
+    for (int i = 0; i < ruleCount; i++) {
+        const struct GpFilterRule* r = &rules[i];
+        if (r->pair == GP_FILTER_NO_PAIR) {
+            if (addAxis(f, r, r->code, r->trigger, absMin, absMax) < 0) {
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Filter] axis %d not present, rule skipped.\n", r->code);
+            }
+            continue;
+        }
+        /* A stick needs both axes, or it is left unfiltered. */
+        int saved = f->count;
+        int x = addAxis(f, r, r->code, 0, absMin, absMax);
+        int y = x < 0 ? -1 : addAxis(f, r, r->pair, 0, absMin, absMax);
+        if (y < 0) {
+            for (int k = saved; k < f->count; k++) {
+                f->slot[f->axes[k].code] = -1;
+                resetLane(&f->lanes, k);
+            }
+            f->count = saved;
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Filter] stick %d/%d not present, rule skipped.\n",
+                   r->code, r->pair);
+            continue;
+        }
+        f->axes[x].partner = (short)y;
+        f->axes[y].partner = (short)x;
+        f->lanes.stick[x] = f->lanes.stick[y] = -1;
+        f->lanes.pair[x]  = y;
+        f->lanes.pair[y]  = x;
+    }
+    return f->count;
+}
+
+/*
+ * Kernels: lane i of the output is
+ *   d   = (raw - center) / half                     deflection, 0..1+ per side
+ *   len = |d|, or |(d, d of pair)| for a stick      what the dead zone measures
+ *   m   = 0 up to inner, 1 from outer on, rescaled in between
+ *   v   = m with the sign of d, or d * m / len for a stick
+ *   out = center + round(v * half), clamped; exactly min/max at |v| >= 1
+ * Rounding is half away from zero in every kernel, so their outputs match
+ * bit for bit.
+ */
+static float rescale(float inner, float outer, float n)
+{
+    if (n <= inner) return 0.0f;
+    if (n >= outer) return 1.0f;
+    return (n - inner) / (outer - inner);
+}
+
+static __s32 roundAway(float x)
+{
+    return (__s32)(x + copysignf(0.5f, x));
+}
+
+static void gatherPartners(struct GpFilterLanes* l, int n)
+{
+    for (int i = 0; i < n; i++) l->other[i] = l->defl[l->pair[i]];
+}
+
+static void kernelScalar(struct GpFilterLanes* l, int n)
+{
+    for (int i = 0; i < n; i++) l->defl[i] = (float)(l->raw[i] - l->center[i]) / (float)l->half[i];
+    gatherPartners(l, n);
+
+    for (int i = 0; i < n; i++) {
+        float d = l->defl[i], o = l->other[i];
+        float len = l->stick[i] ? sqrtf(d * d + o * o) : fabsf(d);
+        float m = rescale(l->inner[i], l->outer[i], len);
+        float v;
+        if (l->stick[i]) v = len > 0.0f ? d * (m / len) : 0.0f;
+        else             v = d < 0.0f ? -m : m;
+
+        __s32 out;
+        if (v >= 1.0f)       out = l->max[i];
+        else if (v <= -1.0f) out = l->min[i];
+        else {
+            out = l->center[i] + roundAway(v * (float)l->half[i]);
+            if (out < l->min[i]) out = l->min[i];
+            if (out > l->max[i]) out = l->max[i];
+        }
+        l->cand[i] = out;
+    }
+}
+
+#if FILTER_SSE2
+static inline __m128 selectPs(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128i selectEpi32(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void kernelSimd(struct GpFilterLanes* l, int n)
+{
+    for (int i = 0; i < n; i += 4) {
+        __m128i delta = _mm_sub_epi32(_mm_load_si128((const __m128i*)&l->raw[i]),
+                                      _mm_load_si128((const __m128i*)&l->center[i]));
+        __m128  half  = _mm_cvtepi32_ps(_mm_load_si128((const __m128i*)&l->half[i]));
+        _mm_store_ps(&l->defl[i], _mm_div_ps(_mm_cvtepi32_ps(delta), half));
+    }
+    gatherPartners(l, n);
+
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 one  = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < n; i += 4) {
+        __m128 d     = _mm_load_ps(&l->defl[i]);
+        __m128 o     = _mm_load_ps(&l->other[i]);
+        __m128 inner = _mm_load_ps(&l->inner[i]);
+        __m128 outer = _mm_load_ps(&l->outer[i]);
+        __m128 stick = _mm_castsi128_ps(_mm_load_si128((const __m128i*)&l->stick[i]));
+
+        __m128 radial = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(d, d), _mm_mul_ps(o, o)));
+        __m128 len    = selectPs(stick, radial, _mm_andnot_ps(sign, d));
+
+        __m128 m = _mm_div_ps(_mm_sub_ps(len, inner), _mm_sub_ps(outer, inner));
+        m = selectPs(_mm_cmpge_ps(len, outer), one, m);
+        m = selectPs(_mm_cmple_ps(len, inner), zero, m);
+
+        __m128 vStick  = _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_mul_ps(d, _mm_div_ps(m, len)));
+        __m128 vSingle = _mm_or_ps(m, _mm_and_ps(d, sign));
+        __m128 v       = selectPs(stick, vStick, vSingle);
+
+        __m128i center = _mm_load_si128((const __m128i*)&l->center[i]);
+        __m128i min    = _mm_load_si128((const __m128i*)&l->min[i]);
+        __m128i max    = _mm_load_si128((const __m128i*)&l->max[i]);
+        __m128  scaled = _mm_mul_ps(v, _mm_cvtepi32_ps(_mm_load_si128((const __m128i*)&l->half[i])));
+        __m128  bias   = _mm_or_ps(_mm_set1_ps(0.5f), _mm_and_ps(scaled, sign));
+        __m128i out    = _mm_add_epi32(center, _mm_cvttps_epi32(_mm_add_ps(scaled, bias)));
+        out = selectEpi32(_mm_cmplt_epi32(out, min), min, out);
+        out = selectEpi32(_mm_cmpgt_epi32(out, max), max, out);
+        out = selectEpi32(_mm_castps_si128(_mm_cmpge_ps(v, one)), max, out);
+        out = selectEpi32(_mm_castps_si128(_mm_cmple_ps(v, _mm_set1_ps(-1.0f))), min, out);
+        _mm_store_si128((__m128i*)&l->cand[i], out);
+    }
+}
+#elif FILTER_NEON
+static void kernelSimd(struct GpFilterLanes* l, int n)
+{
+    for (int i = 0; i < n; i += 4) {
+        int32x4_t delta = vsubq_s32(vld1q_s32(&l->raw[i]), vld1q_s32(&l->center[i]));
+        vst1q_f32(&l->defl[i], vdivq_f32(vcvtq_f32_s32(delta), vcvtq_f32_s32(vld1q_s32(&l->half[i]))));
+    }
+    gatherPartners(l, n);
+
+    const float32x4_t one  = vdupq_n_f32(1.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const uint32x4_t  sign = vdupq_n_u32(0x80000000u);
+    for (int i = 0; i < n; i += 4) {
+        float32x4_t d     = vld1q_f32(&l->defl[i]);
+        float32x4_t o     = vld1q_f32(&l->other[i]);
+        float32x4_t inner = vld1q_f32(&l->inner[i]);
+        float32x4_t outer = vld1q_f32(&l->outer[i]);
+        uint32x4_t  stick = vreinterpretq_u32_s32(vld1q_s32(&l->stick[i]));
+
+        float32x4_t radial = vsqrtq_f32(vaddq_f32(vmulq_f32(d, d), vmulq_f32(o, o)));
+        float32x4_t len    = vbslq_f32(stick, radial, vabsq_f32(d));
+
+        float32x4_t m = vdivq_f32(vsubq_f32(len, inner), vsubq_f32(outer, inner));
+        m = vbslq_f32(vcgeq_f32(len, outer), one, m);
+        m = vbslq_f32(vcleq_f32(len, inner), zero, m);
+
+        float32x4_t vStick  = vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(len, zero),
+                                  vreinterpretq_u32_f32(vmulq_f32(d, vdivq_f32(m, len)))));
+        float32x4_t vSingle = vbslq_f32(sign, d, m);
+        float32x4_t v       = vbslq_f32(stick, vStick, vSingle);
+
+        int32x4_t   min    = vld1q_s32(&l->min[i]);
+        int32x4_t   max    = vld1q_s32(&l->max[i]);
+        float32x4_t scaled = vmulq_f32(v, vcvtq_f32_s32(vld1q_s32(&l->half[i])));
+        float32x4_t bias   = vbslq_f32(sign, scaled, vdupq_n_f32(0.5f));
+        int32x4_t   out    = vaddq_s32(vld1q_s32(&l->center[i]), vcvtq_s32_f32(vaddq_f32(scaled, bias)));
+        out = vminq_s32(vmaxq_s32(out, min), max);
+        out = vbslq_s32(vcgeq_f32(v, one), max, out);
+        out = vbslq_s32(vcleq_f32(v, vdupq_n_f32(-1.0f)), min, out);
+        vst1q_s32(&l->cand[i], out);
+    }
+}
+#endif
+
+#if FILTER_SSE2 || FILTER_NEON
+static int g_useSimd = 1;
+#endif
+
+int gp_filter_use_simd(int on)
+{
+#if FILTER_SSE2 || FILTER_NEON
+    g_useSimd = on ? 1 : 0;
+    return 0;
+#else
+    return on ? -1 : 0;
+#endif
+}
+
+const char* gp_filter_kernel(void)
+{
+#if FILTER_SSE2
+    if (g_useSimd) return "sse2";
+#elif FILTER_NEON
+    if (g_useSimd) return "neon";
+#endif
+    return "scalar";
+}
+
+/* At rest or fully deflected: always emitted, hysteresis or not. */
+static int isAnchor(const struct GpFilterLanes* l, int i, __s32 v)
+{
+    return v == l->center[i] || v == l->min[i] || v == l->max[i];
+}
+
+static void emit(struct GpFilterAxis* a, __s32 v, struct GpFilterOut* out, int* n)
+{
+    if (v == a->out) return;
+    a->out = v;
+    out[*n].code  = a->code;
+    out[*n].value = v;
+    (*n)++;
+}
+
+int gp_filter_frame(struct GpFilter* f, struct GpFilterOut* out)
+{
+    int n = 0;
+    unsigned int dirty = f->dirty;
+    struct GpFilterLanes* l = &f->lanes;
+    f->dirty = 0;
+
+    /* Every lane in one pass; only the dirty ones are looked at below. */
+#if FILTER_SSE2 || FILTER_NEON
+    if (g_useSimd && f->count >= GP_FILTER_SIMD_MIN_AXES) kernelSimd(l, (f->count + 3) & ~3);
+    else                                                   kernelScalar(l, f->count);
+#else
+    kernelScalar(l, f->count);
+#endif
+
+    while (dirty) {
+        int i = __builtin_ctz(dirty);
+        struct GpFilterAxis* a = &f->axes[i];
+        dirty &= ~(1u << i);
+
+        if (a->partner < 0) {
+            __s32 v = l->cand[i];
+            if (a->hysteresis > 0.0f && a->out != INT_MIN && !isAnchor(l, i, v) &&
+                fabsf((float)(v - a->out)) < a->hysteresis * (float)l->half[i]) {
+                v = a->out;
+            }
+            emit(a, v, out, &n);
+            continue;
+        }
+        /* Both stick axes go out together, once per frame. */
+        int j = a->partner;
+        dirty &= ~(1u << j);
+        int xi = j > i ? i : j;
+        int yi = j > i ? j : i;
+        struct GpFilterAxis* x = &f->axes[xi];
+        struct GpFilterAxis* y = &f->axes[yi];
+        __s32 cx = l->cand[xi], cy = l->cand[yi];
+
+        if (x->hysteresis > 0.0f && x->out != INT_MIN && y->out != INT_MIN &&
+            !(isAnchor(l, xi, cx) && isAnchor(l, yi, cy))) {
+            float mx = (float)(cx - x->out) / (float)l->half[xi];
+            float my = (float)(cy - y->out) / (float)l->half[yi];
+            if (sqrtf(mx * mx + my * my) < x->hysteresis) {
+                cx = x->out;
+                cy = y->out;
+            }
+        }
+        emit(x, cx, out, &n);
+        emit(y, cy, out, &n);
+    }
+    return n;
+}
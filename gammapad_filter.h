@@ -0,0 +1,142 @@
+#ifndef GAMMAPAD_FILTER_H
+#define GAMMAPAD_FILTER_H
+
+#include "gammapad.h"
+#include <linux/input.h>
+
+/*
+ * gammapad_filter.h
+ *
+ * Axis conditioning between remap and the pad write: dead zones,
+ * hysteresis and suppression of unchanged values, so a stick resting on a
+ * noisy ADC stops producing frames.
+ *
+ * Rules come from the device's profile (gammapad_profile.h):
+ *     filter <sc> [inner=P] [outer=P] [hysteresis=P] [trigger]
+ *     stick <scX> <scY> [inner=P] [outer=P] [hysteresis=P]
+ * P is a percentage (decimals allowed) of the axis' half range, center to
+ * edge; 'trigger' axes rest at their minimum, so for them it is of the
+ * full range.
+ *   inner      => deflection up to inner reads as rest
+ *   outer      => deflection from outer on reads as full; in between is
+ *                 rescaled, so the output still covers the whole range
+ *   hysteresis => an output is only emitted once it is this far from the
+ *                 last one emitted (rest and full deflection always are)
+ * 'stick' measures inner/outer/hysteresis on the length of the (X, Y)
+ * vector: a radial dead zone, which does not snap diagonals to the axes.
+ *
+ * Filtered axes are held until the device's SYN_REPORT, run through
+ * their rule once per frame, and reach the pad frame only when the output
+ * differs from the last value emitted. Axes without a rule, and axes
+ * routed to keys, are not touched. Values stay in the axis' units (the
+ * canonical ones once calibrated, gammapad_calib.h), so the filter does
+ * not change the pad's absinfo.
+ *
+ * The per-frame pass is batched: the rule parameters live in SoA lanes,
+ * one per filtered axis, and one kernel runs every lane of the device at
+ * once. From GP_FILTER_SIMD_MIN_AXES axes on it goes four lanes at a time
+ * (SSE2 on x86-64, NEON on arm64); below that, moving one stick's values
+ * into vectors costs more than it saves, so the scalar kernel runs. Both
+ * give bit-identical results. Build with -DGAMMAPAD_SIMD=0 (make SIMD=0)
+ * for the scalar kernel only; gp_filter_use_simd() switches at run time
+ * (gammapad_microbench times the two; make check, or --check on the
+ * device, checks they agree).
+ */
+
+#ifndef GAMMAPAD_SIMD
+#define GAMMAPAD_SIMD 1
+#endif
+
+#define GP_FILTER_MAX_RULES 16      /* per profile                */
+#define GP_FILTER_MAX_AXES  16      /* per device, multiple of 4  */
+#define GP_FILTER_NO_PAIR   0xFFFF
+#define GP_FILTER_SIMD_MIN_AXES 8   /* fewer filtered axes => scalar kernel */
+
+struct GpFilterRule {
+    __u16 code;
+    __u16 pair;             /* Y axis of a 'stick', else GP_FILTER_NO_PAIR */
+    float inner;            /* fractions of the half range, 0..1 */
+    float outer;
+    float hysteresis;
+    int   trigger;          /* rests at the minimum (never for a stick) */
+};
+
+struct GpFilterAxis {
+    __u16 code;
+    short partner;          /* lane of the other stick axis, or -1 */
+    float hysteresis;
+    __s32 out;              /* last value emitted, INT_MIN => none yet */
+};
+
+/* Kernel inputs and output, lane i <=> axes[i]; unused lanes stay inert. */
+struct GpFilterLanes {
+    __s32 raw[GP_FILTER_MAX_AXES];      /* latest value from the device */
+    __s32 center[GP_FILTER_MAX_AXES];   /* rest value */
+    __s32 half[GP_FILTER_MAX_AXES];     /* rest to edge, > 0 */
+    __s32 min[GP_FILTER_MAX_AXES];
+    __s32 max[GP_FILTER_MAX_AXES];
+    float inner[GP_FILTER_MAX_AXES];
+    float outer[GP_FILTER_MAX_AXES];
+    __s32 stick[GP_FILTER_MAX_AXES];    /* -1 => radial with lane pair[i], 0 => alone */
+    __s32 pair[GP_FILTER_MAX_AXES];
+    float defl[GP_FILTER_MAX_AXES];     /* scratch: deflection, own and partner's */
+    float other[GP_FILTER_MAX_AXES];
+    __s32 cand[GP_FILTER_MAX_AXES];     /* output before hysteresis */
+} __attribute__((aligned(16)));
+
+struct GpFilter {
+    int count;
+    unsigned int dirty;                 /* bit per axis: raw changed this frame */
+    struct GpFilterAxis axes[GP_FILTER_MAX_AXES];
+    struct GpFilterLanes lanes;
+    signed char slot[ABS_MAX + 1];      /* code => index in axes, -1 => unfiltered */
+};
+
+struct GpFilterOut {
+    __u16 code;
+    __s32 value;
+};
+
+/* Add or replace the rule for rule->code (and its pair). Returns 0, or -1 when full. */
+int  gp_filter_rule_set(struct GpFilterRule* rules, int* count, const struct GpFilterRule* rule);
+
+/*
+ * gp_filter_build => the device's filter from the profile rules and the
+ * discovered ranges; rules for axes the device lacks are skipped.
+ * Returns the number of filtered axes.
+ */
+int  gp_filter_build(struct GpFilter* f, const struct GpFilterRule* rules, int ruleCount,
+                     const int* absMin, const int* absMax);
+
+/* Event path: 1 => the value is held for gp_filter_frame(), 0 => not filtered. */
+static inline int gp_filter_hold(struct GpFilter* f, unsigned int code, __s32 value)
+{
+    if (!f->count || code > ABS_MAX || f->slot[code] < 0) return 0;
+    f->lanes.raw[(int)f->slot[code]] = value;
+    f->dirty |= 1u << f->slot[code];
+    return 1;
+}
+
+/*
+ * gp_filter_frame => at SYN_REPORT: run every held axis through its rule.
+ * Fills 'out' (GP_FILTER_MAX_AXES entries) with the outputs that changed
+ * and returns how many.
+ */
+int  gp_filter_frame(struct GpFilter* f, struct GpFilterOut* out);
+
+/*
+ * gp_filter_use_simd => pick the SIMD kernel (on != 0) or the scalar one.
+ * Returns 0, or -1 if this build has no SIMD kernel (scalar stays).
+ * gp_filter_kernel => "sse2", "neon" or "scalar": the kernel that runs
+ * for devices with GP_FILTER_SIMD_MIN_AXES filtered axes or more.
+ */
+int         gp_filter_use_simd(int on);
+const char* gp_filter_kernel(void);
+
+/* The frame was discarded (SYN_DROPPED): forget what was held. */
+static inline void gp_filter_drop(struct GpFilter* f)
+{
+    f->dirty = 0;
+}
+
+#endif /* GAMMAPAD_FILTER_H */
@@ -0,0 +1,498 @@
+/*****************************************************
+ * gammapad_haptics.c
+ *
+ * Haptics worker: command ring + vibrator rendering.
+ * See gammapad_haptics.h.
+ *****************************************************/
+
+#define _GNU_SOURCE  /* ppoll */
+#include "gammapad.h"
+#include "gammapad_haptics.h"
+#include "gammapad_trace.h"
+#include <stdatomic.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <math.h>
+
+enum GpHapticsOp {
+    GP_HAPTICS_PLAY = 1,
+    GP_HAPTICS_UPDATE,
+    GP_HAPTICS_STOP,
+    GP_HAPTICS_GAIN,
+    GP_HAPTICS_AUTOCENTER,
+    GP_HAPTICS_QUIT
+};
+
+struct GpHapticsCmd {
+    int          op;
+    int          kid;
+    int          value;          /* repeat count, gain or autocenter */
+    struct GpFfParams params;
+    unsigned long long traceNs;  /* gammapad_trace: when it was queued */
+};
+
+/*
+ * SPSC ring: the main thread only writes 'head', the worker only writes
+ * 'tail'. Release/acquire on the indices publishes the slot contents.
+ */
+static struct GpHapticsCmd g_queue[GP_HAPTICS_QUEUE_SIZE];
+static _Atomic unsigned int g_head;
+static _Atomic unsigned int g_tail;
+static atomic_ulong g_dropped;
+static atomic_ulong g_applied;   /* worker only: commands taken off the ring */
+static atomic_ulong g_kicks;     /* worker only: motor pulses written        */
+
+#define GP_VIB_LUT_SIZE 257   /* level >> 8, plus the end point */
+
+struct GpVibMotor {
+    int  present;
+    int  fd;
+    char path[256];        /* node that takes the "1"/"0" writes */
+    char durPath[256];     /* leds: run time of one kick */
+    unsigned short lut[GP_VIB_LUT_SIZE];  /* channel level => output level */
+
+    /* Worker-side state. */
+    unsigned int level;    /* last output level, 0 => motor off */
+    unsigned long long nextPulseNs;
+};
+
+static int       g_wakeFd = -1;
+static int       g_vibKind = GP_VIB_TIMED_OUTPUT;
+static struct GpVibMotor g_motors[GP_FF_CHANNELS];
+static pthread_t g_thread;
+static int       g_running = 0;
+static int       g_mixMode = GP_FF_MIX_SUM;
+
+/* Worker-side state. */
+static unsigned long long g_tracePlayNs;   /* last traced play, until its first kick */
+
+struct GpHapticsPlay {
+    struct GpFfMixer mix;
+};
+
+static int enqueue(int op, int kid, int value, const struct GpFfParams* params)
+{
+    if (!g_running) return -1;
+
+    unsigned int head = atomic_load_explicit(&g_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&g_tail, memory_order_acquire);
+    if (head - tail >= GP_HAPTICS_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+        LOG_FF("[FF] haptics queue full, dropping op=%d kid=%d\n", op, kid);
+        return -1;
+    }
+
+    struct GpHapticsCmd* c = &g_queue[head & (GP_HAPTICS_QUEUE_SIZE - 1)];
+    c->op    = op;
+    c->kid   = kid;
+    c->value = value;
+    if (params) c->params = *params;
+    else        memset(&c->params, 0, sizeof(c->params));
+    c->traceNs = GP_TRACE_ON() ? getMonotonicNs() : 0;
+    atomic_store_explicit(&g_head, head + 1, memory_order_release);
+
+    uint64_t one = 1;
+    if (write(g_wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_FF("[FF] haptics doorbell => %s\n", strerror(errno));
+    }
+    return 0;
+}
+
+int gp_haptics_play(int kid, const struct GpFfParams* p, int repeat)
+{
+    return enqueue(GP_HAPTICS_PLAY, kid, repeat, p);
+}
+
+int gp_haptics_update(int kid, const struct GpFfParams* p)
+{
+    return enqueue(GP_HAPTICS_UPDATE, kid, 0, p);
+}
+
+int gp_haptics_stop_effect(int kid)
+{
+    return enqueue(GP_HAPTICS_STOP, kid, 0, NULL);
+}
+
+int gp_haptics_set_gain(unsigned int gain)
+{
+    return enqueue(GP_HAPTICS_GAIN, -1, (int)gain, NULL);
+}
+
+int gp_haptics_set_autocenter(unsigned int autocenter)
+{
+    return enqueue(GP_HAPTICS_AUTOCENTER, -1, (int)autocenter, NULL);
+}
+
+unsigned long gp_haptics_dropped(void)
+{
+    return atomic_load_explicit(&g_dropped, memory_order_relaxed);
+}
+
+unsigned long gp_haptics_applied(void)
+{
+    return atomic_load_explicit(&g_applied, memory_order_relaxed);
+}
+
+unsigned long gp_haptics_kicks(void)
+{
+    return atomic_load_explicit(&g_kicks, memory_order_relaxed);
+}
+
+/*
+ * vibOpen => open the node the pulses go to. leds-vibrator keeps the run
+ * time in a separate attribute, so it is set once here rather than on
+ * every kick.
+ */
+static int vibOpen(struct GpVibMotor* m)
+{
+    /* O_NONBLOCK: a FIFO stand-in (rumbletest --bench) must not stall us. */
+    m->fd = open(m->path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (m->fd < 0) return -1;
+
+    if (g_vibKind == GP_VIB_LEDS) {
+        int fd = open(m->durPath, O_WRONLY | O_CLOEXEC);
+        char buf[16];
+        int n = snprintf(buf, sizeof(buf), "%d\n", GP_VIB_KICK_MS);
+        if (fd < 0 || pwrite(fd, buf, n, 0) < 0) {
+            LOG_FF("[FF] vibrator duration '%s' => %s\n", m->durPath, strerror(errno));
+        }
+        if (fd >= 0) close(fd);
+    }
+    return 0;
+}
+
+/*
+ * vibWrite => keep the node open and pwrite() at offset 0 (sysfs
+ * attributes want each value written from the start; FIFOs take a plain
+ * write). Reopens lazily if the node was missing.
+ */
+static void vibWrite(struct GpVibMotor* m, const char* val)
+{
+    if (m->fd < 0 && vibOpen(m) < 0) return;
+    ssize_t n = pwrite(m->fd, val, strlen(val), 0);
+    if (n < 0 && errno == ESPIPE) n = write(m->fd, val, strlen(val));
+    if (n < 0) {
+        LOG_FF("[FF] vibrator write '%s' => %s\n", m->path, strerror(errno));
+        close(m->fd);
+        m->fd = -1;
+    }
+}
+
+/*
+ * buildLut => the motor's response curve, sampled every 256 levels.
+ */
+static void buildLut(struct GpVibMotor* m, const struct GpVibMotorConfig* mc)
+{
+    double scale = (mc->scalePct > 100 ? 100 : mc->scalePct) / 100.0;
+    double curve = mc->curve > 0.0 ? mc->curve : 1.0;
+    unsigned int lo = mc->minLevel > 0xffff ? 0xffff : mc->minLevel;
+
+    m->lut[0] = 0;
+    for (int i = 1; i < GP_VIB_LUT_SIZE; i++) {
+        double x = (i * 256.0 > 65535.0 ? 65535.0 : i * 256.0) / 65535.0;
+        double y = scale * pow(x, curve);
+        m->lut[i] = (unsigned short)(y > 0.0 ? lo + (0xffff - lo) * y : 0);
+    }
+}
+
+/* mapLevel => interpolate between the two neighbouring table entries. */
+static unsigned int mapLevel(const struct GpVibMotor* m, unsigned int level)
+{
+    if (!level) return 0;
+    unsigned int i = level >> 8, f = level & 0xff;
+    unsigned int a = i ? m->lut[i] : m->lut[1];  /* never below min once on */
+    return a + (((int)m->lut[i + 1] - (int)a) * (int)f) / 256;
+}
+
+/*
+ * Pulse period per output level (level >> 8): the original ON->sleep->OFF
+ * toggle, 150 ms .. 10 ms (stronger => denser pulses). Built once, so the
+ * tick only indexes it.
+ */
+static unsigned int g_periodUs[256];
+
+static void buildPeriods(void)
+{
+    for (int i = 0; i < 256; i++) {
+        long long us = 150000 - (400000LL * (i << 8)) / 65535;
+        g_periodUs[i] = (unsigned int)(us < 10000 ? 10000 : us);
+    }
+}
+
+static unsigned long long pulsePeriodNs(unsigned int level)
+{
+    return g_periodUs[(level >> 8) & 0xff] * 1000ULL;
+}
+
+/*
+ * applyCommands => drain the ring into the mixer. Returns 1 on QUIT.
+ */
+static int applyCommands(struct GpHapticsPlay* p)
+{
+    unsigned int tail = atomic_load_explicit(&g_tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&g_head, memory_order_acquire);
+    int quit = 0;
+
+    while (tail != head) {
+        struct GpHapticsCmd c = g_queue[tail & (GP_HAPTICS_QUEUE_SIZE - 1)];
+        tail++;
+        atomic_store_explicit(&g_applied, atomic_load_explicit(&g_applied, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+
+        switch (c.op) {
+        case GP_HAPTICS_PLAY:
+            LOG_FF("[FF-Worker] play kid=%d mag=%u/%u dur=%u ms delay=%u ms x%d\n",
+                   c.kid, c.params.magnitude[GP_FF_STRONG], c.params.magnitude[GP_FF_WEAK],
+                   c.params.durationMs, c.params.delayMs, c.value);
+            gp_ffmix_play(&p->mix, c.kid, &c.params, c.value, getMonotonicNs());
+            if (GP_TRACE_ON() && c.traceNs) {
+                g_tracePlayNs = getMonotonicNs();
+                gp_trace_span(GP_TR_FF_QUEUE, c.traceNs, g_tracePlayNs);
+            }
+            break;
+        case GP_HAPTICS_UPDATE:
+            gp_ffmix_update(&p->mix, c.kid, &c.params);
+            break;
+        case GP_HAPTICS_STOP:
+            LOG_FF("[FF-Worker] stop kid=%d\n", c.kid);
+            gp_ffmix_stop(&p->mix, c.kid);
+            break;
+        case GP_HAPTICS_GAIN:
+            gp_ffmix_set_gain(&p->mix, (unsigned int)c.value);
+            break;
+        case GP_HAPTICS_AUTOCENTER:
+            gp_ffmix_set_autocenter(&p->mix, (unsigned int)c.value);
+            break;
+        case GP_HAPTICS_QUIT:
+            quit = 1;
+            break;
+        default:
+            break;
+        }
+    }
+    atomic_store_explicit(&g_tail, tail, memory_order_release);
+    return quit;
+}
+
+/*
+ * renderMotor => kick one motor if a pulse is due. Returns when it next
+ * needs a tick (0 => off).
+ */
+static unsigned long long renderMotor(struct GpVibMotor* m, unsigned int level,
+                                      unsigned long long now)
+{
+    if (!level) {
+        if (m->level) vibWrite(m, "0\n");
+        m->level = 0;
+        return 0;
+    }
+    if (!m->level) {
+        vibWrite(m, "0\n");  /* clear leftovers from before we owned it */
+        m->nextPulseNs = now;
+    }
+    m->level = level;
+
+    if (now >= m->nextPulseNs) {
+        vibWrite(m, "1\n");
+        atomic_store_explicit(&g_kicks, atomic_load_explicit(&g_kicks, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        if (GP_TRACE_ON() && g_tracePlayNs) {
+            gp_trace_span(GP_TR_FF_PLAY, g_tracePlayNs, getMonotonicNs());
+            g_tracePlayNs = 0;
+        }
+        m->nextPulseNs = now + pulsePeriodNs(level);
+    }
+    return m->nextPulseNs;
+}
+
+/*
+ * render => one tick: mix both channels, then drive every motor.
+ * Returns the next time the worker must wake up (0 => only on a command).
+ */
+static unsigned long long render(struct GpHapticsPlay* p, unsigned long long now)
+{
+    unsigned long long next = 0;
+    unsigned int level[GP_FF_CHANNELS];
+    gp_ffmix_level(&p->mix, now, level, &next);
+
+    /* A single motor plays whichever channel is louder. */
+    if (!g_motors[GP_FF_WEAK].present) {
+        if (level[GP_FF_WEAK] > level[GP_FF_STRONG]) level[GP_FF_STRONG] = level[GP_FF_WEAK];
+    }
+    for (int c = 0; c < GP_FF_CHANNELS; c++) {
+        struct GpVibMotor* m = &g_motors[c];
+        if (!m->present) continue;
+        unsigned long long t = renderMotor(m, mapLevel(m, level[c]), now);
+        if (t && (!next || t < next)) next = t;
+    }
+    return next;
+}
+
+static void* hapticsThread(void* arg)
+{
+    (void)arg;
+    static struct GpHapticsPlay play;
+    struct pollfd pfd = { g_wakeFd, POLLIN, 0 };
+
+    memset(&play, 0, sizeof(play));
+    gp_ffmix_init(&play.mix, g_mixMode);
+    unsigned long long wake = 0;
+
+    for (;;) {
+        struct timespec ts, *tsp = NULL;
+        if (wake) {
+            unsigned long long now = getMonotonicNs();
+            unsigned long long wait = wake > now ? wake - now : 0;
+            ts.tv_sec  = (time_t)(wait / 1000000000ULL);
+            ts.tv_nsec = (long)(wait % 1000000000ULL);
+            tsp = &ts;
+        }
+
+        if (ppoll(&pfd, 1, tsp, NULL) > 0 && (pfd.revents & POLLIN)) {
+            uint64_t n;
+            while (read(g_wakeFd, &n, sizeof(n)) > 0) { }
+        }
+        if (applyCommands(&play)) break;
+        wake = render(&play, getMonotonicNs());
+    }
+
+    for (int c = 0; c < GP_FF_CHANNELS; c++) {
+        if (g_motors[c].present && g_motors[c].level) vibWrite(&g_motors[c], "0\n");
+    }
+    return NULL;
+}
+
+void gp_haptics_config_default(struct GpHapticsConfig* cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->kind = GP_VIB_TIMED_OUTPUT;
+    for (int c = 0; c < GP_FF_CHANNELS; c++) {
+        cfg->motor[c].scalePct = 100;
+        cfg->motor[c].curve    = 1.0;
+    }
+}
+
+int gp_haptics_config_tune(struct GpHapticsConfig* cfg, const char* spec)
+{
+    struct GpVibMotorConfig* mc;
+    if (!strncmp(spec, "strong:", 7))    mc = &cfg->motor[GP_FF_STRONG];
+    else if (!strncmp(spec, "weak:", 5)) mc = &cfg->motor[GP_FF_WEAK];
+    else return -1;
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", strchr(spec, ':') + 1);
+    for (char* save = NULL, *kv = strtok_r(buf, ",", &save); kv; kv = strtok_r(NULL, ",", &save)) {
+        char* eq = strchr(kv, '=');
+        char* end = NULL;
+        if (!eq) return -1;
+        *eq++ = 0;
+        if (!strcmp(kv, "scale"))      mc->scalePct = (unsigned int)strtoul(eq, &end, 10);
+        else if (!strcmp(kv, "curve")) mc->curve    = strtod(eq, &end);
+        else if (!strcmp(kv, "min"))   mc->minLevel = (unsigned int)strtoul(eq, &end, 0);
+        else return -1;
+        if (end == eq || *end) return -1;
+    }
+    return 0;
+}
+
+/*
+ * setupMotor => resolve the node(s) of motor c. Motor 0 always exists
+ * (default path if none given); motor 1 only with an explicit path.
+ */
+static int setupMotor(int c, const struct GpVibMotorConfig* mc)
+{
+    struct GpVibMotor* m = &g_motors[c];
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+
+    const char* path = mc->path;
+    if (!path) {
+        if (c != GP_FF_STRONG) return 0;
+        path = g_vibKind == GP_VIB_LEDS ? GP_VIB_LEDS_PATH : GP_VIB_TIMED_OUTPUT_PATH;
+    }
+    if (g_vibKind == GP_VIB_LEDS) {
+        if (snprintf(m->path, sizeof(m->path), "%s/activate", path) >= (int)sizeof(m->path) ||
+            snprintf(m->durPath, sizeof(m->durPath), "%s/duration", path) >= (int)sizeof(m->durPath)) {
+            LOG_FF("[FF] vibrator path '%s' too long\n", path);
+            return -1;
+        }
+    } else {
+        snprintf(m->path, sizeof(m->path), "%s", path);
+    }
+    m->present = 1;
+    buildLut(m, mc);
+
+    if (vibOpen(m) < 0) {
+        LOG_FF("[FF] vibrator '%s' => %s (will retry on play)\n", m->path, strerror(errno));
+    }
+    return 0;
+}
+
+static void closeMotors(void)
+{
+    for (int c = 0; c < GP_FF_CHANNELS; c++) {
+        if (g_motors[c].fd >= 0) close(g_motors[c].fd);
+        g_motors[c].fd = -1;
+    }
+}
+
+int gp_haptics_start(const struct GpHapticsConfig* cfg)
+{
+    if (g_running) return 0;
+
+    struct GpHapticsConfig def;
+    if (!cfg) {
+        gp_haptics_config_default(&def);
+        cfg = &def;
+    }
+
+    const char* mode = getenv("GAMMAPAD_FF_MIX");
+    g_mixMode = (mode && !strcasecmp(mode, "max")) ? GP_FF_MIX_MAX : GP_FF_MIX_SUM;
+
+    g_vibKind = cfg->kind;
+    buildPeriods();
+    for (int c = 0; c < GP_FF_CHANNELS; c++) {
+        if (setupMotor(c, &cfg->motor[c]) < 0) return -1;
+    }
+
+    g_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wakeFd < 0) {
+        LOG_FF("[FF] haptics eventfd => %s\n", strerror(errno));
+        return -1;
+    }
+    atomic_store(&g_head, 0);
+    atomic_store(&g_tail, 0);
+
+    /* The worker must not take SIGINT meant for the main loop. */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    g_running = 1;
+    int rc = pthread_create(&g_thread, NULL, hapticsThread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        LOG_FF("[FF] haptics thread => %s\n", strerror(rc));
+        g_running = 0;
+        close(g_wakeFd);
+        g_wakeFd = -1;
+        closeMotors();
+        return -1;
+    }
+    return 0;
+}
+
+void gp_haptics_stop(void)
+{
+    if (!g_running) return;
+    while (enqueue(GP_HAPTICS_QUIT, -1, 0, NULL) < 0) {
+        msleep(1);  /* ring full => the worker is draining it */
+    }
+    pthread_join(g_thread, NULL);
+    g_running = 0;
+
+    close(g_wakeFd);
+    g_wakeFd = -1;
+    closeMotors();
+}
@@ -0,0 +1,96 @@
+#ifndef GAMMAPAD_HAPTICS_H
+#define GAMMAPAD_HAPTICS_H
+
+#include "gammapad_ffmix.h"
+
+/*
+ * gammapad_haptics.h
+ *
+ * One long-lived haptics worker thread that owns the vibrator.
+ *
+ * The main loop feeds it play/stop/update commands through a bounded
+ * single-producer/single-consumer ring (no locks, no allocation) and an
+ * eventfd doorbell. The worker keeps the vibrator node open, mixes the
+ * scheduled effects (gammapad_ffmix) and renders the mixed level as a
+ * pulse train with pwrite(): every pulse is a GP_VIB_KICK_MS kick, and the
+ * pulse period encodes the level. Both motors of a dual-motor device are
+ * rendered from the same tick. $GAMMAPAD_FF_MIX=max selects max
+ * instead of sum mixing.
+ *
+ * Commands are picked up as soon as the doorbell rings, so a stop halts
+ * the motor immediately rather than at the end of the effect.
+ *
+ * Producer side (everything but gp_haptics_start/stop) is main-thread only.
+ */
+
+#define GP_HAPTICS_QUEUE_SIZE  64   /* power of two */
+
+/*
+ * Motor interfaces:
+ *   timed_output => writing N to 'enable' runs the motor for N ms
+ *   leds         => leds-vibrator (transient trigger): 'duration' holds the
+ *                   run time, writing 1 to 'activate' starts it
+ * Paths may point at plain files (tests, or a stand-in when the sysfs
+ * node is missing); for leds the path is the directory holding both.
+ */
+enum GpVibKind {
+    GP_VIB_TIMED_OUTPUT = 0,
+    GP_VIB_LEDS
+};
+
+#define GP_VIB_TIMED_OUTPUT_PATH "/sys/class/timed_output/vibrator/enable"
+#define GP_VIB_LEDS_PATH         "/sys/class/leds/vibrator"
+#define GP_VIB_KICK_MS           1    /* one pulse of the pulse train */
+
+/*
+ * One motor per mixer channel: GP_FF_STRONG drives motor 0, GP_FF_WEAK
+ * motor 1. With no path for motor 1, motor 0 plays the louder of the two
+ * channels. Each motor maps its channel level through
+ *   out = min + (65535 - min) * scale% * (level / 65535) ^ curve
+ * (0 stays 0), precomputed into a table so the worker tick stays cheap.
+ */
+struct GpVibMotorConfig {
+    const char*  path;      /* NULL => default (motor 0) / absent (motor 1) */
+    unsigned int scalePct;  /* 0..100 */
+    double       curve;     /* exponent, 1.0 => linear */
+    unsigned int minLevel;  /* weakest level that still spins the motor */
+};
+
+struct GpHapticsConfig {
+    int kind;               /* enum GpVibKind, both motors */
+    struct GpVibMotorConfig motor[GP_FF_CHANNELS];
+};
+
+void gp_haptics_config_default(struct GpHapticsConfig* cfg);
+
+/*
+ * gp_haptics_config_tune => apply "strong:scale=50,curve=1.5,min=8000"
+ * (or weak:...) to cfg. Returns 0, or -1 if the spec is malformed.
+ */
+int  gp_haptics_config_tune(struct GpHapticsConfig* cfg, const char* spec);
+
+int  gp_haptics_start(const struct GpHapticsConfig* cfg);
+void gp_haptics_stop(void);
+
+/*
+ * Queue a command for the mixer (gammapad_ffmix). Returns 0, or -1 if the
+ * worker is not running or the queue is full (the command is dropped and
+ * counted).
+ *   play       => schedule kid 'repeat' times (EV_FF value)
+ *   update     => new parameters for kid if it is scheduled (re-upload)
+ *   stop       => stop kid; kid < 0 stops everything
+ *   gain       => FF_GAIN, 0..0xffff
+ *   autocenter => FF_AUTOCENTER, 0..0xffff
+ */
+int  gp_haptics_play(int kid, const struct GpFfParams* p, int repeat);
+int  gp_haptics_update(int kid, const struct GpFfParams* p);
+int  gp_haptics_stop_effect(int kid);
+int  gp_haptics_set_gain(unsigned int gain);
+int  gp_haptics_set_autocenter(unsigned int autocenter);
+
+/* Counters: commands dropped (queue full), applied by the worker, motor kicks. */
+unsigned long gp_haptics_dropped(void);
+unsigned long gp_haptics_applied(void);
+unsigned long gp_haptics_kicks(void);
+
+#endif /* GAMMAPAD_HAPTICS_H */
@@ -0,0 +1,274 @@
+/*****************************************************
+ * gammapad_hotplug.c
+ *
+ * inotify-based hotplug watcher + device selectors.
+ * See gammapad_hotplug.h.
+ *****************************************************/
+
+#include "gammapad_hotplug.h"
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <fnmatch.h>
+
+#define GP_HOTPLUG_PENDING 8
+
+/*
+ * A node usually appears (IN_CREATE) before udev/ueventd has fixed its
+ * permissions (IN_ATTRIB), so the first open can fail. Remember when each
+ * node first showed up, so the reattach latency covers the whole wait.
+ */
+struct GpPendingNode {
+    char name[32];
+    unsigned long long seenNs;
+};
+
+static int  g_inotifyFd = -1;
+static char g_inputDir[PATH_MAX];
+static GpHotplugCallback g_callback;
+static void* g_callbackCtx;
+static struct GpPendingNode g_pending[GP_HOTPLUG_PENDING];
+
+static struct GpDeviceSelector g_selectors[GP_MAX_SELECTORS];
+static int g_selectorCount = 0;
+
+const char* gp_hotplug_default_dir(void)
+{
+    const char* dir = getenv("GAMMAPAD_INPUT_DIR");
+    return (dir && *dir) ? dir : "/dev/input";
+}
+
+int gp_hotplug_init(const char* inputDir, GpHotplugCallback cb, void* ctx)
+{
+    if (g_inotifyFd >= 0) return g_inotifyFd;
+
+    snprintf(g_inputDir, sizeof(g_inputDir), "%s", inputDir ? inputDir : gp_hotplug_default_dir());
+    g_callback    = cb;
+    g_callbackCtx = ctx;
+    memset(g_pending, 0, sizeof(g_pending));
+
+    g_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (g_inotifyFd < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Hotplug] inotify_init1 => %s\n", strerror(errno));
+        return -1;
+    }
+    if (inotify_add_watch(g_inotifyFd, g_inputDir,
+                          IN_CREATE | IN_ATTRIB | IN_MOVED_TO | IN_DELETE) < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Hotplug] watch on '%s' => %s\n",
+            g_inputDir, strerror(errno));
+        close(g_inotifyFd);
+        g_inotifyFd = -1;
+        return -1;
+    }
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Hotplug] watching '%s'\n", g_inputDir);
+    return g_inotifyFd;
+}
+
+void gp_hotplug_shutdown(void)
+{
+    if (g_inotifyFd >= 0) close(g_inotifyFd);
+    g_inotifyFd = -1;
+}
+
+int gp_hotplug_fd(void)
+{
+    return g_inotifyFd;
+}
+
+const char* gp_hotplug_dir(void)
+{
+    return g_inputDir[0] ? g_inputDir : gp_hotplug_default_dir();
+}
+
+int gp_hotplug_probe(const char* path, struct GpNodeInfo* out)
+{
+    memset(out, 0, sizeof(*out));
+    snprintf(out->path, sizeof(out->path), "%s", path);
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    if (ioctl(fd, EVIOCGID, &out->id) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (ioctl(fd, EVIOCGNAME(sizeof(out->name) - 1), out->name) < 0) out->name[0] = 0;
+    if (ioctl(fd, EVIOCGPHYS(sizeof(out->phys) - 1), out->phys) < 0) out->phys[0] = 0;
+    close(fd);
+    return 0;
+}
+
+static int isEventNode(const char* name)
+{
+    return !strncmp(name, "event", 5) && isdigit((unsigned char)name[5]);
+}
+
+static struct GpPendingNode* pendingFind(const char* name)
+{
+    for (int i = 0; i < GP_HOTPLUG_PENDING; i++) {
+        if (g_pending[i].name[0] && !strcmp(g_pending[i].name, name)) return &g_pending[i];
+    }
+    return NULL;
+}
+
+static void pendingAdd(const char* name, unsigned long long now)
+{
+    if (pendingFind(name)) return;
+    struct GpPendingNode* slot = &g_pending[0];
+    for (int i = 0; i < GP_HOTPLUG_PENDING; i++) {
+        if (!g_pending[i].name[0]) { slot = &g_pending[i]; break; }
+        if (g_pending[i].seenNs < slot->seenNs) slot = &g_pending[i];  /* evict oldest */
+    }
+    snprintf(slot->name, sizeof(slot->name), "%s", name);
+    slot->seenNs = now;
+}
+
+/*
+ * reportNode => probe dir/name and hand it to the callback. Nodes that
+ * cannot be opened yet stay pending until their IN_ATTRIB.
+ */
+static int reportNode(const char* name, unsigned long long now)
+{
+    char path[PATH_MAX];
+    struct GpNodeInfo node;
+
+    if (snprintf(path, sizeof(path), "%s/%s", g_inputDir, name) >= (int)sizeof(path)) return 0;
+    if (gp_hotplug_probe(path, &node) < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_DEBUG, "[Hotplug] %s not ready => %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    struct GpPendingNode* p = pendingFind(name);
+    node.firstSeenNs = p ? p->seenNs : now;
+    if (p) p->name[0] = 0;
+
+    if (!strncmp(node.name, "GammaPad Virtual", 16)) return 0;  /* one of ours */
+
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_DEBUG,
+        "[Hotplug] node %s => %04x:%04x name='%s' phys='%s'\n",
+        path, node.id.vendor, node.id.product, node.name, node.phys);
+    if (g_callback) g_callback(&node, g_callbackCtx);
+    return 1;
+}
+
+void gp_hotplug_dispatch(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    if (g_inotifyFd < 0) return;
+    for (;;) {
+        ssize_t n = read(g_inotifyFd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Hotplug] read => %s\n", strerror(errno));
+            }
+            break;
+        }
+
+        unsigned long long now = getMonotonicNs();
+        for (char* p = buf; p < buf + n; ) {
+            const struct inotify_event* ie = (const struct inotify_event*)p;
+            p += sizeof(*ie) + ie->len;
+
+            if (ie->mask & IN_Q_OVERFLOW) {
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Hotplug] event queue overflow => rescanning.\n");
+                gp_hotplug_scan();
+                continue;
+            }
+            if (!ie->len || !isEventNode(ie->name)) continue;
+
+            if (ie->mask & IN_DELETE) {
+                struct GpPendingNode* pn = pendingFind(ie->name);
+                if (pn) pn->name[0] = 0;
+                continue;
+            }
+            if (ie->mask & (IN_CREATE | IN_MOVED_TO)) pendingAdd(ie->name, now);
+            reportNode(ie->name, now);
+        }
+    }
+}
+
+int gp_hotplug_scan(void)
+{
+    DIR* d = opendir(gp_hotplug_dir());
+    if (!d) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Hotplug] opendir '%s' => %s\n",
+            gp_hotplug_dir(), strerror(errno));
+        return 0;
+    }
+    if (!g_inputDir[0]) snprintf(g_inputDir, sizeof(g_inputDir), "%s", gp_hotplug_default_dir());
+
+    int count = 0;
+    unsigned long long now = getMonotonicNs();
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (isEventNode(de->d_name)) count += reportNode(de->d_name, now);
+    }
+    closedir(d);
+    return count;
+}
+
+/*
+ * Selectors
+ */
+int gp_selector_parse(struct GpDeviceSelector* sel, const char* spec)
+{
+    char buf[256];
+    memset(sel, 0, sizeof(*sel));
+    sel->vendor  = -1;
+    sel->product = -1;
+    if (!spec) return -1;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char* eq = strchr(tok, '=');
+        if (!eq) return -1;
+        *eq = 0;
+        const char* val = eq + 1;
+        char* end = NULL;
+
+        if (!strcasecmp(tok, "vendor") || !strcasecmp(tok, "product")) {
+            long v = strtol(val, &end, 16);
+            if (end == val || *end || v < 0 || v > 0xffff) return -1;
+            if (tolower((unsigned char)tok[0]) == 'v') sel->vendor = (int)v;
+            else                                       sel->product = (int)v;
+        } else if (!strcasecmp(tok, "name")) {
+            snprintf(sel->name, sizeof(sel->name), "%s", val);
+        } else if (!strcasecmp(tok, "phys")) {
+            snprintf(sel->phys, sizeof(sel->phys), "%s", val);
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int gp_selector_match(const struct GpDeviceSelector* sel, const struct GpNodeInfo* node)
+{
+    if (sel->vendor  >= 0 && sel->vendor  != node->id.vendor)  return 0;
+    if (sel->product >= 0 && sel->product != node->id.product) return 0;
+    if (sel->name[0] && fnmatch(sel->name, node->name, 0) != 0) return 0;
+    if (sel->phys[0] && fnmatch(sel->phys, node->phys, 0) != 0) return 0;
+    return 1;
+}
+
+int gp_hotplug_add_selector(const char* spec)
+{
+    if (g_selectorCount >= GP_MAX_SELECTORS) return -1;
+    if (gp_selector_parse(&g_selectors[g_selectorCount], spec) < 0) return -1;
+    g_selectorCount++;
+    return 0;
+}
+
+int gp_hotplug_selector_count(void)
+{
+    return g_selectorCount;
+}
+
+int gp_hotplug_wanted(const struct GpNodeInfo* node)
+{
+    for (int i = 0; i < g_selectorCount; i++) {
+        if (gp_selector_match(&g_selectors[i], node)) return 1;
+    }
+    return 0;
+}
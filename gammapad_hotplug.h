@@ -0,0 +1,80 @@
+#ifndef GAMMAPAD_HOTPLUG_H
+#define GAMMAPAD_HOTPLUG_H
+
+#include "gammapad.h"
+#include <linux/input.h>
+#include <limits.h>
+
+/*
+ * gammapad_hotplug.h
+ *
+ * Hotplug watcher for the main epoll loop.
+ *
+ * An inotify watch on the input directory (/dev/input, or $GAMMAPAD_INPUT_DIR,
+ * or whatever gp_hotplug_init() is given, e.g. a temp dir in tests) reports
+ * every event* node that appears or changes permissions. Each one is probed
+ * with EVIOCGID/EVIOCGNAME/EVIOCGPHYS and handed to the callback, which
+ * decides whether to capture it. Deletes are ignored: a device going away
+ * is noticed on its own fd (ENODEV/EPOLLHUP), and our own node removal
+ * after capture must not look like an unplug.
+ *
+ * Our own virtual pads also show up in the input dir; they are filtered out
+ * here so the daemon never captures itself.
+ *
+ * Main loop only, like gammapad_timer.
+ */
+
+#define GP_HOTPLUG_BUDGET_MS  100   /* reattach slower than this => warning */
+#define GP_MAX_SELECTORS      8
+
+struct GpNodeInfo {
+    char path[PATH_MAX];
+    struct input_id id;
+    char name[128];
+    char phys[64];
+    unsigned long long firstSeenNs;  /* when the node first appeared (monotonic) */
+};
+
+/*
+ * GpDeviceSelector: which nodes to capture. vendor/product < 0 => any,
+ * name/phys are fnmatch() patterns, "" => any.
+ */
+struct GpDeviceSelector {
+    int  vendor;
+    int  product;
+    char name[128];
+    char phys[64];
+};
+
+typedef void (*GpHotplugCallback)(const struct GpNodeInfo* node, void* ctx);
+
+const char* gp_hotplug_default_dir(void);
+
+/* Returns the inotify fd to add to epoll, or -1. */
+int  gp_hotplug_init(const char* inputDir, GpHotplugCallback cb, void* ctx);
+void gp_hotplug_shutdown(void);
+int  gp_hotplug_fd(void);
+const char* gp_hotplug_dir(void);
+
+/* Drain the inotify fd, probing and reporting every new node. */
+void gp_hotplug_dispatch(void);
+
+/* Report every node already in the input dir (startup). Returns the count. */
+int  gp_hotplug_scan(void);
+
+/* Fill 'out' from an evdev node. Returns 0, or -1 if it cannot be opened/queried. */
+int  gp_hotplug_probe(const char* path, struct GpNodeInfo* out);
+
+/*
+ * Selectors: "vendor=045e,product=02fd,name=Xbox*,phys=usb-*"
+ * (ids are hex, every key optional). Returns 0, or -1 on a bad spec.
+ */
+int  gp_selector_parse(struct GpDeviceSelector* sel, const char* spec);
+int  gp_selector_match(const struct GpDeviceSelector* sel, const struct GpNodeInfo* node);
+
+/* The --match selectors given on the command line. */
+int  gp_hotplug_add_selector(const char* spec);
+int  gp_hotplug_selector_count(void);
+int  gp_hotplug_wanted(const struct GpNodeInfo* node);
+
+#endif /* GAMMAPAD_HOTPLUG_H */
@@ -47,3 +47,74 @@ int gp_enable_mouse_relaxes(int fd)
     }
     return 0;
 }
+
+/*
+ * Name table for gp_code_from_name(). Covers the codes in the arrays above
+ * plus the usual gamepad aliases; anything else can be given numerically.
+ */
+struct GpCodeName {
+    int type;
+    int code;
+    const char* name;
+};
+
+#define GP_CODE(type, c) { type, c, #c }
+
+static const struct GpCodeName GAMMAPAD_CODE_NAMES[] = {
+    GP_CODE(EV_KEY, BTN_A), GP_CODE(EV_KEY, BTN_B), GP_CODE(EV_KEY, BTN_C),
+    GP_CODE(EV_KEY, BTN_X), GP_CODE(EV_KEY, BTN_Y), GP_CODE(EV_KEY, BTN_Z),
+    GP_CODE(EV_KEY, BTN_TL), GP_CODE(EV_KEY, BTN_TR),
+    GP_CODE(EV_KEY, BTN_TL2), GP_CODE(EV_KEY, BTN_TR2),
+    GP_CODE(EV_KEY, BTN_SELECT), GP_CODE(EV_KEY, BTN_START),
+    GP_CODE(EV_KEY, BTN_THUMBL), GP_CODE(EV_KEY, BTN_THUMBR),
+    GP_CODE(EV_KEY, BTN_DPAD_UP), GP_CODE(EV_KEY, BTN_DPAD_DOWN),
+    GP_CODE(EV_KEY, BTN_DPAD_LEFT), GP_CODE(EV_KEY, BTN_DPAD_RIGHT),
+    GP_CODE(EV_KEY, BTN_BACK), GP_CODE(EV_KEY, BTN_MODE),
+    GP_CODE(EV_KEY, BTN_1), GP_CODE(EV_KEY, BTN_2),
+    GP_CODE(EV_KEY, KEY_VOLUMEDOWN), GP_CODE(EV_KEY, KEY_VOLUMEUP), GP_CODE(EV_KEY, KEY_POWER),
+    GP_CODE(EV_KEY, KEY_BACK), GP_CODE(EV_KEY, KEY_HOMEPAGE), GP_CODE(EV_KEY, KEY_MENU),
+    GP_CODE(EV_ABS, ABS_X), GP_CODE(EV_ABS, ABS_Y),
+    GP_CODE(EV_ABS, ABS_Z), GP_CODE(EV_ABS, ABS_RX), GP_CODE(EV_ABS, ABS_RY), GP_CODE(EV_ABS, ABS_RZ),
+    GP_CODE(EV_ABS, ABS_GAS), GP_CODE(EV_ABS, ABS_BRAKE),
+    GP_CODE(EV_ABS, ABS_HAT0X), GP_CODE(EV_ABS, ABS_HAT0Y),
+};
+
+#undef GP_CODE
+
+/*
+ * gp_code_from_name => "BTN_A", "abs_gas", "0x130" or "304" => code.
+ * Returns -1 if the name is unknown or out of range for 'type'.
+ */
+int gp_code_from_name(int type, const char* name)
+{
+    if (!name || !*name) return -1;
+
+    int maxCode = (type == EV_ABS) ? ABS_MAX : KEY_MAX;
+    if (isdigit((unsigned char)name[0])) {
+        char* end = NULL;
+        long v = strtol(name, &end, 0);
+        if (end == name || *end || v < 0 || v > maxCode) return -1;
+        return (int)v;
+    }
+
+    size_t count = sizeof(GAMMAPAD_CODE_NAMES) / sizeof(GAMMAPAD_CODE_NAMES[0]);
+    for (size_t i = 0; i < count; i++) {
+        if (GAMMAPAD_CODE_NAMES[i].type == type &&
+            !strcasecmp(GAMMAPAD_CODE_NAMES[i].name, name)) {
+            return GAMMAPAD_CODE_NAMES[i].code;
+        }
+    }
+    return -1;
+}
+
+/* gp_code_name => "BTN_A" for a code in the table above, NULL otherwise. */
+const char* gp_code_name(int type, int code)
+{
+    size_t count = sizeof(GAMMAPAD_CODE_NAMES) / sizeof(GAMMAPAD_CODE_NAMES[0]);
+    for (size_t i = 0; i < count; i++) {
+        if (GAMMAPAD_CODE_NAMES[i].type == type && GAMMAPAD_CODE_NAMES[i].code == code) {
+            return GAMMAPAD_CODE_NAMES[i].name;
+        }
+    }
+    return NULL;
+}
@@ -43,4 +43,10 @@ int gp_enable_gamepad_abs(int fd);
 int gp_enable_mouse_buttons(int fd);
 int gp_enable_mouse_relaxes(int fd);
 
+/* Name or number => EV_KEY/EV_ABS code, -1 if unknown. */
+int gp_code_from_name(int type, const char* name);
+
+/* EV_KEY/EV_ABS code => its name (first alias in the table), NULL if unknown. */
+const char* gp_code_name(int type, int code);
+
 #endif /* GAMMAPAD_INPUTDEFS_H */
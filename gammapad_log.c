@@ -0,0 +1,610 @@
+/*****************************************************
+ * gammapad_log.c
+ *
+ * Asynchronous, levelled logging. See gammapad_log.h.
+ *****************************************************/
+
+#include "gammapad.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+/*
+ * Ring geometry. Records are fixed-size so a producer never allocates;
+ * string arguments are copied into the record's own string area. When
+ * they do not all fit, each string gets a fair share of it (short ones in
+ * full, the long ones cut to the same length), so one long path cannot
+ * blank the arguments after it.
+ */
+#define GP_LOG_RING_SIZE   512                 /* must be a power of two */
+#define GP_LOG_MAX_ARGS    8
+#define GP_LOG_STR_BYTES   384
+#define GP_LOG_LINE_MAX    512
+
+/* Idle policy for the writer thread: linger briefly, then block until signalled. */
+#define GP_LOG_LINGER_MS   20
+
+union GpLogArg {
+    long long    i;
+    double       d;
+    unsigned int strOff;
+};
+
+struct GpLogRecord {
+    unsigned long long tsUs;           /* CLOCK_MONOTONIC, microseconds */
+    const char*        fmt;
+    unsigned char      cat;
+    unsigned char      lvl;
+    unsigned char      nargs;
+    union GpLogArg     args[GP_LOG_MAX_ARGS];
+    char               str[GP_LOG_STR_BYTES];
+};
+
+struct GpLogSlot {
+    atomic_size_t      seq;
+    struct GpLogRecord rec;
+};
+
+unsigned char g_gpLogLevel[GP_LOG_CAT_COUNT];
+
+static struct GpLogSlot g_ring[GP_LOG_RING_SIZE];
+static atomic_size_t    g_head;        /* next slot for producers */
+static size_t           g_tail;        /* next slot for the writer thread */
+static atomic_ullong    g_dropped;
+
+static atomic_int       g_running;
+static atomic_int       g_writerIdle;
+static int              g_wakeFd = -1;
+static pthread_t        g_writer;
+
+static const char* const kCategoryNames[GP_LOG_CAT_COUNT] = {
+    "capture", "fwd", "ff", "cmd"
+};
+static const char* const kLevelNames[] = {
+    "off", "error", "warn", "info", "debug"
+};
+static const char kLevelTags[] = { '-', 'E', 'W', 'I', 'D' };
+
+static unsigned long long monotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+}
+
+/****************************************************************************
+ * Format-spec walking, shared by the producer (capture) and the writer
+ * (render). parseSpec() reads one conversion starting right after '%'.
+ ****************************************************************************/
+struct GpLogSpec {
+    const char* start;     /* points at '%' */
+    const char* end;       /* one past the conversion character */
+    int  widthStar;
+    int  precStar;
+    int  lenMod;           /* 0, 'H' (hh), 'h', 'l', 'L' (ll), 'z', 'j', 't', 'D' (long double) */
+    char conv;
+};
+
+static const char* parseSpec(const char* p, struct GpLogSpec* spec)
+{
+    memset(spec, 0, sizeof(*spec));
+    spec->start = p - 1;
+
+    while (*p && strchr("-+ #0'", *p)) p++;
+    if (*p == '*') { spec->widthStar = 1; p++; }
+    while (isdigit((unsigned char)*p)) p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') { spec->precStar = 1; p++; }
+        while (isdigit((unsigned char)*p)) p++;
+    }
+
+    if (p[0] == 'h' && p[1] == 'h')      { spec->lenMod = 'H'; p += 2; }
+    else if (p[0] == 'l' && p[1] == 'l') { spec->lenMod = 'L'; p += 2; }
+    else if (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't') { spec->lenMod = *p; p++; }
+    else if (*p == 'L')                  { spec->lenMod = 'D'; p++; }
+
+    spec->conv = *p;
+    if (*p) p++;
+    spec->end = p;
+    return p;
+}
+
+static int isIntConv(char c)      { return c == 'd' || c == 'i' || c == 'c'; }
+static int isUnsignedConv(char c) { return c == 'u' || c == 'x' || c == 'X' || c == 'o'; }
+static int isFloatConv(char c)
+{
+    return c == 'f' || c == 'F' || c == 'e' || c == 'E' ||
+           c == 'g' || c == 'G' || c == 'a' || c == 'A';
+}
+
+/*
+ * packStrings => copy the n strings of a record into its string area,
+ * shortening the longest ones first when they do not all fit.
+ */
+static void packStrings(struct GpLogRecord* rec, const char* const* s, const int* argIdx, int n)
+{
+    size_t len[GP_LOG_MAX_ARGS];
+    int    fits[GP_LOG_MAX_ARGS];
+    size_t room = GP_LOG_STR_BYTES - (size_t)n;     /* one NUL each */
+    int    left = n;
+    for (int i = 0; i < n; i++) {
+        len[i]  = strlen(s[i]);
+        fits[i] = 0;
+    }
+
+    /* Water-fill: strings within an even share of what is left go in whole. */
+    for (int changed = 1; changed && left > 0; ) {
+        changed = 0;
+        size_t share = room / (size_t)left;
+        for (int i = 0; i < n; i++) {
+            if (fits[i] || len[i] > share) continue;
+            fits[i] = 1;
+            room -= len[i];
+            left--;
+            changed = 1;
+        }
+    }
+    size_t share = left > 0 ? room / (size_t)left : 0;
+
+    size_t used = 0;
+    for (int i = 0; i < n; i++) {
+        size_t l = fits[i] ? len[i] : share;
+        memcpy(&rec->str[used], s[i], l);
+        rec->str[used + l] = '\0';
+        rec->args[argIdx[i]].strOff = (unsigned int)used;
+        used += l + 1;
+    }
+}
+
+/*
+ * captureRaw => copy the raw arguments of 'fmt' into 'rec'; %s arguments
+ * are only collected here, for packStrings().
+ * Stops quietly when the record runs out of argument slots; the writer
+ * renders everything after that point as literal text.
+ */
+static void captureRaw(struct GpLogRecord* rec, const char* fmt, va_list ap,
+                       const char** strs, int* strArg, int* strCount)
+{
+
+    for (const char* p = fmt; *p; ) {
+        if (*p++ != '%') continue;
+        if (*p == '%') { p++; continue; }
+
+        struct GpLogSpec spec;
+        p = parseSpec(p, &spec);
+
+        int needed = spec.widthStar + spec.precStar + 1;
+        if (rec->nargs + needed > GP_LOG_MAX_ARGS) return;
+
+        if (spec.widthStar) rec->args[rec->nargs++].i = va_arg(ap, int);
+        if (spec.precStar)  rec->args[rec->nargs++].i = va_arg(ap, int);
+
+        union GpLogArg* a = &rec->args[rec->nargs++];
+        if (isIntConv(spec.conv)) {
+            switch (spec.lenMod) {
+            case 'l': a->i = va_arg(ap, long); break;
+            case 'L': a->i = va_arg(ap, long long); break;
+            case 'z': a->i = (long long)va_arg(ap, ssize_t); break;
+            case 'j': a->i = (long long)va_arg(ap, intmax_t); break;
+            case 't': a->i = (long long)va_arg(ap, ptrdiff_t); break;
+            default:  a->i = va_arg(ap, int); break;
+            }
+        } else if (isUnsignedConv(spec.conv)) {
+            switch (spec.lenMod) {
+            case 'l': a->i = (long long)va_arg(ap, unsigned long); break;
+            case 'L': a->i = (long long)va_arg(ap, unsigned long long); break;
+            case 'z': a->i = (long long)va_arg(ap, size_t); break;
+            case 'j': a->i = (long long)va_arg(ap, uintmax_t); break;
+            case 't': a->i = (long long)va_arg(ap, ptrdiff_t); break;
+            default:  a->i = (long long)va_arg(ap, unsigned int); break;
+            }
+        } else if (isFloatConv(spec.conv)) {
+            a->d = (spec.lenMod == 'D') ? (double)va_arg(ap, long double) : va_arg(ap, double);
+        } else if (spec.conv == 'p') {
+            a->i = (long long)(uintptr_t)va_arg(ap, void*);
+        } else if (spec.conv == 's') {
+            const char* s = va_arg(ap, const char*);
+            strs[*strCount]   = s ? s : "(null)";
+            strArg[*strCount] = rec->nargs - 1;
+            (*strCount)++;
+        } else {
+            /* %n or something unknown => stop capturing. */
+            rec->nargs--;
+            return;
+        }
+    }
+}
+
+static void captureArgs(struct GpLogRecord* rec, const char* fmt, va_list ap)
+{
+    const char* strs[GP_LOG_MAX_ARGS];
+    int strArg[GP_LOG_MAX_ARGS];
+    int strCount = 0;
+
+    rec->nargs = 0;
+    captureRaw(rec, fmt, ap, strs, strArg, &strCount);
+    packStrings(rec, strs, strArg, strCount);
+}
+
+/* formatPrefix => "[   12.345678] I capture: " */
+static int formatPrefix(char* out, size_t outSize, unsigned long long tsUs, int cat, int lvl)
+{
+    return snprintf(out, outSize, "[%5llu.%06llu] %c %s: ",
+                    tsUs / 1000000ULL, tsUs % 1000000ULL, kLevelTags[lvl], kCategoryNames[cat]);
+}
+
+/* endLine => messages carry their own '\n' today; make sure every line ends with one. */
+static size_t endLine(char* out, size_t pos, size_t outSize)
+{
+    if (pos >= outSize) pos = outSize - 1;
+    if (pos == 0 || out[pos - 1] != '\n') {
+        if (pos >= outSize - 1) pos = outSize - 2;
+        out[pos++] = '\n';
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+/*
+ * renderRecord => turn one record back into a text line.
+ * Each conversion is handed to snprintf() on its own, with '*' replaced by
+ * the captured width/precision, so the output matches printf exactly.
+ */
+static size_t renderRecord(const struct GpLogRecord* rec, char* out, size_t outSize)
+{
+    size_t pos = 0;
+    int argIdx = 0;
+
+#define GP_LOG_ROOM() (pos < outSize ? outSize - pos : 0)
+#define GP_LOG_ADV(n) do { if ((n) > 0) pos += (size_t)(n); if (pos > outSize) pos = outSize; } while (0)
+
+    int n = formatPrefix(out, outSize, rec->tsUs, rec->cat, rec->lvl);
+    GP_LOG_ADV(n);
+
+    for (const char* p = rec->fmt; *p && GP_LOG_ROOM() > 1; ) {
+        if (*p != '%') {
+            out[pos++] = *p++;
+            continue;
+        }
+        p++;
+        if (*p == '%') { out[pos++] = '%'; p++; continue; }
+
+        struct GpLogSpec spec;
+        const char* next = parseSpec(p, &spec);
+        int needed = spec.widthStar + spec.precStar + 1;
+        if (argIdx + needed > rec->nargs) {
+            /* Not captured => emit the remaining format verbatim. */
+            p = spec.start;
+            while (*p && GP_LOG_ROOM() > 1) out[pos++] = *p++;
+            break;
+        }
+
+        /* Rebuild the spec with '*' expanded and the length modifier normalised. */
+        char one[48];
+        size_t o = 0;
+        for (const char* q = spec.start; q < spec.end - 1 && o < sizeof(one) - 24; q++) {
+            if (*q == '*') {
+                o += (size_t)snprintf(&one[o], sizeof(one) - o, "%lld", rec->args[argIdx++].i);
+            } else if (*q == 'h' || *q == 'l' || *q == 'z' || *q == 'j' || *q == 't' || *q == 'L') {
+                /* dropped; re-added below in a form matching the captured type */
+            } else {
+                one[o++] = *q;
+            }
+        }
+
+        const union GpLogArg* a = &rec->args[argIdx++];
+        if (isIntConv(spec.conv) || isUnsignedConv(spec.conv)) {
+            if (spec.conv == 'c') {
+                one[o++] = 'c'; one[o] = '\0';
+                n = snprintf(&out[pos], GP_LOG_ROOM(), one, (int)a->i);
+            } else {
+                one[o++] = 'l'; one[o++] = 'l'; one[o++] = spec.conv; one[o] = '\0';
+                n = snprintf(&out[pos], GP_LOG_ROOM(), one, a->i);
+            }
+        } else if (isFloatConv(spec.conv)) {
+            one[o++] = spec.conv; one[o] = '\0';
+            n = snprintf(&out[pos], GP_LOG_ROOM(), one, a->d);
+        } else if (spec.conv == 'p') {
+            one[o++] = 'p'; one[o] = '\0';
+            n = snprintf(&out[pos], GP_LOG_ROOM(), one, (void*)(uintptr_t)a->i);
+        } else {
+            one[o++] = 's'; one[o] = '\0';
+            n = snprintf(&out[pos], GP_LOG_ROOM(), one, &rec->str[a->strOff]);
+        }
+        GP_LOG_ADV(n);
+        p = next;
+    }
+
+#undef GP_LOG_ROOM
+#undef GP_LOG_ADV
+    return endLine(out, pos, outSize);
+}
+
+static void writeAll(const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+/****************************************************************************
+ * Ring (bounded MPMC queue, used here as multi-producer/single-consumer).
+ * Each slot carries a sequence number: seq == pos means free for the
+ * producer at 'pos', seq == pos+1 means published for the consumer.
+ ****************************************************************************/
+static void ringInit(void)
+{
+    for (size_t i = 0; i < GP_LOG_RING_SIZE; i++) {
+        atomic_store_explicit(&g_ring[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store(&g_head, 0);
+    g_tail = 0;
+}
+
+static struct GpLogSlot* ringClaim(size_t* outPos)
+{
+    size_t pos = atomic_load_explicit(&g_head, memory_order_relaxed);
+    for (;;) {
+        struct GpLogSlot* slot = &g_ring[pos & (GP_LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                *outPos = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return NULL; /* full */
+        } else {
+            pos = atomic_load_explicit(&g_head, memory_order_relaxed);
+        }
+    }
+}
+
+static void ringPublish(struct GpLogSlot* slot, size_t pos)
+{
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/*
+ * drainRing => format everything published so far and write it out in
+ * as few write(2) calls as the batch buffer allows.
+ */
+static int drainRing(void)
+{
+    char batch[4096];
+    size_t used = 0;
+    int count = 0;
+
+    for (;;) {
+        struct GpLogSlot* slot = &g_ring[g_tail & (GP_LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != g_tail + 1) break;
+
+        char line[GP_LOG_LINE_MAX];
+        size_t len = renderRecord(&slot->rec, line, sizeof(line));
+
+        atomic_store_explicit(&slot->seq, g_tail + GP_LOG_RING_SIZE, memory_order_release);
+        g_tail++;
+        count++;
+
+        if (used + len > sizeof(batch)) {
+            writeAll(batch, used);
+            used = 0;
+        }
+        memcpy(&batch[used], line, len);
+        used += len;
+    }
+    if (used) writeAll(batch, used);
+    return count;
+}
+
+static void* writerThreadFunc(void* arg)
+{
+    (void)arg;
+    struct pollfd pfd = { .fd = g_wakeFd, .events = POLLIN };
+
+    while (atomic_load(&g_running)) {
+        if (drainRing() > 0) continue;
+
+        /* Linger briefly so steady traffic does not have to signal us. */
+        poll(NULL, 0, GP_LOG_LINGER_MS);
+        if (drainRing() > 0) continue;
+
+        atomic_store(&g_writerIdle, 1);
+        atomic_thread_fence(memory_order_seq_cst);   /* see gp_log_write() */
+        if (drainRing() == 0 && atomic_load(&g_running)) {
+            poll(&pfd, 1, -1);
+            uint64_t v;
+            if (read(g_wakeFd, &v, sizeof(v)) < 0) { /* nothing pending */ }
+        }
+        atomic_store(&g_writerIdle, 0);
+    }
+    drainRing();
+    return NULL;
+}
+
+/****************************************************************************
+ * Public API
+ ****************************************************************************/
+void gp_log_write(int cat, int lvl, const char* fmt, ...)
+{
+    if (cat < 0 || cat >= GP_LOG_CAT_COUNT || !fmt) return;
+
+    va_list ap;
+    va_start(ap, fmt);
+
+    if (!atomic_load_explicit(&g_running, memory_order_relaxed)) {
+        /* No writer thread => format and write synchronously, strings in full. */
+        char line[GP_LOG_LINE_MAX];
+        int n = formatPrefix(line, sizeof(line), monotonicUs(), cat, lvl);
+        size_t pos = n > 0 ? (size_t)n : 0;
+        if (pos < sizeof(line)) {
+            n = vsnprintf(&line[pos], sizeof(line) - pos, fmt, ap);
+            if (n > 0) pos += (size_t)n;
+        }
+        va_end(ap);
+        writeAll(line, endLine(line, pos, sizeof(line)));
+        return;
+    }
+
+    size_t pos;
+    struct GpLogSlot* slot = ringClaim(&pos);
+    if (!slot) {
+        atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+        va_end(ap);
+        return;
+    }
+    slot->rec.tsUs = monotonicUs();
+    slot->rec.fmt  = fmt;
+    slot->rec.cat  = (unsigned char)cat;
+    slot->rec.lvl  = (unsigned char)lvl;
+    captureArgs(&slot->rec, fmt, ap);
+    va_end(ap);
+    ringPublish(slot, pos);
+
+    /*
+     * Pairs with the fence after the writer sets g_writerIdle: either it
+     * sees this record on its re-check, or we see it idle and wake it.
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&g_writerIdle)) {
+        uint64_t one = 1;
+        if (write(g_wakeFd, &one, sizeof(one)) < 0) { /* writer will catch up */ }
+    }
+}
+
+void gp_log_set_level(int cat, int lvl)
+{
+    if (lvl < GP_LOG_OFF)   lvl = GP_LOG_OFF;
+    if (lvl > GP_LOG_DEBUG) lvl = GP_LOG_DEBUG;
+    if (cat < 0) {
+        for (int i = 0; i < GP_LOG_CAT_COUNT; i++) g_gpLogLevel[i] = (unsigned char)lvl;
+    } else if (cat < GP_LOG_CAT_COUNT) {
+        g_gpLogLevel[cat] = (unsigned char)lvl;
+    }
+}
+
+int gp_log_category_from_name(const char* name)
+{
+    if (!name) return -1;
+    for (int i = 0; i < GP_LOG_CAT_COUNT; i++) {
+        if (!strcasecmp(name, kCategoryNames[i])) return i;
+    }
+    return -1;
+}
+
+int gp_log_level_from_name(const char* name)
+{
+    if (!name) return -1;
+    for (int i = 0; i <= GP_LOG_DEBUG; i++) {
+        if (!strcasecmp(name, kLevelNames[i])) return i;
+    }
+    return -1;
+}
+
+int gp_log_parse_spec(const char* spec)
+{
+    if (!spec) return -1;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    int rc = 0;
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+        char* eq = strchr(tok, '=');
+        if (!eq) { rc = -1; continue; }
+        *eq = '\0';
+
+        int lvl = gp_log_level_from_name(eq + 1);
+        if (lvl < 0) { rc = -1; continue; }
+
+        if (!strcasecmp(tok, "all")) {
+            gp_log_set_level(-1, lvl);
+        } else {
+            int cat = gp_log_category_from_name(tok);
+            if (cat < 0) { rc = -1; continue; }
+            gp_log_set_level(cat, lvl);
+        }
+    }
+    return rc;
+}
+
+void gp_log_init(void)
+{
+    gp_log_set_level(GP_LOG_CAPTURE, GP_LOG_INFO);
+    gp_log_set_level(GP_LOG_FWD,     GP_LOG_WARN);
+    gp_log_set_level(GP_LOG_FF,      GAMMAPAD_VERBOSE_LOGGING ? GP_LOG_DEBUG : GP_LOG_WARN);
+    gp_log_set_level(GP_LOG_CMD,     GP_LOG_INFO);
+
+    const char* env = getenv("GAMMAPAD_LOG");
+    if (env && gp_log_parse_spec(env) < 0) {
+        fprintf(stderr, "[GammaPadLog] Could not fully parse GAMMAPAD_LOG='%s'\n", env);
+    }
+}
+
+int gp_log_start(void)
+{
+    if (atomic_load(&g_running)) return 0;
+
+    ringInit();
+    g_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (g_wakeFd < 0) {
+        fprintf(stderr, "[GammaPadLog] eventfd => %s, staying synchronous.\n", strerror(errno));
+        return -1;
+    }
+
+    atomic_store(&g_writerIdle, 0);
+    atomic_store(&g_running, 1);
+
+    /* The writer must not take SIGINT/SIGTERM meant for the main loop. */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&g_writer, NULL, writerThreadFunc, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        atomic_store(&g_running, 0);
+        close(g_wakeFd);
+        g_wakeFd = -1;
+        fprintf(stderr, "[GammaPadLog] writer thread creation failed, staying synchronous.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void gp_log_stop(void)
+{
+    if (!atomic_load(&g_running)) return;
+
+    atomic_store(&g_running, 0);
+    uint64_t one = 1;
+    if (write(g_wakeFd, &one, sizeof(one)) < 0) { /* thread also exits on its own poll */ }
+    pthread_join(g_writer, NULL);
+
+    close(g_wakeFd);
+    g_wakeFd = -1;
+
+    unsigned long long dropped = atomic_load(&g_dropped);
+    if (dropped) {
+        fprintf(stderr, "[GammaPadLog] %llu log records dropped (ring full).\n", dropped);
+    }
+}
+
+unsigned long long gp_log_dropped(void)
+{
+    return atomic_load(&g_dropped);
+}
@@ -0,0 +1,86 @@
+#ifndef GAMMAPAD_LOG_H
+#define GAMMAPAD_LOG_H
+
+/*
+ * gammapad_log.h
+ *
+ * Levelled, per-category logging that keeps stdio off the input hot path.
+ *
+ * A GP_LOG() call whose category/level is disabled costs one byte load and
+ * a compare. An enabled call copies the format pointer plus its raw
+ * arguments into a fixed-size record on a lock-free ring; a background
+ * thread does the actual formatting and the write(2) to stderr.
+ *
+ * Before gp_log_start() (and after gp_log_stop()) records are formatted
+ * and written synchronously, so early startup and exit-time messages are
+ * never lost.
+ *
+ * Runtime control:
+ *   - env GAMMAPAD_LOG="all=warn,fwd=debug,ff=info"
+ *   - console command "log <capture|fwd|ff|cmd|all> <off|error|warn|info|debug>"
+ */
+
+enum GpLogCategory {
+    GP_LOG_CAPTURE = 0,   /* device open, sysfs, .kl parsing, routing setup */
+    GP_LOG_FWD,           /* per-event forwarding (hot path)                */
+    GP_LOG_FF,            /* force feedback / haptics                       */
+    GP_LOG_CMD,           /* console commands                               */
+    GP_LOG_CAT_COUNT
+};
+
+enum GpLogLevel {
+    GP_LOG_OFF = 0,
+    GP_LOG_ERROR,
+    GP_LOG_WARN,
+    GP_LOG_INFO,
+    GP_LOG_DEBUG
+};
+
+/*
+ * Current threshold per category. A message is emitted when its level is
+ * <= g_gpLogLevel[cat]. Written only by gp_log_set_level().
+ */
+extern unsigned char g_gpLogLevel[GP_LOG_CAT_COUNT];
+
+#define GP_LOG_ENABLED(cat, lvl) \
+    __builtin_expect((unsigned char)(lvl) <= g_gpLogLevel[(cat)], 0)
+
+#define GP_LOG(cat, lvl, fmt, args...)                      \
+    do {                                                    \
+        if (GP_LOG_ENABLED(cat, lvl))                       \
+            gp_log_write((cat), (lvl), fmt, ## args);       \
+    } while (0)
+
+/*
+ * gp_log_write => capture one record. Use GP_LOG() rather than calling
+ * this directly so disabled messages skip the call entirely.
+ * Supported conversions: d i u x X o c s p f e g a (with h/hh/l/ll/z/j/t
+ * length modifiers, '*' width/precision) and %%.
+ */
+void gp_log_write(int cat, int lvl, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/* Apply defaults + GAMMAPAD_LOG from the environment. */
+void gp_log_init(void);
+
+/* Start/stop the background writer thread. gp_log_stop() drains the ring. */
+int  gp_log_start(void);
+void gp_log_stop(void);
+
+/* Runtime level control. cat < 0 => all categories. */
+void gp_log_set_level(int cat, int lvl);
+
+/*
+ * gp_log_parse_spec => "fwd=debug,ff=info" or "all=warn".
+ * Returns 0 on success, -1 if any entry was not understood.
+ */
+int  gp_log_parse_spec(const char* spec);
+
+/* Name lookups for the console command. Return -1 if unknown. */
+int  gp_log_category_from_name(const char* name);
+int  gp_log_level_from_name(const char* name);
+
+/* Records dropped because the ring was full. */
+unsigned long long gp_log_dropped(void);
+
+#endif /* GAMMAPAD_LOG_H */
@@ -1,6 +1,13 @@
 #include "gammapad.h"
 #include "gammapad_inputdefs.h"
 #include "gammapad_capture.h"  // for open_physical_device, forward_physical_event
+#include "gammapad_timer.h"    // releases for timed presses
+#include "gammapad_hotplug.h"  // reattach on replug
+#include "gammapad_sysfs.h"    // --sysfs-root
+#include "gammapad_haptics.h"  // --vib-* motor config
+#include "gammapad_record.h"   // --record
+#include "gammapad_trace.h"    // --trace, ff_upload tracepoint
+#include "gammapad_metrics.h"  // --metrics, main-loop counters
 #include <sys/epoll.h>
 #include <linux/input.h>
 #include <fcntl.h>
@@ -8,7 +15,7 @@
 #include <errno.h>
 
 /*
- * We'll store up to 64 active events for auto-reset.
+ * We'll store up to 64 pending auto-releases (one per held code).
  */
 #define MAX_ACTIVE_EVENTS 64
 #define EPOLL_MAX_EVENTS  16
@@ -19,20 +26,34 @@ enum EventType {
 };
 
 struct ActiveEvent {
+    int used;
     enum EventType type;
     int code;
-    int value;
-    unsigned long long startMs;
-    unsigned long long durationMs;
+    int timerId;     /* gammapad_timer id of the pending release */
 };
 
 static struct ActiveEvent activeEvents[MAX_ACTIVE_EVENTS];
 
-int controllerFd = -1;  /* Virtual gamepad */
+int controllerFd = -1;  /* Virtual gamepad (first pad, owns FF) */
 int mouseFd      = -1;  /* Virtual mouse   */
-int g_physicalFd = -1;  /* Source device   */
+int g_physicalFd = -1;  /* First source device */
+
+/*
+ * One virtual pad per captured device (or a single fallback pad when
+ * nothing was captured). g_pads[0] is the FF/console pad => controllerFd.
+ */
+static struct GpPad g_pads[GP_MAX_DEVICES];
+static int g_padCount = 0;
+
+static int g_epfd = -1;
+static struct GpPollSource g_controllerSrc;
+static struct GpPollSource g_stdinSrc;
+static struct GpPollSource g_timerSrc;
+static struct GpPollSource g_hotplugSrc;
+static struct GpPollSource g_metricsSrc;
 
 static int g_shouldExit = 0;
+static int g_running = 0;   /* pads created + epoll set up => hotplug captures live */
 
 static void sigintHandler(int sig)
 {
@@ -41,45 +62,34 @@ static void sigintHandler(int sig)
 }
 
 /* Forward declarations. */
-int create_virtual_controller(int* fd_out);
+int create_virtual_controller(struct GpDevice* const* devs, int count, int withFF, int* fd_out);
 int create_virtual_mouse(int* fd_out);
 void destroy_virtual_device(int fd);
 
 int dummy_upload_ff_effect(struct ff_effect* effect);
 int dummy_erase_ff_effect(int kernel_id);
 void storeUploadedEffect(struct ff_effect* eff);
-void ff_play_effect(int kernel_id, int doPlay);
+void ff_play_effect(int kernel_id, int value);
+void ff_set_gain(int value);
+void ff_set_autocenter(int value);
+int ff_backend_start(const char* name, const struct GpHapticsConfig* cfg);
+void ff_backend_stop(void);
+void ff_physical_changed(int fd);
 void parseCommand(const char* line);
 
 /*
- * scheduleEvent => from parseCommand
+ * writeSingleEvent => one event + SYN_REPORT on the virtual pad
  */
-static void sendEvent(int code, enum EventType t, int value, unsigned long long dur)
+static void writeSingleEvent(int code, enum EventType t, int value)
 {
-    for (int i=0; i<MAX_ACTIVE_EVENTS; i++){
-        if (activeEvents[i].code==0 && activeEvents[i].value==0){
-            activeEvents[i].type = t;
-            activeEvents[i].code = code;
-            activeEvents[i].value= value;
-            activeEvents[i].startMs= getTimeMs();
-            activeEvents[i].durationMs= dur;
-            break;
-        }
-    }
     if (controllerFd < 0) return;
 
     struct input_event ev[2];
     memset(ev,0,sizeof(ev));
 
-    if(t==EVENT_TYPE_KEY){
-        ev[0].type= EV_KEY;
-        ev[0].code= code;
-        ev[0].value= value;
-    } else {
-        ev[0].type= EV_ABS;
-        ev[0].code= code;
-        ev[0].value= value;
-    }
+    ev[0].type= (t==EVENT_TYPE_KEY) ? EV_KEY : EV_ABS;
+    ev[0].code= code;
+    ev[0].value= value;
     ev[1].type= EV_SYN;
     ev[1].code= SYN_REPORT;
     ev[1].value=0;
@@ -87,55 +97,51 @@ static void sendEvent(int code, enum EventType t, int value, unsigned long long
     write(controllerFd, &ev, sizeof(ev));
 }
 
-void scheduleEvent(int code, int isKey, int value, unsigned long long durationMs)
+/*
+ * releaseTimerFired => the press duration is over, reset the code to 0
+ */
+static void releaseTimerFired(void* arg)
 {
-    sendEvent(code, (isKey ? EVENT_TYPE_KEY : EVENT_TYPE_ABS), value, durationMs);
+    struct ActiveEvent* ae = (struct ActiveEvent*)arg;
+    writeSingleEvent(ae->code, ae->type, 0);
+    ae->used = 0;
+    ae->timerId = 0;
 }
 
 /*
- * resetEvent => for short-press
+ * sendEvent => press now, schedule the release 'dur' ms later.
+ * Pressing a code that is already held just moves its release deadline.
  */
-static void resetEvent(int code, enum EventType t)
+static void sendEvent(int code, enum EventType t, int value, unsigned long long dur)
 {
-    if(controllerFd<0) return;
+    struct ActiveEvent* slot = NULL;
+    for (int i=0; i<MAX_ACTIVE_EVENTS; i++){
+        if (activeEvents[i].used && activeEvents[i].type==t && activeEvents[i].code==code){
+            gp_timer_cancel(activeEvents[i].timerId);
+            slot = &activeEvents[i];
+            break;
+        }
+        if (!slot && !activeEvents[i].used) slot = &activeEvents[i];
+    }
 
-    struct input_event ev[2];
-    memset(ev,0,sizeof(ev));
+    writeSingleEvent(code, t, value);
 
-    if(t==EVENT_TYPE_KEY){
-        ev[0].type=EV_KEY;
-        ev[0].code=code;
-        ev[0].value=0;
-    } else {
-        ev[0].type=EV_ABS;
-        ev[0].code=code;
-        ev[0].value=0;
-    }
-    ev[1].type=EV_SYN;
-    ev[1].code=SYN_REPORT;
-    ev[1].value=0;
-    write(controllerFd, &ev, sizeof(ev));
+    if (!slot) {
+        fprintf(stderr,"[GammaPad] Too many held events, code=%d will not auto-release.\n", code);
+        return;
+    }
+    slot->used = 1;
+    slot->type = t;
+    slot->code = code;
+    slot->timerId = gp_timer_add_ms(dur, releaseTimerFired, slot);
+    if (slot->timerId < 0) {
+        slot->used = 0;
+    }
 }
 
-/*
- * checkEventTimeouts => see if short-press ended
- */
-static void checkEventTimeouts(void)
+void scheduleEvent(int code, int isKey, int value, unsigned long long durationMs)
 {
-    unsigned long long now= getTimeMs();
-    for(int i=0;i<MAX_ACTIVE_EVENTS;i++){
-        if(activeEvents[i].code!=0 || activeEvents[i].value!=0){
-            unsigned long long elapsed= now - activeEvents[i].startMs;
-            if(elapsed>= activeEvents[i].durationMs){
-                resetEvent(activeEvents[i].code, activeEvents[i].type);
-                activeEvents[i].type= EVENT_TYPE_KEY;
-                activeEvents[i].code= 0;
-                activeEvents[i].value= 0;
-                activeEvents[i].startMs=0;
-                activeEvents[i].durationMs=0;
-            }
-        }
-    }
+    sendEvent(code, (isKey ? EVENT_TYPE_KEY : EVENT_TYPE_ABS), value, durationMs);
 }
 
 /*
@@ -145,7 +151,9 @@ static void handleFFRequest(const struct input_event* ev)
 {
     if(!ev) return;
     if(ev->code==UI_FF_UPLOAD){
+        g_gpMetrics.ffUploads++;
         struct uinput_ff_upload ffup;
+        unsigned long long traceNs= GP_TRACE_ON() ? getMonotonicNs() : 0;
         memset(&ffup,0,sizeof(ffup));
         ffup.request_id= ev->value;
         if(!ioctl(controllerFd, UI_BEGIN_FF_UPLOAD, &ffup)){
@@ -155,7 +163,9 @@ static void handleFFRequest(const struct input_event* ev)
                 storeUploadedEffect(&ffup.effect);
             }
         }
+        if(GP_TRACE_ON() && traceNs) gp_trace_span(GP_TR_FF_UPLOAD, traceNs, getMonotonicNs());
     } else if(ev->code==UI_FF_ERASE){
+        g_gpMetrics.ffErases++;
         struct uinput_ff_erase fferase;
         memset(&fferase,0,sizeof(fferase));
         fferase.request_id= ev->value;
@@ -168,18 +178,27 @@ static void handleFFRequest(const struct input_event* ev)
 }
 
 /*
- * handleFFPlayStop => EV_FF => start or stop effect
+ * handleFFPlayStop => EV_FF => start/stop effect, or gain/autocenter
  */
-static void handleFFPlayStop(int kid, int doPlay)
+static void handleFFPlayStop(int code, int value)
 {
-    ff_play_effect(kid, doPlay);
+    if(code==FF_GAIN)            ff_set_gain(value);
+    else if(code==FF_AUTOCENTER) ff_set_autocenter(value);
+    else {
+        if(value>0) g_gpMetrics.ffPlays++;
+        else        g_gpMetrics.ffStops++;
+        ff_play_effect(code, value);
+    }
 }
 
 /*
- * processControllerFdEvent => read from the virtual pad (controllerFd)
+ * onControllerFdEvent => read from the virtual pad (controllerFd)
  */
-static void processControllerFdEvent(void)
+static void onControllerFdEvent(struct GpPollSource* src, unsigned int events)
 {
+    (void)src;
+    if(!(events & EPOLLIN)) return;
+
     struct input_event ie;
     while(1){
         ssize_t n= read(controllerFd, &ie, sizeof(ie));
@@ -199,29 +218,71 @@ static void processControllerFdEvent(void)
 }
 
 /*
- * processPhysicalDeviceEvent => read from physical, forward
+ * updatePhysicalFd => g_physicalFd follows the open source of the FF pad.
  */
-static void processPhysicalDeviceEvent(int physical_fd)
+static void updatePhysicalFd(void)
 {
-    struct input_event ev;
-    while(1){
-        ssize_t n= read(physical_fd, &ev,sizeof(ev));
-        if(n<0){
-            if(errno==EAGAIN||errno==EWOULDBLOCK) break;
+    g_physicalFd= -1;
+    for(int i=0; i<gp_device_count(); i++){
+        struct GpDevice* dev= gp_device_at(i);
+        if(dev->fd>=0 && dev->pad && dev->pad->hasFF){
+            g_physicalFd= dev->fd;
             break;
         }
-        if(n==0) break;
-        if((size_t)n<sizeof(ev)) break;
+    }
+    ff_physical_changed(g_physicalFd);
+}
 
-        forward_physical_event(&ev);
+/*
+ * detachDevice => the node went away (ENODEV/HUP): stop polling it and
+ * close it. Its pad stays, so consumers keep a stable virtual device and
+ * the device can be reattached when it comes back (onHotplugNode).
+ */
+static void detachDevice(struct GpDevice* dev)
+{
+    fprintf(stderr,"[GammaPad] Device #%d '%s' went away.\n", dev->index, dev->path);
+    g_gpMetrics.hotplugDetach++;
+    epoll_ctl(g_epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+    if(dev->pad){
+        /* Let go of whatever this source was holding (keys up, axes centered). */
+        gp_pad_release_source(dev->pad, dev);
     }
+    close_physical_device(dev);
+    /*
+     * The hardware is gone: nothing to unlink or rebind at exit (the
+     * eventN may belong to another device by then). A reattach sets both
+     * again.
+     */
+    dev->path[0]= 0;
+    dev->hasDriver= 0;
+    updatePhysicalFd();
 }
 
 /*
- * processStdinEvent => parse typed commands
+ * onPhysicalDeviceEvent => read from one physical device, forward.
+ * gp_device_pump reads in batches to keep read() syscalls per frame low.
  */
-static void processStdinEvent(void)
+static void onPhysicalDeviceEvent(struct GpPollSource* src, unsigned int events)
 {
+    struct GpDevice* dev= (struct GpDevice*)src->ctx;
+
+    if(gp_device_pump(dev)<0){
+        detachDevice(dev);
+        return;
+    }
+    if(dev->fd>=0 && (events & (EPOLLHUP|EPOLLERR))){
+        detachDevice(dev);
+    }
+}
+
+/*
+ * onStdinEvent => parse typed commands
+ */
+static void onStdinEvent(struct GpPollSource* src, unsigned int events)
+{
+    (void)src;
+    if(!(events & EPOLLIN)) return;
+
     char line[256];
     memset(line,0,sizeof(line));
     if(!fgets(line,sizeof(line),stdin)) return;
@@ -235,91 +296,464 @@ static void processStdinEvent(void)
 }
 
 /*
- * add_epoll_fd => helper
+ * onTimerEvent => timed releases etc.
+ */
+static void onTimerEvent(struct GpPollSource* src, unsigned int events)
+{
+    (void)src;
+    if(events & EPOLLIN){
+        gp_timer_dispatch();
+    }
+}
+
+/*
+ * add_epoll_source => register src->fd with data.ptr = src
  */
-static void add_epoll_fd(int epfd, int fd)
+static void add_epoll_source(int epfd, struct GpPollSource* src)
 {
-    if(fd<0) return;
+    if(!src || src->fd<0) return;
     struct epoll_event ev;
     memset(&ev,0,sizeof(ev));
     ev.events= EPOLLIN|EPOLLET;
-    ev.data.fd= fd;
-    if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd,&ev)<0){
-        fprintf(stderr,"epoll_ctl ADD fd=%d => %s\n", fd,strerror(errno));
+    ev.data.ptr= src;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, src->fd,&ev)<0){
+        fprintf(stderr,"epoll_ctl ADD fd=%d => %s\n", src->fd,strerror(errno));
+    }
+    fcntl(src->fd,F_SETFL,O_NONBLOCK);
+}
+
+static void init_poll_source(struct GpPollSource* src, int fd,
+                             void (*onEvent)(struct GpPollSource*, unsigned int), void* ctx)
+{
+    src->fd= fd;
+    src->onEvent= onEvent;
+    src->ctx= ctx;
+}
+
+/*
+ * onMetricsEvent => clients on the metrics socket
+ */
+static void onMetricsEvent(struct GpPollSource* src, unsigned int events)
+{
+    (void)src;
+    if(events & EPOLLIN){
+        gp_metrics_serve();
+    }
+}
+
+/*
+ * onHotplugEvent => inotify on the input dir
+ */
+static void onHotplugEvent(struct GpPollSource* src, unsigned int events)
+{
+    (void)src;
+    if(events & EPOLLIN){
+        gp_hotplug_dispatch();
+    }
+}
+
+/*
+ * startCapture => node removal + epoll registration for a device opened
+ * while the loop is already running.
+ */
+static void startCapture(struct GpDevice* dev)
+{
+    if(unlink(dev->path)<0 && errno!=ENOENT){
+        fprintf(stderr,"[GammaPad] unlink '%s' => %s\n", dev->path, strerror(errno));
     }
-    fcntl(fd,F_SETFL,O_NONBLOCK);
+    init_poll_source(&dev->pollSrc, dev->fd, onPhysicalDeviceEvent, dev);
+    add_epoll_source(g_epfd, &dev->pollSrc);
+    updatePhysicalFd();
+    g_gpMetrics.hotplugAttach++;
+}
+
+/*
+ * findDetachedDevice => a device we lost whose identity matches 'node'.
+ * A matching phys (same port) wins over vendor/product/name alone.
+ */
+static struct GpDevice* findDetachedDevice(const struct GpNodeInfo* node)
+{
+    struct GpDevice* loose= NULL;
+    for(int i=0; i<gp_device_count(); i++){
+        struct GpDevice* dev= gp_device_at(i);
+        if(dev->fd>=0 || !dev->pad) continue;
+        if(dev->id.vendor!=node->id.vendor || dev->id.product!=node->id.product) continue;
+        if(strcmp(dev->inputName, node->name)) continue;
+        if(!strcmp(dev->phys, node->phys)) return dev;
+        if(!loose) loose= dev;
+    }
+    return loose;
+}
+
+/*
+ * captureNewDevice => a --match node appeared at runtime: it gets its own
+ * pad, or joins the composite pad (whose capabilities were fixed when it
+ * was created, so only codes it already advertises get through).
+ */
+static void captureNewDevice(const struct GpNodeInfo* node)
+{
+    struct GpDevice* dev= gp_device_alloc();
+    if(!dev) return;
+    if(open_physical_device(dev, node->path)<0){
+        gp_device_free(dev);
+        return;
+    }
+
+    struct GpPad* pad= NULL;
+    if(g_padCount>0 && g_pads[0].merge){
+        pad= &g_pads[0];
+    } else if(g_padCount<GP_MAX_DEVICES){
+        pad= &g_pads[g_padCount];
+        memset(pad,0,sizeof(*pad));
+        if(create_virtual_controller(&dev, 1, 0, &pad->fd)<0){
+            fprintf(stderr,"[GammaPad] create_virtual_controller for '%s' => failed.\n", dev->path);
+            pad= NULL;
+        } else {
+            g_padCount++;
+        }
+    }
+    if(!pad){
+        gp_device_free(dev);
+        return;
+    }
+    gp_pad_attach_source(pad, dev);
+    startCapture(dev);
+    fprintf(stderr,"[GammaPad] Source #%d '%s' (%s) captured.\n", dev->index, dev->path, node->name);
+}
+
+/*
+ * onHotplugNode => a node appeared (or became readable) in the input dir.
+ *   - ours already                  => nothing to do
+ *   - a device we lost came back    => reattach it to its old pad
+ *   - matches a --match selector    => capture it (at startup: just open it,
+ *                                      pads are created afterwards)
+ */
+static void onHotplugNode(const struct GpNodeInfo* node, void* ctx)
+{
+    (void)ctx;
+    for(int i=0; i<gp_device_count(); i++){
+        struct GpDevice* dev= gp_device_at(i);
+        if(dev->fd>=0 && !strcmp(dev->path, node->path)) return;
+    }
+
+    struct GpDevice* dev= findDetachedDevice(node);
+    if(dev){
+        if(open_physical_device(dev, node->path)<0) return;
+        gp_pad_attach_source(dev->pad, dev);
+        startCapture(dev);
+
+        double ms= (double)(getMonotonicNs() - node->firstSeenNs) / 1e6;
+        fprintf(stderr,"[GammaPad] Device #%d reattached from '%s' in %.1f ms.\n",
+                dev->index, node->path, ms);
+        if(ms > GP_HOTPLUG_BUDGET_MS){
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Hotplug] reattach of #%d took %.1f ms (budget %d ms).\n",
+                dev->index, ms, GP_HOTPLUG_BUDGET_MS);
+        }
+        return;
+    }
+
+    if(!gp_hotplug_wanted(node)) return;
+    if(!g_running){
+        dev= gp_device_alloc();
+        if(!dev) return;
+        if(open_physical_device(dev, node->path)<0){
+            gp_device_free(dev);
+            return;
+        }
+        fprintf(stderr,"[GammaPad] Source #%d '%s' (%s) opened.\n", dev->index, node->path, node->name);
+        return;
+    }
+    captureNewDevice(node);
+}
+
+/*
+ * destroy_all_pads => tear down every virtual pad we created
+ */
+static void destroy_all_pads(void)
+{
+    for(int i=0; i<g_padCount; i++){
+        destroy_virtual_device(g_pads[i].fd);
+        g_pads[i].fd= -1;
+        free(g_pads[i].merge);
+        g_pads[i].merge= NULL;
+    }
+    g_padCount= 0;
+    controllerFd= -1;
+}
+
+static void close_all_devices(void)
+{
+    for(int i=0; i<gp_device_count(); i++){
+        close_physical_device(gp_device_at(i));
+    }
+    g_physicalFd= -1;
 }
 
 int main(int argc, char** argv)
 {
     signal(SIGINT, sigintHandler);
 
+    gp_log_init();
+    gp_log_start();
+
+    if(gp_timer_init()<0){
+        fprintf(stderr,"[GammaPad] gp_timer_init => failed.\n");
+        gp_log_stop();
+        return 1;
+    }
+
     /*
-     * Step 1: If user specified a physical device path, open it first,
-     * parse .kl, discover scancodes, but DO NOT remove the node yet.
+     * Step 1: open every physical device path given on the command line,
+     * parse .kl, discover scancodes, but DO NOT remove the nodes yet.
+     *   --composite[=last|max] => merge every device into one pad; axes
+     *                             claimed by several devices follow the
+     *                             last writer (default) or the one
+     *                             furthest from center.
+     *   --input-dir=DIR        => watch DIR instead of /dev/input
+     *                             ($GAMMAPAD_INPUT_DIR works too)
+     *   --sysfs-root=DIR       => look drivers up under DIR instead of /sys
+     *                             ($GAMMAPAD_SYSFS_ROOT works too)
+     *   --match=SPEC           => also capture nodes matching SPEC, now and
+     *                             whenever they appear, e.g.
+     *                             vendor=045e,product=02fd,name=Xbox*,phys=usb-*
+     *   --ff=BACKEND           => auto (default), timed_output, leds or
+     *                             passthrough ($GAMMAPAD_FF_BACKEND works too)
+     *   --vib-path=PATH        => vibrator node (timed_output) or directory
+     *                             (leds); may be a plain file/dir stand-in
+     *                             ($GAMMAPAD_VIB_PATH works too)
+     *   --vib-weak-path=PATH   => second motor for the weak rumble channel
+     *                             ($GAMMAPAD_VIB_WEAK_PATH works too)
+     *   --vib-tune=SPEC        => per-motor response, e.g.
+     *                             strong:scale=33,curve=1.5,min=8000
+     *   --record=FILE          => append everything the devices emit, plus
+     *                             their capture setup, to FILE for
+     *                             gammapad_replay
+     *   --metrics=PATH         => serve counter snapshots on a Unix socket
+     *                             ('@name' => abstract; $GAMMAPAD_METRICS)
+     *   --trace[=FILE]         => record stage latencies from the start
+     *                             (TRACE=1 builds); print them at exit and
+     *                             write the Chrome trace to FILE
+     * The input dir is watched from the start, so a captured device that is
+     * unplugged and plugged back in is reattached to its old pad.
      */
-    if(argc>1){
-        g_physicalFd= open_physical_device(argv[1]);
-        if(g_physicalFd<0){
-            fprintf(stderr,"[GammaPad] Could not open '%s'. Will proceed with no physical.\n", argv[1]);
-            g_physicalFd=-1;
-        } else {
-            fprintf(stderr,"[GammaPad] Source '%s' opened.\n", argv[1]);
-            /* We do NOT remove node here. We'll do it after creating the virtual pad. */
+    int composite= 0;
+    int axisMerge= GP_AXIS_MERGE_LAST;
+    const char* inputDir= NULL;
+    const char* recordPath= NULL;
+    const char* metricsPath= getenv("GAMMAPAD_METRICS");
+    const char* tracePath= NULL;
+    int trace= 0;
+    const char* ffBackend= getenv("GAMMAPAD_FF_BACKEND");
+    struct GpHapticsConfig vibCfg;
+    gp_haptics_config_default(&vibCfg);
+    const char* envPath= getenv("GAMMAPAD_VIB_PATH");
+    if(envPath && *envPath) vibCfg.motor[GP_FF_STRONG].path= envPath;
+    envPath= getenv("GAMMAPAD_VIB_WEAK_PATH");
+    if(envPath && *envPath) vibCfg.motor[GP_FF_WEAK].path= envPath;
+    for(int a=1; a<argc; a++){
+        if(!strncmp(argv[a], "--composite", 11)){
+            const char* policy= argv[a]+11;
+            composite= 1;
+            if(!strcmp(policy, "=max")) axisMerge= GP_AXIS_MERGE_MAX;
+            else if(*policy && strcmp(policy, "=last")){
+                fprintf(stderr,"[GammaPad] Unknown axis merge policy '%s', using last.\n", policy+1);
+            }
+        } else if(!strncmp(argv[a], "--input-dir=", 12)){
+            inputDir= argv[a]+12;
+        } else if(!strncmp(argv[a], "--sysfs-root=", 13)){
+            gp_sysfs_set_root(argv[a]+13);
+        } else if(!strncmp(argv[a], "--ff=", 5)){
+            ffBackend= argv[a]+5;
+        } else if(!strncmp(argv[a], "--vib-path=", 11)){
+            vibCfg.motor[GP_FF_STRONG].path= argv[a]+11;
+        } else if(!strncmp(argv[a], "--vib-weak-path=", 16)){
+            vibCfg.motor[GP_FF_WEAK].path= argv[a]+16;
+        } else if(!strncmp(argv[a], "--vib-tune=", 11)){
+            if(gp_haptics_config_tune(&vibCfg, argv[a]+11)<0){
+                fprintf(stderr,"[GammaPad] Ignoring bad motor tuning '%s'.\n", argv[a]+11);
+            }
+        } else if(!strncmp(argv[a], "--trace", 7) && (!argv[a][7] || argv[a][7]=='=')){
+            trace= 1;
+            if(argv[a][7]=='=') tracePath= argv[a]+8;
+        } else if(!strncmp(argv[a], "--metrics=", 10)){
+            metricsPath= argv[a]+10;
+        } else if(!strncmp(argv[a], "--record=", 9)){
+            recordPath= argv[a]+9;
+        } else if(!strncmp(argv[a], "--match=", 8)){
+            if(gp_hotplug_add_selector(argv[a]+8)<0){
+                fprintf(stderr,"[GammaPad] Ignoring bad selector '%s'.\n", argv[a]+8);
+            }
         }
     }
 
+    if(trace && gp_trace_enable(1)<0){
+        fprintf(stderr,"[GammaPad] --trace: tracing is compiled out (build with make TRACE=1).\n");
+        trace= 0;
+    }
+    if(recordPath && gp_record_open(recordPath)<0){
+        fprintf(stderr,"[GammaPad] Could not record to '%s'.\n", recordPath);
+    }
+
+    if(gp_hotplug_init(inputDir, onHotplugNode, NULL)<0){
+        fprintf(stderr,"[GammaPad] Hotplug watcher unavailable => no reattach.\n");
+    }
+
+    for(int a=1; a<argc; a++){
+        if(!strncmp(argv[a], "--", 2)) continue;
+        struct GpDevice* dev= gp_device_alloc();
+        if(!dev){
+            fprintf(stderr,"[GammaPad] Ignoring '%s': device table full.\n", argv[a]);
+            continue;
+        }
+        if(open_physical_device(dev, argv[a])<0){
+            fprintf(stderr,"[GammaPad] Could not open '%s'. Skipping it.\n", argv[a]);
+            gp_device_free(dev);
+            continue;
+        }
+        fprintf(stderr,"[GammaPad] Source #%d '%s' opened.\n", dev->index, argv[a]);
+        /* We do NOT remove node here. We'll do it after creating the virtual pad. */
+    }
+    if(gp_hotplug_selector_count()>0){
+        gp_hotplug_scan();
+    }
+
     /*
-     * Step 2: create the Virtual Pad + Virtual Mouse
+     * Step 2: create one Virtual Pad per opened device (the first one owns
+     * FF), one composite pad for all of them, or a single fallback pad,
+     * plus the Virtual Mouse.
      */
-    if(create_virtual_controller(&controllerFd)<0){
-        fprintf(stderr,"[GammaPad] create_virtual_controller => failed.\n");
-        return 1;
+    if(composite){
+        struct GpDevice* srcs[GP_MAX_DEVICES];
+        int srcCount= 0;
+        for(int i=0; i<gp_device_count(); i++){
+            if(gp_device_at(i)->fd>=0) srcs[srcCount++]= gp_device_at(i);
+        }
+        struct GpPad* pad= &g_pads[0];
+        memset(pad,0,sizeof(*pad));
+        pad->hasFF= 1;
+        if(srcCount>0 && gp_pad_enable_merge(pad, axisMerge)==0 &&
+           create_virtual_controller(srcs, srcCount, 1, &pad->fd)==0){
+            for(int i=0; i<srcCount; i++){
+                gp_pad_attach_source(pad, srcs[i]);
+            }
+            g_physicalFd= srcs[0]->fd;
+            g_padCount= 1;
+            fprintf(stderr,"[GammaPad] Composite pad => %d sources, axis merge=%s.\n",
+                    srcCount, axisMerge==GP_AXIS_MERGE_MAX ? "max" : "last");
+        } else if(srcCount>0){
+            fprintf(stderr,"[GammaPad] composite create_virtual_controller => failed.\n");
+            for(int i=0; i<srcCount; i++){
+                gp_device_free(srcs[i]);
+            }
+            free(pad->merge);
+            pad->merge= NULL;
+        }
+    }
+    for(int i=0; i<gp_device_count() && !composite; i++){
+        struct GpDevice* dev= gp_device_at(i);
+        if(dev->fd<0) continue;
+
+        struct GpPad* pad= &g_pads[g_padCount];
+        memset(pad,0,sizeof(*pad));
+        pad->hasFF= (g_padCount==0);
+        if(create_virtual_controller(&dev, 1, pad->hasFF, &pad->fd)<0){
+            fprintf(stderr,"[GammaPad] create_virtual_controller for '%s' => failed.\n", dev->path);
+            gp_device_free(dev);     /* never captured => slot can be reused */
+            continue;
+        }
+        gp_pad_attach_source(pad, dev);
+        if(pad->hasFF) g_physicalFd= dev->fd;
+        g_padCount++;
     }
+    if(g_padCount==0){
+        struct GpPad* pad= &g_pads[0];
+        memset(pad,0,sizeof(*pad));
+        pad->hasFF= 1;
+        if(create_virtual_controller(NULL, 0, 1, &pad->fd)<0){
+            fprintf(stderr,"[GammaPad] create_virtual_controller => failed.\n");
+            gp_log_stop();
+            return 1;
+        }
+        g_padCount= 1;
+    }
+    controllerFd= g_pads[0].fd;
+
+    if(ff_backend_start(ffBackend, &vibCfg)<0){
+        fprintf(stderr,"[GammaPad] Haptics backend unavailable => rumble disabled.\n");
+    }
+
     if(create_virtual_mouse(&mouseFd)<0){
         fprintf(stderr,"[GammaPad] create_virtual_mouse => failed.\n");
-        destroy_virtual_device(controllerFd);
+        close_all_devices();
+        destroy_all_pads();
+        gp_log_stop();
         return 1;
     }
-    fprintf(stderr,"GammaPad Virtual Controller (fd=%d)\n", controllerFd);
+    for(int i=0; i<g_padCount; i++){
+        fprintf(stderr,"GammaPad Virtual Controller #%d (fd=%d)\n", i, g_pads[i].fd);
+    }
     fprintf(stderr,"GammaPad Virtual Mouse       (fd=%d)\n", mouseFd);
 
     /*
-     * Step 3: remove the node from /dev/input if we have a real device.
+     * Step 3: remove the nodes from /dev/input for every captured device.
      */
-    if(g_physicalFd>=0 && argc>1){
-        char rmCmd[300];
-        snprintf(rmCmd,sizeof(rmCmd), "rm -f '%s'", argv[1]);
-        fprintf(stderr,"[GammaPad] Removing node with: %s\n", rmCmd);
-        system(rmCmd);
-        fprintf(stderr,"[GammaPad] Removed node: %s\n", argv[1]);
-        fprintf(stderr,"[GammaPad] Capturing input from '%s'.\n", argv[1]);
+    for(int i=0; i<gp_device_count(); i++){
+        struct GpDevice* dev= gp_device_at(i);
+        if(dev->fd<0) continue;
+        fprintf(stderr,"[GammaPad] Removing node '%s'.\n", dev->path);
+        if(unlink(dev->path)<0 && errno!=ENOENT){
+            fprintf(stderr,"[GammaPad] unlink '%s' => %s\n", dev->path, strerror(errno));
+        }
+        fprintf(stderr,"[GammaPad] Capturing input from '%s'.\n", dev->path);
     }
 
     /*
-     * Step 4: set up epoll for the virtual pad, the physical device, and stdin
+     * Step 4: set up epoll for the FF pad, every physical device, stdin
+     * and the timer. data.ptr => GpPollSource, so dispatch is O(1).
      */
-    int epfd= epoll_create1(0);
-    if(epfd<0){
+    g_epfd= epoll_create1(0);
+    if(g_epfd<0){
         perror("epoll_create1");
-        if(g_physicalFd>=0){
-            ioctl(g_physicalFd, EVIOCGRAB, 0);
-            close(g_physicalFd);
-        }
+        close_all_devices();
         destroy_virtual_device(mouseFd);
-        destroy_virtual_device(controllerFd);
+        destroy_all_pads();
+        gp_log_stop();
         return 1;
     }
-    add_epoll_fd(epfd, controllerFd);
-    if(g_physicalFd>=0){
-        add_epoll_fd(epfd, g_physicalFd);
+    init_poll_source(&g_controllerSrc, controllerFd, onControllerFdEvent, NULL);
+    add_epoll_source(g_epfd, &g_controllerSrc);
+    for(int i=0; i<gp_device_count(); i++){
+        struct GpDevice* dev= gp_device_at(i);
+        if(dev->fd<0) continue;
+        init_poll_source(&dev->pollSrc, dev->fd, onPhysicalDeviceEvent, dev);
+        add_epoll_source(g_epfd, &dev->pollSrc);
+    }
+    init_poll_source(&g_stdinSrc, STDIN_FILENO, onStdinEvent, NULL);
+    add_epoll_source(g_epfd, &g_stdinSrc);
+    init_poll_source(&g_timerSrc, gp_timer_fd(), onTimerEvent, NULL);
+    add_epoll_source(g_epfd, &g_timerSrc);
+    init_poll_source(&g_hotplugSrc, gp_hotplug_fd(), onHotplugEvent, NULL);
+    add_epoll_source(g_epfd, &g_hotplugSrc);
+    if(metricsPath && *metricsPath){
+        int fd= gp_metrics_listen(metricsPath);
+        if(fd<0){
+            fprintf(stderr,"[GammaPad] metrics socket '%s' => %s\n", metricsPath, strerror(errno));
+        } else {
+            init_poll_source(&g_metricsSrc, fd, onMetricsEvent, NULL);
+            add_epoll_source(g_epfd, &g_metricsSrc);
+        }
     }
-    add_epoll_fd(epfd, STDIN_FILENO);
+    g_running= 1;
+    /* Anything that appeared while we were setting up. */
+    gp_hotplug_dispatch();
 
     fprintf(stderr,
         "=== GAMMAPAD COMMANDS ===\n"
         " press <button> [ms]\n"
         " push <axis> <value> [ms]\n"
+        " log <capture|fwd|ff|cmd|all> <off|error|warn|info|debug>\n"
+        " trace <on|off|reset|stats|dump FILE>\n"
+        " calibrate <start|save|cancel|status>\n"
         " exit\n\n"
         "Buttons:\n"
         "   up, down, left, right,\n"
@@ -336,42 +770,43 @@ int main(int argc, char** argv)
     struct epoll_event events[EPOLL_MAX_EVENTS];
 
     while(!g_shouldExit){
-        checkEventTimeouts();
-        int n= epoll_wait(epfd, events, EPOLL_MAX_EVENTS, 500);
+        /* No timeout: timed releases arrive through the timerfd. */
+        int n= epoll_wait(g_epfd, events, EPOLL_MAX_EVENTS, -1);
+        g_gpMetrics.epollWakeups++;
         if(n<0){
             if(errno==EINTR) continue;
             perror("epoll_wait");
             break;
         }
         for(int i=0; i<n; i++){
-            int fd= events[i].data.fd;
-            if(fd==controllerFd){
-                if(events[i].events & EPOLLIN){
-                    processControllerFdEvent();
-                }
-            } else if(fd==STDIN_FILENO){
-                if(events[i].events & EPOLLIN){
-                    processStdinEvent();
-                }
-            } else if(fd==g_physicalFd){
-                if(events[i].events & EPOLLIN){
-                    processPhysicalDeviceEvent(g_physicalFd);
-                }
-            }
+            struct GpPollSource* src= (struct GpPollSource*)events[i].data.ptr;
+            src->onEvent(src, events[i].events);
         }
     }
 
-    close(epfd);
+    close(g_epfd);
+    g_epfd= -1;
+    gp_metrics_close();
+    gp_hotplug_shutdown();
+    ff_backend_stop();
 
-    if(g_physicalFd>=0){
-        ioctl(g_physicalFd,EVIOCGRAB,0);
-        close(g_physicalFd);
-        g_physicalFd=-1;
-    }
+    close_all_devices();
 
     destroy_virtual_device(mouseFd);
-    destroy_virtual_device(controllerFd);
+    destroy_all_pads();
+
+    /* Give the physical nodes back: returns as soon as every rebind is done. */
+    gp_capture_release_all(GP_RELEASE_TIMEOUT_MS);
+    gp_timer_shutdown();
+    gp_record_close();
+    if(trace){
+        gp_trace_print(stderr);
+        if(tracePath && gp_trace_dump(tracePath)<0){
+            fprintf(stderr,"[GammaPad] trace dump '%s' => %s\n", tracePath, strerror(errno));
+        }
+    }
 
     fprintf(stderr,"[GammaPad] Exiting.\n");
+    gp_log_stop();
     return 0;
 }
@@ -0,0 +1,201 @@
+/*****************************************************
+ * gammapad_metrics.c
+ *
+ * Main-loop counters + the snapshot socket.
+ * See gammapad_metrics.h.
+ *****************************************************/
+
+#define _GNU_SOURCE  /* accept4 */
+#include "gammapad_metrics.h"
+#include "gammapad_capture.h"
+#include "gammapad_haptics.h"
+#include "gammapad_timer.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define METRICS_BUFFER (16 * 1024)
+
+struct GpMetrics g_gpMetrics;
+
+static int  g_listenFd = -1;
+static char g_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+static unsigned long long g_startNs;
+static unsigned long long g_lastNs;         /* previous snapshot, for the rates */
+static unsigned long long g_lastWakeups;
+
+int gp_metrics_listen(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    size_t len = strlen(path);
+    if (!len || len >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(addr.sun_path, path, len);
+
+    socklen_t addrLen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+    if (path[0] == '@') {
+        addr.sun_path[0] = 0;       /* abstract: nothing on the filesystem */
+    } else {
+        addrLen = sizeof(addr);
+        unlink(path);               /* left over from a previous run */
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr*)&addr, addrLen) < 0 || listen(fd, 4) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    snprintf(g_path, sizeof(g_path), "%s", path);
+    g_listenFd = fd;
+    g_startNs = g_lastNs = getMonotonicNs();
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Metrics] serving snapshots on '%s'.\n", path);
+    return fd;
+}
+
+void gp_metrics_close(void)
+{
+    if (g_listenFd < 0) return;
+    close(g_listenFd);
+    g_listenFd = -1;
+    if (g_path[0] && g_path[0] != '@') unlink(g_path);
+}
+
+/* Appends to the snapshot; output past the end of the buffer is dropped. */
+struct Out {
+    char*  buf;
+    size_t len;
+    size_t pos;
+};
+
+static void put(struct Out* o, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void put(struct Out* o, const char* fmt, ...)
+{
+    if (o->pos + 1 >= o->len) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->pos, o->len - o->pos, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    o->pos += (size_t)n;
+    if (o->pos >= o->len) o->pos = o->len - 1;
+}
+
+/*
+ * labelValue => 'src' as a label value: backslash, double quote and
+ * newline escaped, as the exposition format wants. Truncated to fit.
+ */
+static const char* labelValue(char* dst, size_t len, const char* src)
+{
+    size_t n = 0;
+    for (; *src && n + 2 < len; src++) {
+        char c = *src;
+        if (c == '\\' || c == '"' || c == '\n') {
+            dst[n++] = '\\';
+            c = c == '\n' ? 'n' : c;
+        }
+        dst[n++] = c;
+    }
+    dst[n] = 0;
+    return dst;
+}
+
+size_t gp_metrics_snapshot(char* buf, size_t len)
+{
+    struct Out o = { buf, len, 0 };
+    if (!len) return 0;
+    buf[0] = 0;
+
+    unsigned long long now = getMonotonicNs();
+    if (!g_startNs) g_startNs = g_lastNs = now;
+    double since = (double)(now - g_lastNs) / 1e9;
+    double rate  = since > 0 ? (double)(g_gpMetrics.epollWakeups - g_lastWakeups) / since : 0.0;
+    g_lastNs      = now;
+    g_lastWakeups = g_gpMetrics.epollWakeups;
+
+    struct GpCaptureStats st;
+    gp_capture_stats(&st);
+
+    put(&o, "gammapad_uptime_seconds %.3f\n", (double)(now - g_startNs) / 1e9);
+    put(&o, "gammapad_epoll_wakeups_total %llu\n", g_gpMetrics.epollWakeups);
+    put(&o, "gammapad_epoll_wakeups_per_second %.1f\n", rate);
+    put(&o, "gammapad_read_syscalls_total %llu\n", st.reads);
+    put(&o, "gammapad_write_syscalls_total %llu\n", st.writes);
+    put(&o, "gammapad_ff_uploads_total %llu\n", g_gpMetrics.ffUploads);
+    put(&o, "gammapad_ff_erases_total %llu\n", g_gpMetrics.ffErases);
+    put(&o, "gammapad_ff_plays_total %llu\n", g_gpMetrics.ffPlays);
+    put(&o, "gammapad_ff_stops_total %llu\n", g_gpMetrics.ffStops);
+    put(&o, "gammapad_haptics_commands_total %lu\n", gp_haptics_applied());
+    put(&o, "gammapad_haptics_dropped_total %lu\n", gp_haptics_dropped());
+    put(&o, "gammapad_haptics_kicks_total %lu\n", gp_haptics_kicks());
+    put(&o, "gammapad_hotplug_attach_total %llu\n", g_gpMetrics.hotplugAttach);
+    put(&o, "gammapad_hotplug_detach_total %llu\n", g_gpMetrics.hotplugDetach);
+    put(&o, "gammapad_log_dropped_total %llu\n", gp_log_dropped());
+    put(&o, "gammapad_timers_pending %d\n", gp_timer_pending());
+    put(&o, "gammapad_timer_add_failed_total %lu\n", gp_timer_add_failed());
+
+    /* Pads are numbered in the order their first device appears. */
+    const struct GpPad* pads[GP_MAX_DEVICES];
+    int padCount = 0;
+    for (int i = 0; i < gp_device_count(); i++) {
+        const struct GpDevice* dev = gp_device_at(i);
+        const struct GpDeviceCounters* c = &dev->counters;
+        int pad = -1;
+        for (int p = 0; p < padCount && dev->pad; p++) {
+            if (pads[p] == dev->pad) pad = p;
+        }
+        if (pad < 0 && dev->pad && padCount < GP_MAX_DEVICES) {
+            pad = padCount;
+            pads[padCount++] = dev->pad;
+        }
+
+        char path[2 * sizeof(dev->path)], labels[sizeof(path) + 64];
+        snprintf(labels, sizeof(labels), "device=\"%d\",path=\"%s\",pad=\"%d\"", dev->index,
+                 labelValue(path, sizeof(path), dev->path), pad);
+        put(&o, "gammapad_device_open{%s} %d\n", labels, dev->fd >= 0);
+        put(&o, "gammapad_device_reads_total{%s} %llu\n", labels, c->reads);
+        put(&o, "gammapad_device_events_read_total{%s} %llu\n", labels, c->eventsIn);
+        put(&o, "gammapad_device_dropped_unmapped_total{%s} %llu\n", labels, c->unmapped);
+        put(&o, "gammapad_device_dropped_overrun_total{%s} %llu\n", labels, c->overrun);
+        put(&o, "gammapad_device_filtered_total{%s} %llu\n", labels, c->filtered);
+    }
+    for (int p = 0; p < padCount; p++) {
+        const struct GpPadCounters* c = &pads[p]->counters;
+        put(&o, "gammapad_pad_frames_total{pad=\"%d\"} %llu\n", p, c->frames);
+        put(&o, "gammapad_pad_events_written_total{pad=\"%d\"} %llu\n", p, c->eventsOut);
+        put(&o, "gammapad_pad_events_coalesced_total{pad=\"%d\"} %llu\n", p, c->coalesced);
+        put(&o, "gammapad_pad_rate_held_total{pad=\"%d\"} %llu\n", p, c->rateHeld);
+        put(&o, "gammapad_pad_dropped_eagain_total{pad=\"%d\"} %llu\n", p, c->writeEagain);
+        put(&o, "gammapad_pad_dropped_error_total{pad=\"%d\"} %llu\n", p, c->writeErrors);
+    }
+    return o.pos;
+}
+
+void gp_metrics_serve(void)
+{
+    static char buf[METRICS_BUFFER];
+
+    for (;;) {
+        int fd = accept4(g_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;                 /* EAGAIN => all answered */
+        }
+        size_t len = gp_metrics_snapshot(buf, sizeof(buf));
+        /* Fits the socket buffer; a client that is not reading just gets less. */
+        if (send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_DEBUG, "[Metrics] send => %s\n", strerror(errno));
+        }
+        close(fd);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef GAMMAPAD_METRICS_H
+#define GAMMAPAD_METRICS_H
+
+#include "gammapad.h"
+
+/*
+ * gammapad_metrics.h
+ *
+ * Runtime counters, and a snapshot of them served on a Unix socket.
+ *
+ * Counters live with the thread that bumps them and are plain increments:
+ *   - main loop:      GpMetrics below (wakeups, FF requests, hotplug),
+ *                     gp_timer_add_failed() (gammapad_timer)
+ *   - forwarding:     GpDevice.counters / GpPad.counters (gammapad_capture)
+ *   - haptics worker: gp_haptics_applied/dropped/kicks() (relaxed atomics)
+ * The snapshot is built on the main thread, so only the worker's counters
+ * are read across threads.
+ *
+ * The socket (--metrics=PATH, '@name' for the abstract namespace) writes
+ * one snapshot to each client that connects and closes the connection:
+ *   socat - UNIX-CONNECT:/data/local/tmp/gammapad.sock
+ * Format: Prometheus text exposition, one "name{labels} value" per line.
+ */
+
+struct GpMetrics {
+    unsigned long long epollWakeups;    /* epoll_wait() returns in the main loop */
+    unsigned long long ffUploads;
+    unsigned long long ffErases;
+    unsigned long long ffPlays;
+    unsigned long long ffStops;
+    unsigned long long hotplugAttach;   /* devices captured or reattached while running */
+    unsigned long long hotplugDetach;   /* devices that went away */
+};
+
+extern struct GpMetrics g_gpMetrics;
+
+/* Listening socket for the main loop's epoll set, or -1. */
+int  gp_metrics_listen(const char* path);
+void gp_metrics_close(void);
+
+/* Listening socket readable => answer every pending client. */
+void gp_metrics_serve(void);
+
+/* Write the snapshot into buf (always terminated). Returns its length. */
+size_t gp_metrics_snapshot(char* buf, size_t len);
+
+#endif /* GAMMAPAD_METRICS_H */
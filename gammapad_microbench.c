@@ -0,0 +1,726 @@
+/*****************************************************
+ * gammapad_microbench.c
+ *
+ * Per-call cost of the hot functions (make bench).
+ *
+ * Every benchmark calls the real function from its module in a tight
+ * loop; nothing is copied or reimplemented here:
+ *   forward_event   => forward_physical_event(), one ABS event (routed and
+ *                      merged into the pad frame, no flush)
+ *   forward_frame   => forward_physical_event(), ABS_X + ABS_Y + key +
+ *                      SYN_REPORT, flushed to /dev/null (includes write())
+ *   forward_idle    => forward_physical_event(), ABS_X + ABS_Y jitter of a
+ *                      stick at rest + SYN_REPORT through a radial dead zone
+ *                      (gammapad_filter), so nothing is written
+ *   forward_calib   => forward_event through a calibrated axis with an
+ *                      expo curve (gammapad_calib lookup + interpolation)
+ *   parse_command   => parseCommand() on press/push/log lines
+ *   kl_line         => parseKeyLayoutLine() on key/axis lines
+ *   store_effect    => storeUploadedEffect(), rumble and periodic (the
+ *                      haptics worker is not running, so nothing is queued)
+ *   axis_collisions => resolveAxisCollisions() on a pad with the usual
+ *                      trigger collisions
+ *   key_scan        => scanKeyBits(), the discoverKeys() bitmap walk
+ *   route_build     => gp_route_table_build() for that pad
+ *   filter_N        => gp_filter_hold() + gp_filter_frame() for N stick
+ *                      axes that all move every frame, per frame, with
+ *                      the kernel gammapad_filter picks for N (SIMD from
+ *                      GP_FILTER_SIMD_MIN_AXES on)
+ *   filter_16_scalar => filter_16 through the scalar kernel
+ * With --evdev=PATH, also discover_keys / discover_axes: the real ioctl
+ * scans on a live node.
+ *
+ * Each benchmark doubles its iteration count until one run takes at least
+ * MB_MIN_RUN_NS, then takes MB_SAMPLES runs of that length and reports the
+ * best and the median ns/op. The best run is what gets compared: on a
+ * busy device the median moves by tens of percent, the best barely does.
+ *
+ * --check runs the correctness checks instead (make check), exit code 1
+ * if any fails:
+ *   ff_full_scale   => full-scale FF_CONSTANT / FF_PERIODIC mix as strong
+ *                      as a full FF_RUMBLE (gp_ffmix_compile scaling)
+ *   filter_simd     => the SIMD axis filter kernel emits what the scalar
+ *                      one does, frame for frame, on random input through
+ *                      sticks, triggers, plain axes and hysteresis
+ *
+ * Usage: gammapad_microbench [--filter=SUBSTR] [--evdev=PATH]
+ *                            [--baseline=FILE] [--save-baseline=FILE]
+ *        gammapad_microbench --check
+ *   --baseline      => a best run more than MB_SLACK_PCT % and MB_SLACK_NS
+ *                      slower than the baseline is a regression; exit code 2
+ *   --save-baseline => write this run's best times (same format)
+ *****************************************************/
+
+#include "gammapad.h"
+#include "gammapad_capture.h"
+#include "gammapad_route.h"
+#include "gammapad_ffmix.h"
+#include <time.h>
+
+#define MB_MIN_RUN_NS  20000000ULL      /* 20 ms per sample */
+#define MB_SAMPLES     7
+#define MB_SLACK_PCT   20
+#define MB_SLACK_NS    5.0
+
+/* gammapad_commands.c / gammapad_ff.c expect these from gammapad_main.c. */
+int g_physicalFd = -1;
+static unsigned long g_scheduled;
+
+void scheduleEvent(int code, int isKey, int value, unsigned long long durationMs)
+{
+    (void)code; (void)isKey; (void)value; (void)durationMs;
+    g_scheduled++;
+}
+
+extern void parseCommand(const char* line);
+extern void storeUploadedEffect(struct ff_effect* eff);
+
+struct MicroBench {
+    const char* name;
+    int  (*setup)(void);            /* NULL => nothing to prepare; <0 => skip */
+    void (*run)(unsigned long iters);
+};
+
+struct MicroResult {
+    const char* name;
+    double bestNs;
+    double medianNs;
+};
+
+static struct MicroResult g_results[32];
+static int g_resultCount;
+static const char* g_evdevPath;
+
+static unsigned long long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/* --- forwarding --- */
+
+static struct GpDevice* g_fwdDev;
+static struct GpPad     g_fwdPad;
+static struct GpDevice* g_idleDev;
+static struct GpPad     g_idlePad;
+static struct GpDevice* g_calDev;
+static struct GpPad     g_calPad;
+
+static int openForward(struct GpDevice** dev, struct GpPad* pad, const char* const* profile, int profileCount)
+{
+    static const __u16 keys[] = { BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_START, BTN_SELECT };
+    static const __u16 axes[] = { ABS_X, ABS_Y, ABS_RX, ABS_RY };
+    if (*dev) return 0;
+
+    /* The source pipe is never written: the events go straight in. */
+    int src[2];
+    if (pipe(src) < 0 || !(*dev = gp_device_alloc())) return -1;
+    struct GpStreamCaps caps = {
+        .name = "microbench", .keys = keys, .keyCount = (int)(sizeof(keys) / sizeof(keys[0])),
+        .axes = axes, .axisCount = (int)(sizeof(axes) / sizeof(axes[0])),
+        .absMin = -32768, .absMax = 32767,
+        .profile = profile, .profileCount = profileCount,
+    };
+    if (gp_device_open_stream(*dev, src[0], &caps) < 0) return -1;
+
+    memset(pad, 0, sizeof(*pad));
+    pad->fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (pad->fd < 0) return -1;
+    return gp_pad_attach_source(pad, *dev);
+}
+
+static int setupForward(void)
+{
+    return openForward(&g_fwdDev, &g_fwdPad, NULL, 0);
+}
+
+static int setupIdle(void)
+{
+    static const char* const profile[] = { "stick ABS_X ABS_Y inner=6 outer=95 hysteresis=0.5" };
+    return openForward(&g_idleDev, &g_idlePad, profile, 1);
+}
+
+static int setupCalib(void)
+{
+    static const char* const profile[] = {
+        "calib ABS_X min=-32768 center=-150 max=32767",
+        "curve ABS_X expo=40",
+    };
+    return openForward(&g_calDev, &g_calPad, profile, 2);
+}
+
+static void setEvent(struct input_event* ev, __u16 type, __u16 code, __s32 value)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->type  = type;
+    ev->code  = code;
+    ev->value = value;
+}
+
+static void runForwardEvent(unsigned long iters)
+{
+    struct input_event ev;
+    setEvent(&ev, EV_ABS, ABS_X, 0);
+    for (unsigned long i = 0; i < iters; i++) {
+        ev.value = (__s32)(i & 0x7fff);     /* changes every call, like a moving stick */
+        forward_physical_event(g_fwdDev, &ev);
+    }
+}
+
+static void runForwardFrame(unsigned long iters)
+{
+    struct input_event evs[4];
+    setEvent(&evs[0], EV_ABS, ABS_X, 0);
+    setEvent(&evs[1], EV_ABS, ABS_Y, 0);
+    setEvent(&evs[2], EV_KEY, BTN_SOUTH, 0);
+    setEvent(&evs[3], EV_SYN, SYN_REPORT, 0);
+    for (unsigned long i = 0; i < iters; i++) {
+        evs[0].value = (__s32)(i & 0x7fff);
+        evs[1].value = -evs[0].value;
+        evs[2].value = (__s32)(i & 1);
+        for (int k = 0; k < 4; k++) forward_physical_event(g_fwdDev, &evs[k]);
+    }
+}
+
+static void runForwardCalib(unsigned long iters)
+{
+    struct input_event ev;
+    setEvent(&ev, EV_ABS, ABS_X, 0);
+    for (unsigned long i = 0; i < iters; i++) {
+        ev.value = (__s32)(i & 0xffff) - 32768;
+        forward_physical_event(g_calDev, &ev);
+    }
+}
+
+static void runForwardIdle(unsigned long iters)
+{
+    struct input_event evs[3];
+    setEvent(&evs[0], EV_ABS, ABS_X, 0);
+    setEvent(&evs[1], EV_ABS, ABS_Y, 0);
+    setEvent(&evs[2], EV_SYN, SYN_REPORT, 0);
+    for (unsigned long i = 0; i < iters; i++) {
+        evs[0].value = (__s32)(i * 7 % 601) - 300;     /* ~1% ADC noise around center */
+        evs[1].value = (__s32)(i * 13 % 601) - 300;
+        for (int k = 0; k < 3; k++) forward_physical_event(g_idleDev, &evs[k]);
+    }
+}
+
+/* --- console --- */
+
+static void runParseCommand(unsigned long iters)
+{
+    static const char* const lines[] = {
+        "press a 100", "press volumeup", "push abs_x 100 50", "push abs_brake 255", "log fwd warn",
+    };
+    for (unsigned long i = 0; i < iters; i++) {
+        parseCommand(lines[i % (sizeof(lines) / sizeof(lines[0]))]);
+    }
+}
+
+/* --- FF upload --- */
+
+static void runStoreEffect(unsigned long iters)
+{
+    struct ff_effect effs[2];
+    memset(effs, 0, sizeof(effs));
+    effs[0].type = FF_RUMBLE;
+    effs[0].id   = 0;
+    effs[0].replay.length = 200;
+    effs[0].u.rumble.strong_magnitude = 0xc000;
+    effs[0].u.rumble.weak_magnitude   = 0x4000;
+    effs[1].type = FF_PERIODIC;
+    effs[1].id   = 1;
+    effs[1].replay.length = 500;
+    effs[1].u.periodic.waveform  = FF_SINE;
+    effs[1].u.periodic.period    = 50;
+    effs[1].u.periodic.magnitude = 0x6000;
+    effs[1].u.periodic.envelope.attack_length = 100;
+    effs[1].u.periodic.envelope.fade_length   = 100;
+    for (unsigned long i = 0; i < iters; i++) {
+        storeUploadedEffect(&effs[i & 1]);
+    }
+}
+
+/* --- startup --- */
+
+static struct GpRouteBuilder g_builder;
+
+static void runKeyLayoutLine(unsigned long iters)
+{
+    static const char* const lines[] = {
+        "key 304   BUTTON_A", "key 0x131 BUTTON_B", "key 315   BUTTON_START",
+        "axis 0x00 X", "axis 0x05 RTRIGGER", "axis 0x10 HAT_X flat 0",
+    };
+    for (unsigned long i = 0; i < iters; i++) {
+        parseKeyLayoutLine(&g_builder, lines[i % (sizeof(lines) / sizeof(lines[0]))]);
+    }
+}
+
+/*
+ * A retro handheld layout: sticks on X/Y and RX/RY, analog triggers on
+ * Z/RZ plus digital ones on GAS/BRAKE remapped onto the same axes, hat.
+ */
+static struct GpDevice      g_axisDev;
+static struct GpRouteBuilder g_axisBuilder;
+static int                   g_axisRules;
+
+static int setupAxes(void)
+{
+    static const __u16 axes[] = { ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ,
+                                  ABS_GAS, ABS_BRAKE, ABS_HAT0X, ABS_HAT0Y };
+    static const __u16 keys[] = { BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_TL, BTN_TR,
+                                  BTN_TL2, BTN_TR2, BTN_SELECT, BTN_START, BTN_MODE,
+                                  BTN_THUMBL, BTN_THUMBR, KEY_VOLUMEUP, KEY_VOLUMEDOWN, KEY_POWER };
+
+    gp_route_builder_reset(&g_axisBuilder);
+    memset(&g_axisDev, 0, sizeof(g_axisDev));
+    for (size_t i = 0; i < sizeof(axes) / sizeof(axes[0]); i++) {
+        gp_set_bit(g_axisBuilder.absBits, axes[i]);
+        g_axisDev.absMin[axes[i]] = axes[i] >= ABS_HAT0X ? -1 : 0;
+        g_axisDev.absMax[axes[i]] = axes[i] >= ABS_HAT0X ? 1 : 4095;
+    }
+    g_axisDev.absMax[ABS_GAS] = g_axisDev.absMax[ABS_BRAKE] = 1;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        gp_set_bit(g_axisBuilder.keyBits, keys[i]);
+    }
+    gp_route_builder_set(&g_axisBuilder, EV_ABS, ABS_GAS,   GP_ROUTE_ABS, ABS_RZ, 0);
+    gp_route_builder_set(&g_axisBuilder, EV_ABS, ABS_BRAKE, GP_ROUTE_ABS, ABS_Z,  0);
+    gp_route_builder_set(&g_axisBuilder, EV_ABS, ABS_RX,    GP_ROUTE_ABS, ABS_Z,  0);
+    g_axisRules = g_axisBuilder.ruleCount;
+    return 0;
+}
+
+static void runAxisCollisions(unsigned long iters)
+{
+    struct GpRoute saved[8];
+    memcpy(saved, g_axisBuilder.rules, (size_t)g_axisRules * sizeof(saved[0]));
+    for (unsigned long i = 0; i < iters; i++) {
+        /* Undo the previous call's drops so every call resolves the same collisions. */
+        memcpy(g_axisBuilder.rules, saved, (size_t)g_axisRules * sizeof(saved[0]));
+        g_axisBuilder.ruleCount = g_axisRules;
+        resolveAxisCollisions(&g_axisDev, &g_axisBuilder);
+    }
+}
+
+static void runKeyScan(unsigned long iters)
+{
+    static struct GpRouteBuilder b;
+    for (unsigned long i = 0; i < iters; i++) {
+        scanKeyBits(&b, g_axisBuilder.keyBits);
+    }
+}
+
+static void runRouteBuild(unsigned long iters)
+{
+    struct GpRouteTable t;
+    memset(&t, 0, sizeof(t));
+    for (unsigned long i = 0; i < iters; i++) {
+        gp_route_table_build(&t, &g_axisBuilder);
+    }
+    gp_route_table_free(&t);
+}
+
+/* --- axis filter (gammapad_filter) --- */
+
+static struct GpFilter g_filter;
+static int             g_filterAxes;
+
+/* 'axes' codes 0.. as axes/2 sticks, like a pad with that many analog inputs. */
+static int setupFilter(int axes)
+{
+    static int absMin[ABS_MAX + 1], absMax[ABS_MAX + 1];
+    struct GpFilterRule rules[GP_FILTER_MAX_AXES / 2];
+    int count = 0;
+
+    for (int c = 0; c < axes; c++) {
+        absMin[c] = -32768;
+        absMax[c] = 32767;
+    }
+    for (int c = 0; c < axes; c += 2) {
+        struct GpFilterRule r = { .code = (__u16)c, .pair = (__u16)(c + 1),
+                                  .inner = 0.06f, .outer = 0.95f, .hysteresis = 0.005f };
+        if (gp_filter_rule_set(rules, &count, &r) < 0) return -1;
+    }
+    g_filterAxes = axes;
+    return gp_filter_build(&g_filter, rules, count, absMin, absMax) == axes ? 0 : -1;
+}
+
+static int setupFilter2(void)  { return setupFilter(2); }
+static int setupFilter4(void)  { return setupFilter(4); }
+static int setupFilter8(void)  { return setupFilter(8); }
+static int setupFilter16(void) { return setupFilter(16); }
+
+static void runFilterFrame(unsigned long iters)
+{
+    struct GpFilterOut out[GP_FILTER_MAX_AXES];
+    for (unsigned long i = 0; i < iters; i++) {
+        __s32 v = (__s32)(i * 2749 % 60001) - 30000;   /* sweeps the range, beyond the hysteresis */
+        for (int c = 0; c < g_filterAxes; c++) gp_filter_hold(&g_filter, (unsigned int)c, c & 1 ? -v : v);
+        gp_filter_frame(&g_filter, out);
+    }
+}
+
+static void runFilterScalar(unsigned long iters)
+{
+    gp_filter_use_simd(0);
+    runFilterFrame(iters);
+    gp_filter_use_simd(1);
+}
+
+/* --- live node (--evdev) --- */
+
+static struct GpDevice g_evdev = { .fd = -1 };
+
+static int setupEvdev(void)
+{
+    if (!g_evdevPath) return -1;
+    if (g_evdev.fd >= 0) return 0;
+    g_evdev.fd = open(g_evdevPath, O_RDONLY | O_CLOEXEC);
+    if (g_evdev.fd < 0) {
+        fprintf(stderr, "[Bench] '%s' => %s\n", g_evdevPath, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void runDiscoverKeys(unsigned long iters)
+{
+    static struct GpRouteBuilder b;
+    for (unsigned long i = 0; i < iters; i++) discoverKeys(&g_evdev, &b);
+}
+
+static void runDiscoverAxes(unsigned long iters)
+{
+    static struct GpRouteBuilder b;
+    for (unsigned long i = 0; i < iters; i++) discoverAxes(&g_evdev, &b);
+}
+
+static const struct MicroBench g_benches[] = {
+    { "forward_event",    setupForward,  runForwardEvent },
+    { "forward_frame",    setupForward,  runForwardFrame },
+    { "forward_idle",     setupIdle,     runForwardIdle },
+    { "forward_calib",    setupCalib,    runForwardCalib },
+    { "parse_command",    NULL,          runParseCommand },
+    { "kl_line",          NULL,          runKeyLayoutLine },
+    { "store_effect",     NULL,          runStoreEffect },
+    { "axis_collisions",  setupAxes,     runAxisCollisions },
+    { "key_scan",         setupAxes,     runKeyScan },
+    { "route_build",      setupAxes,     runRouteBuild },
+    { "filter_2",         setupFilter2,  runFilterFrame },
+    { "filter_4",         setupFilter4,  runFilterFrame },
+    { "filter_8",         setupFilter8,  runFilterFrame },
+    { "filter_16",        setupFilter16, runFilterFrame },
+    { "filter_16_scalar", setupFilter16, runFilterScalar },
+    { "discover_keys",    setupEvdev,    runDiscoverKeys },
+    { "discover_axes",    setupEvdev,    runDiscoverAxes },
+};
+
+/* --- checks (--check) --- */
+
+/* mixedLevel => strong channel of 'p' playing alone, 'atMs' into it. */
+static unsigned int mixedLevel(const struct GpFfParams* p, unsigned int atMs)
+{
+    struct GpFfMixer m;
+    unsigned int level[GP_FF_CHANNELS];
+    unsigned long long next;
+    gp_ffmix_init(&m, GP_FF_MIX_SUM);
+    gp_ffmix_play(&m, 0, p, 1, 0);
+    gp_ffmix_level(&m, (unsigned long long)atMs * 1000000ULL, level, &next);
+    return level[GP_FF_STRONG];
+}
+
+static int checkFfFullScale(void)
+{
+    struct GpFfParams rumble;
+    memset(&rumble, 0, sizeof(rumble));
+    rumble.magnitude[GP_FF_STRONG] = rumble.magnitude[GP_FF_WEAK] = 0xffff;
+    unsigned int full = mixedLevel(&rumble, 1);
+
+    /* Compiled the way storeUploadedEffect() does it. */
+    struct ff_effect eff;
+    struct GpFfParams p;
+    memset(&eff, 0, sizeof(eff));
+    memset(&p, 0, sizeof(p));
+    eff.type = FF_CONSTANT;
+    eff.u.constant.level = 0x7fff;
+    gp_ffmix_compile(&eff, &p);
+    p.magnitude[GP_FF_STRONG] = p.magnitude[GP_FF_WEAK] = p.shape.hold;
+    unsigned int constant = mixedLevel(&p, 1);
+
+    memset(&eff, 0, sizeof(eff));
+    memset(&p, 0, sizeof(p));
+    eff.type = FF_PERIODIC;
+    eff.replay.length = 1000;
+    eff.u.periodic.waveform  = FF_SQUARE;
+    eff.u.periodic.period    = 100;
+    eff.u.periodic.magnitude = 0x7fff;
+    gp_ffmix_compile(&eff, &p);
+    p.magnitude[GP_FF_STRONG] = p.magnitude[GP_FF_WEAK] = p.shape.hold;
+    unsigned int crest = mixedLevel(&p, 10);    /* first half of the period */
+
+    printf("[Check] ff_full_scale: rumble=%u constant=%u periodic crest=%u\n", full, constant, crest);
+    return (full == 0xffff && constant == full && crest == full) ? 0 : -1;
+}
+
+/*
+ * A pad with every kind of lane: three sticks on different ranges, four
+ * triggers and three plain axes (13 lanes, so the last SIMD group has
+ * inert lanes too), with and without hysteresis. GAS and RUDDER put the
+ * dead zone edges on exact raw values, to catch a < that should be <=.
+ */
+static int buildMixedFilter(struct GpFilter* f)
+{
+    static int absMin[ABS_MAX + 1], absMax[ABS_MAX + 1];
+    static const struct GpFilterRule mixed[] = {
+        { .code = ABS_X,  .pair = ABS_Y,  .inner = 0.06f, .outer = 0.95f, .hysteresis = 0.01f },
+        { .code = ABS_RX, .pair = ABS_RY, .inner = 0.10f, .outer = 0.90f },
+        { .code = ABS_TILT_X, .pair = ABS_TILT_Y, .inner = 0.0f, .outer = 1.0f, .hysteresis = 0.03f },
+        { .code = ABS_Z,     .pair = GP_FILTER_NO_PAIR, .inner = 0.05f, .outer = 0.98f, .trigger = 1 },
+        { .code = ABS_RZ,    .pair = GP_FILTER_NO_PAIR, .inner = 0.05f, .outer = 0.98f, .hysteresis = 0.02f, .trigger = 1 },
+        { .code = ABS_GAS,   .pair = GP_FILTER_NO_PAIR, .inner = 0.5f,  .outer = 0.5f, .trigger = 1 },
+        { .code = ABS_BRAKE, .pair = GP_FILTER_NO_PAIR, .inner = 0.0f,  .outer = 0.50f, .hysteresis = 0.05f, .trigger = 1 },
+        { .code = ABS_THROTTLE, .pair = GP_FILTER_NO_PAIR, .inner = 0.08f, .outer = 0.92f },
+        { .code = ABS_RUDDER,   .pair = GP_FILTER_NO_PAIR, .inner = 0.25f, .outer = 0.75f, .hysteresis = 0.01f },
+        { .code = ABS_WHEEL,    .pair = GP_FILTER_NO_PAIR, .inner = 0.15f, .outer = 0.60f },
+    };
+    absMin[ABS_X]  = absMin[ABS_Y]  = -32768; absMax[ABS_X]  = absMax[ABS_Y]  = 32767;
+    absMin[ABS_RX] = absMin[ABS_RY] = 0;      absMax[ABS_RX] = absMax[ABS_RY] = 4095;
+    absMin[ABS_TILT_X] = absMin[ABS_TILT_Y] = -127; absMax[ABS_TILT_X] = absMax[ABS_TILT_Y] = 127;
+    absMin[ABS_Z] = absMin[ABS_RZ] = 0;       absMax[ABS_Z] = absMax[ABS_RZ] = 255;
+    absMin[ABS_GAS] = absMin[ABS_BRAKE] = 0;  absMax[ABS_GAS] = absMax[ABS_BRAKE] = 1000;
+    absMin[ABS_THROTTLE] = -512;  absMax[ABS_THROTTLE] = 511;
+    absMin[ABS_RUDDER]   = -100;  absMax[ABS_RUDDER]   = 100;
+    absMin[ABS_WHEEL]    = 0;     absMax[ABS_WHEEL]    = 65535;
+
+    struct GpFilterRule rules[GP_FILTER_MAX_RULES];
+    int count = 0;
+    for (size_t i = 0; i < sizeof(mixed) / sizeof(mixed[0]); i++) {
+        if (gp_filter_rule_set(rules, &count, &mixed[i]) < 0) return -1;
+    }
+    return gp_filter_build(f, rules, count, absMin, absMax);
+}
+
+static unsigned int g_rng = 0x2545f491u;
+
+static unsigned int nextRandom(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+/* Mostly in range, sometimes exactly min / center / max, sometimes a bit past. */
+static __s32 randomValue(const struct GpFilterLanes* l, int i)
+{
+    __s32 min = l->min[i], max = l->max[i];
+    switch (nextRandom() % 8) {
+    case 0:  return min;
+    case 1:  return max;
+    case 2:  return l->center[i];
+    case 3:  return l->center[i] + (__s32)(nextRandom() % 7) - 3;    /* jitter at rest */
+    case 4:  return (nextRandom() & 1) ? max + (__s32)(nextRandom() % 16) : min - (__s32)(nextRandom() % 16);
+    default: return min + (__s32)(nextRandom() % (unsigned int)(max - min + 1));
+    }
+}
+
+/*
+ * The scalar and the SIMD kernel fed the same frames, on two copies of
+ * the filter: every frame must emit the same axes with the same values.
+ */
+static int checkFilterSimd(void)
+{
+    static struct GpFilter scalar, simd;
+    if (gp_filter_use_simd(1) < 0) {
+        printf("[Check] filter_simd: no SIMD kernel in this build, skipped.\n");
+        return 0;
+    }
+    int axes = buildMixedFilter(&scalar);
+    if (axes < GP_FILTER_SIMD_MIN_AXES) {
+        printf("[Check] filter_simd: %d axes built, need %d.\n", axes, GP_FILTER_SIMD_MIN_AXES);
+        return -1;
+    }
+    simd = scalar;
+
+    enum { FRAMES = 200000 };
+    long emitted = 0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+        /* A random subset moves; a stick axis may move without its partner. */
+        unsigned int moving = nextRandom();
+        for (int i = 0; i < axes; i++) {
+            if (!(moving & (1u << i))) continue;
+            __s32 v = randomValue(&scalar.lanes, i);
+            gp_filter_hold(&scalar, scalar.axes[i].code, v);
+            gp_filter_hold(&simd, simd.axes[i].code, v);
+        }
+        struct GpFilterOut a[GP_FILTER_MAX_AXES], b[GP_FILTER_MAX_AXES];
+        gp_filter_use_simd(0);
+        int na = gp_filter_frame(&scalar, a);
+        gp_filter_use_simd(1);
+        int nb = gp_filter_frame(&simd, b);
+
+        int same = na == nb;
+        for (int k = 0; same && k < na; k++) same = a[k].code == b[k].code && a[k].value == b[k].value;
+        if (!same) {
+            printf("[Check] filter_simd: frame %d differs (%s):\n", frame, gp_filter_kernel());
+            for (int k = 0; k < na; k++) printf("    scalar axis %d => %d\n", a[k].code, a[k].value);
+            for (int k = 0; k < nb; k++) printf("    simd   axis %d => %d\n", b[k].code, b[k].value);
+            return -1;
+        }
+        emitted += na;
+    }
+    printf("[Check] filter_simd: %s == scalar over %d frames, %d axes, %ld outputs\n",
+           gp_filter_kernel(), FRAMES, axes, emitted);
+    return 0;
+}
+
+struct MicroCheck {
+    const char* name;
+    int (*run)(void);               /* 0 => pass */
+};
+
+static const struct MicroCheck g_checks[] = {
+    { "ff_full_scale", checkFfFullScale },
+    { "filter_simd",   checkFilterSimd },
+};
+
+static int runChecks(void)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(g_checks) / sizeof(g_checks[0]); i++) {
+        int bad = g_checks[i].run() != 0;
+        printf("%-10s %s\n", bad ? "FAIL" : "ok", g_checks[i].name);
+        failed += bad;
+    }
+    return failed;
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double timeRun(const struct MicroBench* mb, unsigned long iters)
+{
+    unsigned long long t0 = nowNs();
+    mb->run(iters);
+    return (double)(nowNs() - t0);
+}
+
+static void runBench(const struct MicroBench* mb)
+{
+    /* Calibrate; this also warms caches and the branch predictor. */
+    unsigned long iters = 1;
+    while (timeRun(mb, iters) < (double)MB_MIN_RUN_NS && iters < (1UL << 30)) iters *= 2;
+
+    double ns[MB_SAMPLES];
+    for (int s = 0; s < MB_SAMPLES; s++) ns[s] = timeRun(mb, iters) / (double)iters;
+    qsort(ns, MB_SAMPLES, sizeof(double), cmpDouble);
+
+    struct MicroResult* r = &g_results[g_resultCount++];
+    r->name     = mb->name;
+    r->bestNs   = ns[0];
+    r->medianNs = ns[MB_SAMPLES / 2];
+    printf("%-16s %10.1f ns/op  (median %.1f, %lu iters x %d)\n", r->name, r->bestNs, r->medianNs,
+           iters, MB_SAMPLES);
+}
+
+static int saveBaseline(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "# gammapad_microbench baseline: name ns_per_op\n");
+    for (int i = 0; i < g_resultCount; i++) {
+        fprintf(f, "%s %.1f\n", g_results[i].name, g_results[i].bestNs);
+    }
+    fclose(f);
+    printf("Baseline saved to %s\n", path);
+    return 0;
+}
+
+/* Returns the number of regressions, or -1 if the baseline can't be read. */
+static int checkBaseline(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[128], name[32];
+    double base;
+    int bad = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%31s %lf", name, &base) != 2) continue;
+        for (int i = 0; i < g_resultCount; i++) {
+            const struct MicroResult* r = &g_results[i];
+            if (strcmp(r->name, name)) continue;
+            int regressed = r->bestNs > base * (100 + MB_SLACK_PCT) / 100.0 &&
+                            r->bestNs - base > MB_SLACK_NS;
+            printf("%-10s %-16s %10.1f -> %10.1f ns/op (%+.0f%%)\n", regressed ? "REGRESSION" : "ok",
+                   name, base, r->bestNs, base > 0 ? (r->bestNs / base - 1.0) * 100.0 : 0.0);
+            bad += regressed;
+        }
+    }
+    fclose(f);
+    return bad;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* filter = NULL;
+    const char* baseline = NULL;
+    const char* save = NULL;
+    int check = 0;
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--check"))                   check    = 1;
+        else if (!strncmp(argv[a], "--filter=", 9))        filter   = argv[a] + 9;
+        else if (!strncmp(argv[a], "--evdev=", 8))         g_evdevPath = argv[a] + 8;
+        else if (!strncmp(argv[a], "--baseline=", 11))     baseline = argv[a] + 11;
+        else if (!strncmp(argv[a], "--save-baseline=", 16)) save    = argv[a] + 16;
+        else {
+            fprintf(stderr, "Usage: %s [--filter=SUBSTR] [--evdev=PATH]"
+                            " [--baseline=FILE] [--save-baseline=FILE] | --check\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* Only warnings: a log line per call would be all we measure. */
+    gp_log_init();
+    gp_log_set_level(-1, GP_LOG_WARN);
+    gp_log_start();
+    printf("axis filter kernel: %s\n", gp_filter_kernel());
+    if (check) {
+        int failed = runChecks();
+        if (failed) printf("%d check(s) failed.\n", failed);
+        gp_log_stop();
+        return failed ? 1 : 0;
+    }
+
+    for (size_t i = 0; i < sizeof(g_benches) / sizeof(g_benches[0]); i++) {
+        const struct MicroBench* mb = &g_benches[i];
+        if (filter && !strstr(mb->name, filter)) continue;
+        if (mb->setup && mb->setup() < 0) {
+            if (mb->setup != setupEvdev) fprintf(stderr, "[Bench] %s: setup failed, skipped.\n", mb->name);
+            continue;
+        }
+        runBench(mb);
+    }
+
+    int status = 0;
+    if (save && saveBaseline(save) < 0) status = 1;
+    if (baseline) {
+        int bad = checkBaseline(baseline);
+        if (bad < 0) status = 1;
+        else if (bad > 0) {
+            printf("%d benchmark(s) regressed beyond %d%% / %.0f ns.\n", bad, MB_SLACK_PCT, MB_SLACK_NS);
+            status = 2;
+        }
+    }
+    gp_log_stop();
+    return status;
+}
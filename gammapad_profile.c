@@ -0,0 +1,333 @@
+/*****************************************************
+ * gammapad_profile.c
+ *
+ * Per-device GammaPad profile parsing. See gammapad_profile.h.
+ *****************************************************/
+
+#include "gammapad_profile.h"
+#include "gammapad_inputdefs.h"
+
+#define ARG_LEN 64      /* room for "points=X:Y,X:Y,..." */
+
+static int typeFromName(const char* name)
+{
+    if (!strcasecmp(name, "key")) return EV_KEY;
+    if (!strcasecmp(name, "abs") || !strcasecmp(name, "axis")) return EV_ABS;
+    return -1;
+}
+
+/*
+ * parseRoute => "route <inType> <sc> <drop | outType code [param]>"
+ */
+static int parseRoute(struct GpRouteBuilder* b, int argc, char argv[][ARG_LEN])
+{
+    if (argc < 4) return -1;
+
+    int inType = typeFromName(argv[1]);
+    if (inType < 0) return -1;
+    int inCode = gp_code_from_name(inType, argv[2]);
+    if (inCode < 0) return -1;
+
+    if (!strcasecmp(argv[3], "drop")) {
+        return gp_route_builder_set(b, inType, inCode, GP_ROUTE_DROP, 0, 0) < 0 ? -1 : 1;
+    }
+
+    if (argc < 5) return -1;
+    int outType = typeFromName(argv[3]);
+    if (outType < 0) return -1;
+    int outCode = gp_code_from_name(outType, argv[4]);
+    if (outCode < 0) return -1;
+
+    int action;
+    int param = 0;
+    if (inType == EV_KEY && outType == EV_KEY) {
+        action = GP_ROUTE_KEY;
+    } else if (inType == EV_ABS && outType == EV_ABS) {
+        action = GP_ROUTE_ABS;
+    } else {
+        /* Cross-type routes need the value/threshold. */
+        if (argc < 6) return -1;
+        param  = (int)strtol(argv[5], NULL, 0);
+        action = (inType == EV_KEY) ? GP_ROUTE_KEY_TO_ABS : GP_ROUTE_ABS_TO_KEY;
+    }
+    return gp_route_builder_set(b, inType, inCode, action, outCode, param) < 0 ? -1 : 1;
+}
+
+/*
+ * parseAbsInfo => "absinfo <axis> [fuzz=N] [flat=N] [res=N]"
+ */
+static int parseAbsInfo(struct GpRouteBuilder* b, int argc, char argv[][ARG_LEN])
+{
+    if (argc < 3) return -1;
+
+    int code = gp_code_from_name(EV_ABS, argv[1]);
+    if (code < 0) return -1;
+
+    struct GpAbsOverride o = b->absOverride[code];
+    for (int i = 2; i < argc; i++) {
+        char* eq = strchr(argv[i], '=');
+        if (!eq || !eq[1]) return -1;
+        *eq = 0;
+        char* end = NULL;
+        long v = strtol(eq + 1, &end, 0);
+        if (*end || v < 0 || v > 0x7fffffffL) return -1;
+
+        if (!strcasecmp(argv[i], "fuzz")) {
+            o.fuzz = (int)v;
+            o.set |= GP_ABS_SET_FUZZ;
+        } else if (!strcasecmp(argv[i], "flat")) {
+            o.flat = (int)v;
+            o.set |= GP_ABS_SET_FLAT;
+        } else if (!strcasecmp(argv[i], "res") || !strcasecmp(argv[i], "resolution")) {
+            o.resolution = (int)v;
+            o.set |= GP_ABS_SET_RES;
+        } else {
+            return -1;
+        }
+    }
+    b->absOverride[code] = o;
+    return 1;
+}
+
+/*
+ * parseFilter => "filter <sc> [opts]" or "stick <scX> <scY> [opts]",
+ * opts being inner=P outer=P hysteresis=P (percent) and, for filter, trigger.
+ */
+static int parseFilter(struct GpRouteBuilder* b, int argc, char argv[][ARG_LEN], int stick)
+{
+    int first = stick ? 3 : 2;
+    if (argc < first) return -1;
+
+    struct GpFilterRule r;
+    memset(&r, 0, sizeof(r));
+    r.outer = 1.0f;
+    r.pair  = GP_FILTER_NO_PAIR;
+    int code = gp_code_from_name(EV_ABS, argv[1]);
+    if (code < 0) return -1;
+    r.code = (__u16)code;
+    if (stick) {
+        int pair = gp_code_from_name(EV_ABS, argv[2]);
+        if (pair < 0 || pair == code) return -1;
+        r.pair = (__u16)pair;
+    }
+
+    for (int i = first; i < argc; i++) {
+        if (!stick && !strcasecmp(argv[i], "trigger")) {
+            r.trigger = 1;
+            continue;
+        }
+        char* eq = strchr(argv[i], '=');
+        if (!eq || !eq[1]) return -1;
+        *eq = 0;
+        char* end = NULL;
+        double pct = strtod(eq + 1, &end);
+        if (*end || pct < 0.0 || pct > 100.0) return -1;
+
+        if (!strcasecmp(argv[i], "inner"))           r.inner = (float)(pct / 100.0);
+        else if (!strcasecmp(argv[i], "outer"))      r.outer = (float)(pct / 100.0);
+        else if (!strcasecmp(argv[i], "hysteresis")) r.hysteresis = (float)(pct / 100.0);
+        else return -1;
+    }
+    if (r.inner >= r.outer) return -1;
+    return gp_filter_rule_set(b->filters, &b->filterCount, &r) < 0 ? -1 : 1;
+}
+
+/*
+ * parseRate => "rate <hz>" | "rate off"
+ */
+static int parseRate(struct GpRouteBuilder* b, int argc, char argv[][ARG_LEN])
+{
+    if (argc != 2) return -1;
+    if (!strcasecmp(argv[1], "off")) {
+        b->outputRateHz = 0;
+        return 1;
+    }
+    char* end = NULL;
+    long hz = strtol(argv[1], &end, 10);
+    if (*end || hz < 1 || hz > 100000) return -1;
+    b->outputRateHz = (int)hz;
+    return 1;
+}
+
+/*
+ * parseCalib => "calib <sc> min=N center=N max=N"
+ */
+static int parseCalib(struct GpRouteBuilder* b, int argc, char argv[][ARG_LEN])
+{
+    if (argc != 5) return -1;
+
+    struct GpCalRule r;
+    memset(&r, 0, sizeof(r));
+    int code = gp_code_from_name(EV_ABS, argv[1]);
+    if (code < 0) return -1;
+    r.code = (__u16)code;
+    r.set  = GP_CAL_SET_RANGE;
+
+    int have = 0;
+    for (int i = 2; i < argc; i++) {
+        char* eq = strchr(argv[i], '=');
+        if (!eq || !eq[1]) return -1;
+        *eq = 0;
+        char* end = NULL;
+        long v = strtol(eq + 1, &end, 0);
+        if (*end || v < -0x7fffffffL || v > 0x7fffffffL) return -1;
+
+        if (!strcasecmp(argv[i], "min"))         { r.min = (int)v;    have |= 1; }
+        else if (!strcasecmp(argv[i], "center")) { r.center = (int)v; have |= 2; }
+        else if (!strcasecmp(argv[i], "max"))    { r.max = (int)v;    have |= 4; }
+        else return -1;
+    }
+    if (have != 7 || r.max <= r.min || r.center < r.min || r.center > r.max) return -1;
+    return gp_cal_rule_set(b->calib, &b->calibCount, &r) < 0 ? -1 : 1;
+}
+
+/*
+ * parsePoints => "X:Y,X:Y,..." in percent, X strictly increasing.
+ */
+static int parsePoints(struct GpCalRule* r, const char* list)
+{
+    const char* p = list;
+    float lastX = 0.0f;
+    while (*p) {
+        if (r->pointCount >= GP_CAL_MAX_POINTS) return -1;
+        char* end = NULL;
+        double x = strtod(p, &end);
+        if (end == p || *end != ':') return -1;
+        p = end + 1;
+        double y = strtod(p, &end);
+        if (end == p || (*end && *end != ',')) return -1;
+        p = *end ? end + 1 : end;
+
+        if (x <= 0.0 || x >= 100.0 || y < 0.0 || y > 100.0) return -1;
+        if ((float)(x / 100.0) <= lastX) return -1;
+        lastX = (float)(x / 100.0);
+        r->px[r->pointCount] = lastX;
+        r->py[r->pointCount] = (float)(y / 100.0);
+        r->pointCount++;
+    }
+    return r->pointCount ? 0 : -1;
+}
+
+/*
+ * parseCurve => "curve <sc> linear|expo=P|points=X:Y,... [trigger]"
+ */
+static int parseCurve(struct GpRouteBuilder* b, int argc, char argv[][ARG_LEN])
+{
+    if (argc < 3 || argc > 4) return -1;
+
+    struct GpCalRule r;
+    memset(&r, 0, sizeof(r));
+    int code = gp_code_from_name(EV_ABS, argv[1]);
+    if (code < 0) return -1;
+    r.code = (__u16)code;
+    r.set  = GP_CAL_SET_CURVE;
+
+    if (argc == 4) {
+        if (strcasecmp(argv[3], "trigger")) return -1;
+        r.trigger = 1;
+    }
+
+    if (!strcasecmp(argv[2], "linear")) {
+        r.curve = GP_CAL_LINEAR;
+    } else if (!strncasecmp(argv[2], "expo=", 5)) {
+        char* end = NULL;
+        double pct = strtod(argv[2] + 5, &end);
+        if (end == argv[2] + 5 || *end || pct < 0.0 || pct > 100.0) return -1;
+        r.curve = GP_CAL_EXPO;
+        r.expo  = (float)(pct / 100.0);
+    } else if (!strncasecmp(argv[2], "points=", 7)) {
+        r.curve = GP_CAL_POINTS;
+        if (parsePoints(&r, argv[2] + 7) < 0) return -1;
+    } else {
+        return -1;
+    }
+    return gp_cal_rule_set(b->calib, &b->calibCount, &r) < 0 ? -1 : 1;
+}
+
+int gp_profile_parse_line(struct GpRouteBuilder* b, const char* line)
+{
+    if (!b || !line) return -1;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", line);
+    char* hash = strchr(buf, '#');
+    if (hash) *hash = 0;
+
+    char argv[8][ARG_LEN];
+    int argc = 0;
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, " \t\r\n", &save); tok && argc < 8;
+         tok = strtok_r(NULL, " \t\r\n", &save)) {
+        snprintf(argv[argc++], sizeof(argv[0]), "%s", tok);
+    }
+    if (argc == 0) return 0;
+
+    if (!strcasecmp(argv[0], "route")) {
+        return parseRoute(b, argc, argv);
+    }
+    if (!strcasecmp(argv[0], "absinfo")) {
+        return parseAbsInfo(b, argc, argv);
+    }
+    if (!strcasecmp(argv[0], "filter") || !strcasecmp(argv[0], "stick")) {
+        return parseFilter(b, argc, argv, !strcasecmp(argv[0], "stick"));
+    }
+    if (!strcasecmp(argv[0], "rate")) {
+        return parseRate(b, argc, argv);
+    }
+    if (!strcasecmp(argv[0], "calib")) {
+        return parseCalib(b, argc, argv);
+    }
+    if (!strcasecmp(argv[0], "curve")) {
+        return parseCurve(b, argc, argv);
+    }
+    return -1;
+}
+
+void gp_profile_path(const struct input_id* id, const char* ext, char* buf, size_t len)
+{
+    const char* dir = getenv("GAMMAPAD_PROFILE_DIR");
+    if (!dir || !*dir) dir = GAMMAPAD_DEFAULT_PROFILE_DIR;
+    snprintf(buf, len, "%s/Vendor_%04x_Product_%04x.%s", dir, id->vendor, id->product, ext);
+}
+
+static int loadFile(const char* path, struct GpRouteBuilder* b)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Profile] No profile at %s\n", path);
+        return 0;
+    }
+
+    int applied = 0;
+    int lineNo  = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        lineNo++;
+        char* nl = strchr(line, '\n');
+        if (nl) *nl = 0;
+        int rc = gp_profile_parse_line(b, line);
+        if (rc < 0) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Profile] %s:%d: cannot parse '%s'\n",
+                   path, lineNo, line);
+        } else {
+            applied += rc;
+        }
+    }
+    fclose(f);
+
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Profile] %s => %d directives applied\n", path, applied);
+    return applied;
+}
+
+int gp_profile_load_for_device(int fd, struct GpRouteBuilder* b)
+{
+    struct input_id id;
+    if (ioctl(fd, EVIOCGID, &id) < 0) return 0;
+
+    /* The .cal after the .gp: its calib lines join the .gp's curves. */
+    char path[512];
+    gp_profile_path(&id, "gp", path, sizeof(path));
+    int applied = loadFile(path, b);
+    gp_profile_path(&id, "cal", path, sizeof(path));
+    return applied + loadFile(path, b);
+}
@@ -0,0 +1,62 @@
+#ifndef GAMMAPAD_PROFILE_H
+#define GAMMAPAD_PROFILE_H
+
+#include "gammapad_route.h"
+
+/*
+ * gammapad_profile.h
+ *
+ * Per-device GammaPad profile: a plain text file next to (but separate
+ * from) the Android .kl, looked up by vendor/product:
+ *
+ *     <profile dir>/Vendor_<vvvv>_Product_<pppp>.gp
+ *
+ * The profile dir is $GAMMAPAD_PROFILE_DIR, or GAMMAPAD_DEFAULT_PROFILE_DIR.
+ * One directive per line, '#' starts a comment:
+ *
+ *     route key <sc> key <code>            # plain remap
+ *     route key <sc> abs <code> <value>    # button drives an axis
+ *     route abs <sc> abs <code>            # plain remap
+ *     route abs <sc> key <code> <thresh>   # axis drives a button
+ *     route key|abs <sc> drop              # swallow the input
+ *     absinfo <sc> [fuzz=N] [flat=N] [res=N]
+ *                                          # replace the driver's EVIOCGABS values
+ *     filter <sc> [inner=P] [outer=P] [hysteresis=P] [trigger]
+ *     stick <scX> <scY> [inner=P] [outer=P] [hysteresis=P]
+ *                                          # dead zones (gammapad_filter.h)
+ *     curve <sc> linear|expo=P|points=X:Y,... [trigger]
+ *                                          # response curve (gammapad_calib.h)
+ *     rate <hz>|off                        # write axis-only frames at most
+ *                                          # hz times/s (gammapad_capture.h)
+ *
+ * Vendor_<vvvv>_Product_<pppp>.cal, written by the console's "calibrate
+ * save", is read after the .gp and takes the same directives; it holds
+ *     calib <sc> min=N center=N max=N
+ *
+ * Codes are names from gp_code_from_name() ("BTN_A", "ABS_GAS") or numbers.
+ *
+ * absinfo applies to the physical axis; the virtual axis it is routed to
+ * gets the largest fuzz/flat of its sources (see gammapad_controller.c).
+ * fuzz makes the kernel drop changes smaller than it before they reach
+ * readers of the pad, flat is the dead zone Android applies to sticks,
+ * res is units per mm (units per radian for rotation axes).
+ */
+
+#ifndef GAMMAPAD_DEFAULT_PROFILE_DIR
+  #ifdef __ANDROID__
+    #define GAMMAPAD_DEFAULT_PROFILE_DIR "/data/local/tmp/gammapad"
+  #else
+    #define GAMMAPAD_DEFAULT_PROFILE_DIR "/etc/gammapad"
+  #endif
+#endif
+
+/* <profile dir>/Vendor_<vvvv>_Product_<pppp>.<ext> */
+void gp_profile_path(const struct input_id* id, const char* ext, char* buf, size_t len);
+
+/* Load the profile (.gp, then .cal) matching fd's EVIOCGID. Returns lines applied. */
+int gp_profile_load_for_device(int fd, struct GpRouteBuilder* b);
+
+/* Apply one profile line. Returns 1 if applied, 0 if blank/comment, -1 if invalid. */
+int gp_profile_parse_line(struct GpRouteBuilder* b, const char* line);
+
+#endif /* GAMMAPAD_PROFILE_H */
@@ -0,0 +1,158 @@
+/*****************************************************
+ * gammapad_rebind.c
+ *
+ * Unbind/bind state machine. See gammapad_rebind.h.
+ *****************************************************/
+
+#include "gammapad_rebind.h"
+#include "gammapad_timer.h"
+
+static void rebindTick(void* arg);
+
+/*
+ * isBound => the driver directory holds a link named after each device
+ * bound to it.
+ */
+static int isBound(const struct GpRebind* rb)
+{
+    char link[600];
+    struct stat st;
+    snprintf(link, sizeof(link), "%s/%s", rb->driverPath, rb->deviceName);
+    return fstatat(AT_FDCWD, link, &st, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+static void writeControl(struct GpRebind* rb, const char* what)
+{
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%s", rb->driverPath, what);
+
+    rb->writes++;
+    rb->polls   = 0;
+    rb->delayMs = GP_REBIND_POLL_MIN_MS;
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Rebind] %s #%d: open '%s' => %s\n",
+            what, rb->writes, path, strerror(errno));
+        return;
+    }
+    /* ENODEV etc. just mean the kernel is already where we want it; the poll decides. */
+    if (write(fd, rb->deviceName, strlen(rb->deviceName)) < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_DEBUG, "[Rebind] %s #%d: write '%s' => %s\n",
+            what, rb->writes, rb->deviceName, strerror(errno));
+    }
+    close(fd);
+}
+
+static void finish(struct GpRebind* rb, int state)
+{
+    rb->state   = state;
+    rb->timerId = 0;
+    rb->doneNs  = getMonotonicNs();
+
+    GP_LOG(GP_LOG_CAPTURE, state == GP_REBIND_DONE ? GP_LOG_INFO : GP_LOG_WARN,
+        "[Rebind] '%s' on '%s' => %s after %.1f ms\n",
+        rb->deviceName, rb->driverPath, gp_rebind_state_name(state), gp_rebind_elapsed_ms(rb));
+    if (rb->onDone) rb->onDone(rb, rb->arg);
+}
+
+/*
+ * advance => run the machine as far as it can go without waiting, then
+ * schedule the next poll if it still has to wait for the kernel.
+ */
+static void advance(struct GpRebind* rb)
+{
+    for (;;) {
+        if (rb->state == GP_REBIND_UNBINDING) {
+            if (isBound(rb)) break;
+            rb->state  = GP_REBIND_BINDING;
+            rb->writes = 0;
+            writeControl(rb, "bind");
+            continue;
+        }
+        if (rb->state == GP_REBIND_BINDING) {
+            if (!isBound(rb)) break;
+            finish(rb, GP_REBIND_DONE);
+            return;
+        }
+        return;
+    }
+
+    /* Still waiting on the kernel. */
+    if (rb->polls >= GP_REBIND_POLLS_PER_WRITE) {
+        if (rb->writes >= GP_REBIND_MAX_WRITES) {
+            finish(rb, GP_REBIND_FAILED);
+            return;
+        }
+        writeControl(rb, rb->state == GP_REBIND_UNBINDING ? "unbind" : "bind");
+        advance(rb);
+        return;
+    }
+
+    rb->timerId = gp_timer_add_ms(rb->delayMs, rebindTick, rb);
+    if (rb->timerId < 0) {
+        finish(rb, GP_REBIND_FAILED);
+        return;
+    }
+    rb->polls++;
+    rb->delayMs *= 2;
+    if (rb->delayMs > GP_REBIND_POLL_MAX_MS) rb->delayMs = GP_REBIND_POLL_MAX_MS;
+}
+
+static void rebindTick(void* arg)
+{
+    struct GpRebind* rb = (struct GpRebind*)arg;
+    rb->timerId = 0;
+    advance(rb);
+}
+
+int gp_rebind_start(struct GpRebind* rb, const char* driverPath, const char* deviceName,
+                    GpRebindCallback onDone, void* arg)
+{
+    if (!rb || !driverPath || !driverPath[0] || !deviceName || !deviceName[0]) return -1;
+
+    memset(rb, 0, sizeof(*rb));
+    snprintf(rb->driverPath, sizeof(rb->driverPath), "%s", driverPath);
+    snprintf(rb->deviceName, sizeof(rb->deviceName), "%s", deviceName);
+    rb->onDone  = onDone;
+    rb->arg     = arg;
+    rb->startNs = getMonotonicNs();
+    rb->state   = GP_REBIND_UNBINDING;
+
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Rebind] '%s' on '%s' => unbind + bind\n",
+        rb->deviceName, rb->driverPath);
+    writeControl(rb, "unbind");
+    advance(rb);
+    return 0;
+}
+
+void gp_rebind_cancel(struct GpRebind* rb)
+{
+    if (!rb || !gp_rebind_active(rb)) return;
+    if (rb->timerId > 0) gp_timer_cancel(rb->timerId);
+    rb->timerId = 0;
+    rb->state   = GP_REBIND_IDLE;
+}
+
+int gp_rebind_active(const struct GpRebind* rb)
+{
+    return rb && (rb->state == GP_REBIND_UNBINDING || rb->state == GP_REBIND_BINDING);
+}
+
+double gp_rebind_elapsed_ms(const struct GpRebind* rb)
+{
+    unsigned long long end = rb->doneNs ? rb->doneNs : getMonotonicNs();
+    return (double)(end - rb->startNs) / 1e6;
+}
+
+const char* gp_rebind_state_name(int state)
+{
+    switch (state) {
+    case GP_REBIND_IDLE:      return "idle";
+    case GP_REBIND_UNBINDING: return "unbinding";
+    case GP_REBIND_BINDING:   return "binding";
+    case GP_REBIND_DONE:      return "done";
+    case GP_REBIND_FAILED:    return "failed";
+    default:                  return "?";
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef GAMMAPAD_REBIND_H
+#define GAMMAPAD_REBIND_H
+
+#include "gammapad.h"
+
+/*
+ * gammapad_rebind.h
+ *
+ * Asynchronous unbind + bind of one device from its driver, driven by
+ * gammapad_timer (so it needs gp_timer_dispatch() to be pumped).
+ *
+ *   UNBINDING => write <driver>/unbind, poll until <driver>/<device> is gone
+ *   BINDING   => write <driver>/bind,   poll until <driver>/<device> is back
+ *   DONE / FAILED
+ *
+ * The link is checked right after each write, so a driver that (un)binds
+ * synchronously costs no wait at all. Otherwise it is polled with
+ * exponential backoff (GP_REBIND_POLL_MIN_MS doubling up to
+ * GP_REBIND_POLL_MAX_MS); after GP_REBIND_POLLS_PER_WRITE polls the write
+ * is retried, at most GP_REBIND_MAX_WRITES times per phase. Worst case is
+ * well under a second per phase.
+ */
+
+#define GP_REBIND_POLL_MIN_MS       1
+#define GP_REBIND_POLL_MAX_MS       64
+#define GP_REBIND_POLLS_PER_WRITE   8
+#define GP_REBIND_MAX_WRITES        3
+
+enum GpRebindState {
+    GP_REBIND_IDLE = 0,
+    GP_REBIND_UNBINDING,
+    GP_REBIND_BINDING,
+    GP_REBIND_DONE,
+    GP_REBIND_FAILED
+};
+
+struct GpRebind;
+typedef void (*GpRebindCallback)(struct GpRebind* rb, void* arg);
+
+struct GpRebind {
+    int          state;         /* enum GpRebindState */
+    int          writes;        /* writes issued in the current phase */
+    int          polls;         /* polls since the last write */
+    unsigned int delayMs;       /* next poll interval */
+    int          timerId;
+    unsigned long long startNs;
+    unsigned long long doneNs;
+    char         driverPath[256];
+    char         deviceName[256];
+    GpRebindCallback onDone;    /* called once, on DONE or FAILED */
+    void*        arg;
+};
+
+/*
+ * gp_rebind_start => begin the cycle. Returns 0 if it is running (or
+ * already finished, in which case onDone has been called), -1 on bad args.
+ */
+int  gp_rebind_start(struct GpRebind* rb, const char* driverPath, const char* deviceName,
+                     GpRebindCallback onDone, void* arg);
+void gp_rebind_cancel(struct GpRebind* rb);
+int  gp_rebind_active(const struct GpRebind* rb);
+
+/* Elapsed time of a finished cycle. */
+double gp_rebind_elapsed_ms(const struct GpRebind* rb);
+
+const char* gp_rebind_state_name(int state);
+
+#endif /* GAMMAPAD_REBIND_H */
@@ -0,0 +1,226 @@
+/*****************************************************
+ * gammapad_record.c
+ *
+ * Binary recordings of captured input + their reader.
+ * See gammapad_record.h.
+ *****************************************************/
+
+#include "gammapad_record.h"
+#include <sys/mman.h>
+
+#define REC_STDIO_BUFFER (64 * 1024)
+
+int g_gpRecording = 0;
+
+static FILE* g_recFile;
+static char* g_recBuffer;
+static unsigned long long g_lastUs;     /* timestamp of the previous record */
+
+static unsigned long long realtimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+}
+
+/*
+ * deltaUs => time since the previous record. evdev stamps events with
+ * CLOCK_REALTIME unless told otherwise; sources that leave the timestamp
+ * empty (pipes) get the time of the read instead. Never negative.
+ */
+static __u32 deltaUs(unsigned long long nowUs)
+{
+    unsigned long long dt = nowUs > g_lastUs ? nowUs - g_lastUs : 0;
+    if (nowUs > g_lastUs) g_lastUs = nowUs;
+    return dt > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (__u32)dt;
+}
+
+int gp_record_open(const char* path)
+{
+    if (g_recFile) gp_record_close();
+
+    g_recFile = fopen(path, "wb");
+    if (!g_recFile) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Record] open '%s' => %s\n", path, strerror(errno));
+        return -1;
+    }
+    g_recBuffer = malloc(REC_STDIO_BUFFER);
+    if (g_recBuffer) setvbuf(g_recFile, g_recBuffer, _IOFBF, REC_STDIO_BUFFER);
+
+    struct GpRecHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GP_REC_MAGIC, sizeof(h.magic));
+    h.version = GP_REC_VERSION;
+    g_lastUs = realtimeUs();
+    h.startRealtimeNs = g_lastUs * 1000ULL;
+    if (fwrite(&h, sizeof(h), 1, g_recFile) != 1) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Record] write '%s' => %s\n", path, strerror(errno));
+        gp_record_close();
+        return -1;
+    }
+
+    g_gpRecording = 1;
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO, "[Record] recording to '%s'.\n", path);
+    return 0;
+}
+
+void gp_record_close(void)
+{
+    g_gpRecording = 0;
+    if (g_recFile) {
+        fclose(g_recFile);
+        g_recFile = NULL;
+    }
+    free(g_recBuffer);
+    g_recBuffer = NULL;
+}
+
+void gp_record_device(int device, const char* name, const struct input_id* id,
+                      const struct GpRouteBuilder* b, const int* absMin, const int* absMax)
+{
+    if (!g_gpRecording) return;
+
+    static struct GpRecDevice d;    /* ~7 KB, main thread only */
+    memset(&d, 0, sizeof(d));
+    snprintf(d.name, sizeof(d.name), "%s", name ? name : "");
+    if (id) d.id = *id;
+    for (int i = 0; i <= KEY_MAX; i++) {
+        if (gp_test_bit(b->keyBits, i)) d.keyBits[i / 8] |= (__u8)(1 << (i % 8));
+    }
+    for (int i = 0; i <= ABS_MAX; i++) {
+        if (gp_test_bit(b->absBits, i)) d.absBits[i / 8] |= (__u8)(1 << (i % 8));
+        d.absMin[i] = absMin[i];
+        d.absMax[i] = absMax[i];
+    }
+    d.ruleCount = (__u32)b->ruleCount;
+    memcpy(d.rules, b->rules, (size_t)b->ruleCount * sizeof(b->rules[0]));
+    d.filterCount = (__u32)b->filterCount;
+    memcpy(d.filters, b->filters, (size_t)b->filterCount * sizeof(b->filters[0]));
+    d.calibCount = (__u32)b->calibCount;
+    memcpy(d.calib, b->calib, (size_t)b->calibCount * sizeof(b->calib[0]));
+    d.outputRateHz = b->outputRateHz;
+    memcpy(d.absOverride, b->absOverride, sizeof(d.absOverride));
+
+    struct GpRecEvent rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.dtUs   = deltaUs(realtimeUs());
+    rec.type   = GP_REC_META;
+    rec.value  = (__s32)sizeof(d);
+    rec.device = (__u16)device;
+
+    static const unsigned char zeros[16];
+    size_t pad = GP_REC_ALIGN(sizeof(d)) - sizeof(d);
+    if (fwrite(&rec, sizeof(rec), 1, g_recFile) != 1 ||
+        fwrite(&d, sizeof(d), 1, g_recFile) != 1 ||
+        (pad && fwrite(zeros, pad, 1, g_recFile) != 1)) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Record] write failed => recording stopped.\n");
+        gp_record_close();
+    }
+}
+
+void gp_record_events(int device, const struct input_event* evs, size_t count)
+{
+    if (!g_gpRecording) return;
+
+    struct GpRecEvent recs[64];
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        const struct input_event* ev = &evs[i];
+        unsigned long long t = (unsigned long long)ev->input_event_sec * 1000000ULL +
+                               (unsigned long long)ev->input_event_usec;
+        struct GpRecEvent* rec = &recs[n++];
+        rec->dtUs     = deltaUs(t ? t : realtimeUs());
+        rec->type     = ev->type;
+        rec->code     = ev->code;
+        rec->value    = ev->value;
+        rec->device   = (__u16)device;
+        rec->reserved = 0;
+        if (n == sizeof(recs) / sizeof(recs[0]) || i + 1 == count) {
+            if (fwrite(recs, sizeof(recs[0]), n, g_recFile) != n) {
+                GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Record] write failed => recording stopped.\n");
+                gp_record_close();
+                return;
+            }
+            n = 0;
+        }
+    }
+}
+
+int gp_rec_map(struct GpRecFile* f, const char* path)
+{
+    memset(f, 0, sizeof(*f));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct GpRecHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    f->base   = (const unsigned char*)p;
+    f->size   = (size_t)st.st_size;
+    f->header = (const struct GpRecHeader*)p;
+    f->pos    = sizeof(struct GpRecHeader);
+    if (memcmp(f->header->magic, GP_REC_MAGIC, sizeof(f->header->magic)) ||
+        f->header->version != GP_REC_VERSION) {
+        gp_rec_unmap(f);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void gp_rec_unmap(struct GpRecFile* f)
+{
+    if (f->base) munmap((void*)f->base, f->size);
+    memset(f, 0, sizeof(*f));
+}
+
+const struct GpRecEvent* gp_rec_next(struct GpRecFile* f, const struct GpRecDevice** meta)
+{
+    if (meta) *meta = NULL;
+    if (f->pos + sizeof(struct GpRecEvent) > f->size) return NULL;
+
+    const struct GpRecEvent* rec = (const struct GpRecEvent*)(f->base + f->pos);
+    size_t next = f->pos + sizeof(*rec);
+    if (rec->type == GP_REC_META) {
+        if (rec->value != (__s32)sizeof(struct GpRecDevice)) return NULL;  /* other version */
+        next += GP_REC_ALIGN(sizeof(struct GpRecDevice));
+        if (next > f->size) return NULL;
+        if (meta) *meta = (const struct GpRecDevice*)(rec + 1);
+    }
+    f->pos = next;
+    return rec;
+}
+
+void gp_rec_device_to_builder(const struct GpRecDevice* d, struct GpRouteBuilder* b,
+                              int* absMin, int* absMax)
+{
+    gp_route_builder_reset(b);
+    for (int i = 0; i <= KEY_MAX; i++) {
+        if (d->keyBits[i / 8] & (1 << (i % 8))) gp_set_bit(b->keyBits, i);
+    }
+    for (int i = 0; i <= ABS_MAX; i++) {
+        if (d->absBits[i / 8] & (1 << (i % 8))) gp_set_bit(b->absBits, i);
+        absMin[i] = d->absMin[i];
+        absMax[i] = d->absMax[i];
+    }
+    int count = d->ruleCount > GP_ROUTE_MAX_RULES ? GP_ROUTE_MAX_RULES : (int)d->ruleCount;
+    memcpy(b->rules, d->rules, (size_t)count * sizeof(b->rules[0]));
+    b->ruleCount = count;
+
+    count = d->filterCount > GP_FILTER_MAX_RULES ? GP_FILTER_MAX_RULES : (int)d->filterCount;
+    memcpy(b->filters, d->filters, (size_t)count * sizeof(b->filters[0]));
+    b->filterCount = count;
+
+    count = d->calibCount > GP_CAL_MAX_RULES ? GP_CAL_MAX_RULES : (int)d->calibCount;
+    memcpy(b->calib, d->calib, (size_t)count * sizeof(b->calib[0]));
+    b->calibCount = count;
+    b->outputRateHz = d->outputRateHz;
+    memcpy(b->absOverride, d->absOverride, sizeof(b->absOverride));
+}
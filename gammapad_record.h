@@ -0,0 +1,106 @@
+#ifndef GAMMAPAD_RECORD_H
+#define GAMMAPAD_RECORD_H
+
+#include "gammapad.h"
+#include "gammapad_route.h"
+#include <linux/input.h>
+
+/*
+ * gammapad_record.h
+ *
+ * Field recordings of what the physical devices emitted, for replay
+ * against a new build (gammapad_replay).
+ *
+ * File layout, native endianness, every record a multiple of 16 bytes so
+ * the file can be mmap()ed and walked in place:
+ *   GpRecHeader
+ *   GpRecEvent ...     one per input_event read from a captured device
+ *   GpRecEvent(META) + GpRecDevice   whenever a device is opened, i.e.
+ *                      before its first event and again after a replug
+ *
+ * GpRecDevice is the route builder as it stood before collision
+ * resolution: the .kl and profile rules, the profile's filter, calib/curve,
+ * rate and absinfo lines, the discovered key/axis bits and the absinfo
+ * ranges. Replay compiles it again, so a change in collision handling,
+ * route compilation, calibration or filtering shows up in the replayed
+ * output.
+ *
+ * Events are buffered with stdio and flushed on gp_record_close(); a
+ * crash loses at most the buffer, and the reader ignores a torn tail.
+ */
+
+#define GP_REC_MAGIC    "GPREC\0\0\0"
+#define GP_REC_VERSION  3
+#define GP_REC_META     0xFFFF      /* GpRecEvent.type of a device record */
+
+struct GpRecHeader {
+    char  magic[8];
+    __u32 version;
+    __u32 reserved;
+    __u64 startRealtimeNs;          /* wall clock when recording began */
+    __u64 reserved2;
+};
+
+struct GpRecEvent {
+    __u32 dtUs;                     /* since the previous record, event timestamps */
+    __u16 type;                     /* EV_*, or GP_REC_META                        */
+    __u16 code;
+    __s32 value;                    /* META: payload size (GpRecDevice)            */
+    __u16 device;                   /* GpDevice.index                              */
+    __u16 reserved;
+};
+
+struct GpRecDevice {
+    char            name[128];
+    struct input_id id;
+    __u8            keyBits[(KEY_MAX + 1) / 8];
+    __u8            absBits[(ABS_MAX + 1) / 8];
+    __s32           absMin[ABS_MAX + 1];
+    __s32           absMax[ABS_MAX + 1];
+    __u32           ruleCount;
+    __u32           filterCount;
+    __u32           calibCount;
+    __s32           outputRateHz;
+    struct GpRoute  rules[GP_ROUTE_MAX_RULES];
+    struct GpFilterRule  filters[GP_FILTER_MAX_RULES];
+    struct GpCalRule     calib[GP_CAL_MAX_RULES];
+    struct GpAbsOverride absOverride[ABS_MAX + 1];
+};
+
+#define GP_REC_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+/*
+ * Recorder (main thread). gp_record_open() before the devices are opened;
+ * gammapad_capture then calls gp_record_device() from every device open
+ * and gp_record_events() from gp_device_pump(). While no recording is
+ * open that costs one flag test per read() batch.
+ */
+extern int g_gpRecording;
+
+int  gp_record_open(const char* path);
+void gp_record_close(void);
+void gp_record_device(int device, const char* name, const struct input_id* id,
+                      const struct GpRouteBuilder* b, const int* absMin, const int* absMax);
+void gp_record_events(int device, const struct input_event* evs, size_t count);
+
+/*
+ * Reader: gp_rec_map() validates the header, gp_rec_next() walks the
+ * records and returns NULL at the end (or at a torn record). For META
+ * records *meta points at the device payload, else it is set to NULL.
+ */
+struct GpRecFile {
+    const unsigned char* base;
+    size_t size;
+    size_t pos;
+    const struct GpRecHeader* header;
+};
+
+int  gp_rec_map(struct GpRecFile* f, const char* path);
+void gp_rec_unmap(struct GpRecFile* f);
+const struct GpRecEvent* gp_rec_next(struct GpRecFile* f, const struct GpRecDevice** meta);
+
+/* GpRecDevice => route builder + ranges, the inverse of gp_record_device(). */
+void gp_rec_device_to_builder(const struct GpRecDevice* d, struct GpRouteBuilder* b,
+                              int* absMin, int* absMax);
+
+#endif /* GAMMAPAD_RECORD_H */
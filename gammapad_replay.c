@@ -0,0 +1,285 @@
+/*****************************************************
+ * gammapad_replay.c
+ *
+ * Plays a --record file back through the capture pipeline.
+ *
+ * Every recorded device becomes a stream device (gp_device_open_replay)
+ * with the recorded .kl/profile rules, key/axis bits and ranges, fed
+ * through a pipe and pumped with gp_device_pump() exactly like a live
+ * node. Its pad writes to a pipe that is drained after every frame.
+ *
+ * stdout (or --out) gets a text transcript meant to be diffed against a
+ * golden file: the compiled routes of each device, then one line per
+ * forwarded frame stamped with its recorded time. Nothing measured goes
+ * into it, so it is identical run to run. Pipeline timings (source write
+ * to sink read per frame) and, at original timing, how late frames were
+ * fed go to stderr.
+ *
+ * Usage: gammapad_replay [--fast] [--out=FILE] RECORDING
+ *   --fast => feed frames back to back instead of at their recorded times
+ *****************************************************/
+
+#include "gammapad.h"
+#include "gammapad_capture.h"
+#include "gammapad_record.h"
+#include "gammapad_inputdefs.h"
+
+struct ReplayDev {
+    int srcRead, srcWrite;          /* recording => pipeline */
+    int sinkRead, sinkWrite;        /* pipeline => transcript */
+    struct GpDevice* dev;
+    struct GpPad pad;
+    int pendingCount;
+    struct input_event pending[GP_READ_BATCH];
+};
+
+static struct ReplayDev* g_replay[GP_MAX_DEVICES];  /* by recorded device index */
+static FILE* g_out;
+static int   g_fast = 0;
+
+static double* g_pipeUs;            /* per frame: source write => sink drained */
+static double* g_lateUs;            /* per frame: fed after its recorded time  */
+static unsigned long g_frames, g_frameCap;
+static unsigned long g_skipped;
+
+static unsigned long long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static void printCode(int type, int code)
+{
+    const char* name = gp_code_name(type, code);
+    if (name) fputs(name, g_out);
+    else fprintf(g_out, "%s_0x%x", type == EV_ABS ? "ABS" : type == EV_KEY ? "KEY" : "EV", code);
+}
+
+static int cmpRoute(const void* a, const void* b)
+{
+    const struct GpRoute* x = *(const struct GpRoute* const*)a;
+    const struct GpRoute* y = *(const struct GpRoute* const*)b;
+    if (x->inType != y->inType) return (int)x->inType - (int)y->inType;
+    return (int)x->inCode - (int)y->inCode;
+}
+
+/*
+ * printRoutes => the compiled table in (type, code) order; the hash order
+ * would make the transcript depend on the table size.
+ */
+static void printRoutes(double tMs, int index, const struct GpDevice* dev, const struct GpRecDevice* meta)
+{
+    static const char* const actions[] = { "empty", "drop", "key", "abs", "key_to_abs", "abs_to_key" };
+    const struct GpRoute* sorted[GP_ROUTE_MAX_RULES + KEY_MAX + ABS_MAX];
+    int count = 0;
+
+    GP_ROUTE_FOREACH(&dev->routes, r) {
+        if (count < (int)(sizeof(sorted) / sizeof(sorted[0]))) sorted[count++] = r;
+    }
+    qsort(sorted, (size_t)count, sizeof(sorted[0]), cmpRoute);
+
+    fprintf(g_out, "# %10.3f device %d '%s' %04x:%04x rules=%u routes=%d\n",
+            tMs, index, meta->name, meta->id.vendor, meta->id.product, meta->ruleCount, count);
+    for (int i = 0; i < count; i++) {
+        const struct GpRoute* r = sorted[i];
+        int outType = (r->action == GP_ROUTE_ABS || r->action == GP_ROUTE_KEY_TO_ABS) ? EV_ABS : EV_KEY;
+        fputs("#   ", g_out);
+        printCode(r->inType, r->inCode);
+        fprintf(g_out, " => %s ", r->action < sizeof(actions) / sizeof(actions[0]) ? actions[r->action] : "?");
+        printCode(outType, r->outCode);
+        if (r->action == GP_ROUTE_KEY_TO_ABS || r->action == GP_ROUTE_ABS_TO_KEY) {
+            fprintf(g_out, " %d", r->param);
+        }
+        fputc('\n', g_out);
+    }
+}
+
+static int makePipe(int* readEnd, int* writeEnd)
+{
+    int fds[2];
+    if (pipe(fds) < 0) return -1;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    *readEnd  = fds[0];
+    *writeEnd = fds[1];
+    return 0;
+}
+
+static struct ReplayDev* openDevice(int index, const struct GpRecDevice* meta, double tMs)
+{
+    struct ReplayDev* rd = g_replay[index];
+    if (!rd) {
+        rd = calloc(1, sizeof(*rd));
+        if (!rd || makePipe(&rd->srcRead, &rd->srcWrite) < 0 ||
+            makePipe(&rd->sinkRead, &rd->sinkWrite) < 0 || !(rd->dev = gp_device_alloc())) {
+            fprintf(stderr, "[Replay] device %d: setup failed.\n", index);
+            free(rd);
+            return NULL;
+        }
+        rd->pad.fd = rd->sinkWrite;
+        g_replay[index] = rd;
+    }
+    /* A second META for the same index is a replug: rebuild its routes. */
+    if (gp_device_open_replay(rd->dev, rd->srcRead, meta) < 0) {
+        fprintf(stderr, "[Replay] device %d: could not build routes.\n", index);
+        return NULL;
+    }
+    gp_pad_attach_source(&rd->pad, rd->dev);
+    printRoutes(tMs, index, rd->dev, meta);
+    return rd;
+}
+
+static void addSample(double pipeUs, double lateUs)
+{
+    if (g_frames == g_frameCap) {
+        unsigned long cap = g_frameCap ? g_frameCap * 2 : 4096;
+        double* p = realloc(g_pipeUs, cap * sizeof(double));
+        double* l = p ? realloc(g_lateUs, cap * sizeof(double)) : NULL;
+        if (p) g_pipeUs = p;
+        if (!l) return;
+        g_lateUs = l;
+        g_frameCap = cap;
+    }
+    g_pipeUs[g_frames] = pipeUs;
+    g_lateUs[g_frames] = lateUs;
+    g_frames++;
+}
+
+/*
+ * feedFrame => one recorded frame into the pipeline, at its recorded time
+ * unless --fast, then print whatever the pad wrote.
+ */
+static void feedFrame(int index, struct ReplayDev* rd, unsigned long long tUs, unsigned long long startNs)
+{
+    unsigned long long lateNs = 0;
+    if (!g_fast) {
+        unsigned long long target = startNs + tUs * 1000ULL;
+        struct timespec ts = { (time_t)(target / 1000000000ULL), (long)(target % 1000000000ULL) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        unsigned long long now = nowNs();
+        lateNs = now > target ? now - target : 0;
+    }
+
+    unsigned long long t0 = nowNs();
+    if (write(rd->srcWrite, rd->pending, (size_t)rd->pendingCount * sizeof(rd->pending[0])) < 0) {
+        perror("[Replay] source write");
+    }
+    rd->pendingCount = 0;
+    if (gp_device_pump(rd->dev) < 0) {
+        fprintf(stderr, "[Replay] device %d: source closed.\n", index);
+    }
+
+    struct input_event out[GP_FRAME_MAX_EVENTS * 2];
+    int printed = 0;
+    for (;;) {
+        ssize_t n = read(rd->sinkRead, out, sizeof(out));
+        if (n <= 0) break;
+        if (!printed) {
+            printed = 1;
+            fprintf(g_out, "%12.3f pad%d", (double)tUs / 1000.0, index);
+        }
+        for (size_t i = 0; i < (size_t)n / sizeof(out[0]); i++) {
+            if (out[i].type == EV_SYN) {
+                if (out[i].code != SYN_REPORT) fprintf(g_out, " SYN_%u", out[i].code);
+                continue;
+            }
+            fputc(' ', g_out);
+            printCode(out[i].type, out[i].code);
+            fprintf(g_out, "=%d", out[i].value);
+        }
+    }
+    if (printed) fputc('\n', g_out);
+    addSample((double)(nowNs() - t0) / 1e3, (double)lateNs / 1e3);
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void printStats(const char* what, double* v, unsigned long n)
+{
+    if (!n) return;
+    qsort(v, n, sizeof(double), cmpDouble);
+    fprintf(stderr, "[Replay] %-9s us p50=%.1f p99=%.1f max=%.1f\n", what,
+            v[n / 2], v[(unsigned long)(n * 0.99)], v[n - 1]);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = NULL;
+    const char* outPath = NULL;
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--fast")) g_fast = 1;
+        else if (!strncmp(argv[a], "--out=", 6)) outPath = argv[a] + 6;
+        else if (argv[a][0] != '-' && !path) path = argv[a];
+        else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [--fast] [--out=FILE] RECORDING\n", argv[0]);
+        return 1;
+    }
+
+    struct GpRecFile f;
+    if (gp_rec_map(&f, path) < 0) {
+        fprintf(stderr, "[Replay] '%s' => %s\n", path, strerror(errno));
+        return 1;
+    }
+    g_out = outPath ? fopen(outPath, "w") : stdout;
+    if (!g_out) {
+        fprintf(stderr, "[Replay] '%s' => %s\n", outPath, strerror(errno));
+        return 1;
+    }
+
+    gp_log_init();
+    gp_log_set_level(GP_LOG_CAPTURE, GP_LOG_WARN);
+    gp_log_start();
+
+    unsigned long long tUs = 0;
+    unsigned long long startNs = nowNs();
+    const struct GpRecDevice* meta;
+    const struct GpRecEvent* rec;
+    while ((rec = gp_rec_next(&f, &meta)) != NULL) {
+        tUs += rec->dtUs;
+        int index = rec->device;
+        if (meta) {
+            if (index < GP_MAX_DEVICES) openDevice(index, meta, (double)tUs / 1000.0);
+            continue;
+        }
+
+        struct ReplayDev* rd = index < GP_MAX_DEVICES ? g_replay[index] : NULL;
+        if (!rd) {
+            g_skipped++;            /* events of a device whose setup failed */
+            continue;
+        }
+        struct input_event* ev = &rd->pending[rd->pendingCount++];
+        memset(ev, 0, sizeof(*ev));
+        ev->type  = rec->type;
+        ev->code  = rec->code;
+        ev->value = rec->value;
+        if ((ev->type == EV_SYN && ev->code == SYN_REPORT) || rd->pendingCount == GP_READ_BATCH) {
+            feedFrame(index, rd, tUs, startNs);
+        }
+    }
+    if (f.pos != f.size) {
+        fprintf(stderr, "[Replay] ignoring %zu trailing bytes (torn record).\n", f.size - f.pos);
+    }
+
+    fprintf(stderr, "[Replay] %lu frames, %.3f s recorded%s", g_frames, (double)tUs / 1e6,
+            g_skipped ? "" : "\n");
+    if (g_skipped) fprintf(stderr, ", %lu events of unknown devices skipped\n", g_skipped);
+    printStats("pipeline", g_pipeUs, g_frames);
+    if (!g_fast) printStats("late", g_lateUs, g_frames);
+
+    if (g_out != stdout) fclose(g_out);
+    gp_rec_unmap(&f);
+    gp_log_stop();
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*****************************************************
+ * gammapad_route.c
+ *
+ * Builder + compiler for the routing table. See gammapad_route.h.
+ *****************************************************/
+
+#include "gammapad_route.h"
+
+void gp_route_builder_reset(struct GpRouteBuilder* b)
+{
+    if (!b) return;
+    memset(b, 0, sizeof(*b));
+}
+
+struct GpRoute* gp_route_builder_find(struct GpRouteBuilder* b, int inType, int inCode)
+{
+    if (!b) return NULL;
+    for (int i = 0; i < b->ruleCount; i++) {
+        if (b->rules[i].inType == inType && b->rules[i].inCode == inCode) {
+            return &b->rules[i];
+        }
+    }
+    return NULL;
+}
+
+int gp_route_builder_set(struct GpRouteBuilder* b,
+                         int inType, int inCode, int action, int outCode, int param)
+{
+    if (!b) return -1;
+
+    struct GpRoute* r = gp_route_builder_find(b, inType, inCode);
+    if (!r) {
+        if (b->ruleCount >= GP_ROUTE_MAX_RULES) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN,
+                "[Route] rule table full, ignoring type=%d code=%d\n", inType, inCode);
+            return -1;
+        }
+        r = &b->rules[b->ruleCount++];
+    }
+    memset(r, 0, sizeof(*r));
+    r->inType  = (__u8)inType;
+    r->inCode  = (__u16)inCode;
+    r->action  = (__u8)action;
+    r->outCode = (__u16)outCode;
+    r->param   = param;
+    return 0;
+}
+
+/*
+ * insertRoute => linear probing insert; the caller guarantees free slots.
+ */
+static void insertRoute(struct GpRouteTable* t, const struct GpRoute* src)
+{
+    unsigned int i = gp_route_hash(src->inType, src->inCode) & t->mask;
+    while (t->slots[i].inType != 0) {
+        if (t->slots[i].inType == src->inType && t->slots[i].inCode == src->inCode) break;
+        i = (i + 1) & t->mask;
+    }
+    if (t->slots[i].inType == 0) t->count++;
+    t->slots[i] = *src;
+    t->slots[i].state = 0;
+    t->slots[i].mergeSlot = GP_MERGE_NONE;
+}
+
+/*
+ * resolveRoute => explicit rule if any, otherwise identity for 'type'.
+ * Returns 0 if the input should not be routed at all.
+ */
+static int resolveRoute(const struct GpRouteBuilder* b, int type, int code, struct GpRoute* out)
+{
+    for (int i = 0; i < b->ruleCount; i++) {
+        if (b->rules[i].inType == type && b->rules[i].inCode == code) {
+            if (b->rules[i].action == GP_ROUTE_DROP) return 0;
+            *out = b->rules[i];
+            return 1;
+        }
+    }
+    memset(out, 0, sizeof(*out));
+    out->inType  = (__u8)type;
+    out->inCode  = (__u16)code;
+    out->action  = (type == EV_KEY) ? GP_ROUTE_KEY : GP_ROUTE_ABS;
+    out->outCode = (__u16)code;
+    return 1;
+}
+
+int gp_route_table_build(struct GpRouteTable* t, const struct GpRouteBuilder* b)
+{
+    if (!t || !b) return -1;
+
+    /* Pass 1: count what will be routed, to size the table. */
+    unsigned int n = 0;
+    struct GpRoute r;
+    for (int sc = 0; sc <= KEY_MAX; sc++) {
+        if (gp_test_bit(b->keyBits, sc) && resolveRoute(b, EV_KEY, sc, &r)) n++;
+    }
+    for (int sc = 0; sc <= ABS_MAX; sc++) {
+        if (gp_test_bit(b->absBits, sc) && resolveRoute(b, EV_ABS, sc, &r)) n++;
+    }
+
+    /* Keep the load factor <= 3/4 so probe chains stay short and always terminate. */
+    unsigned int cap = 8;
+    while (cap * 3 < n * 4 + 4) cap <<= 1;
+
+    struct GpRoute* slots = calloc(cap, sizeof(*slots));
+    if (!slots) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[Route] allocation of %u slots failed\n", cap);
+        return -1;
+    }
+
+    gp_route_table_free(t);
+    t->slots = slots;
+    t->mask  = cap - 1;
+    t->count = 0;
+
+    /* Pass 2: insert. */
+    for (int sc = 0; sc <= KEY_MAX; sc++) {
+        if (gp_test_bit(b->keyBits, sc) && resolveRoute(b, EV_KEY, sc, &r)) insertRoute(t, &r);
+    }
+    for (int sc = 0; sc <= ABS_MAX; sc++) {
+        if (gp_test_bit(b->absBits, sc) && resolveRoute(b, EV_ABS, sc, &r)) insertRoute(t, &r);
+    }
+
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO,
+        "[Route] compiled %u routes into %u slots (%zu bytes)\n",
+        t->count, cap, (size_t)cap * sizeof(*slots));
+    return 0;
+}
+
+void gp_route_table_free(struct GpRouteTable* t)
+{
+    if (!t) return;
+    free(t->slots);
+    t->slots = NULL;
+    t->mask  = 0;
+    t->count = 0;
+}
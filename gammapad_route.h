@@ -0,0 +1,148 @@
+#ifndef GAMMAPAD_ROUTE_H
+#define GAMMAPAD_ROUTE_H
+
+#include "gammapad.h"
+#include "gammapad_calib.h"
+#include "gammapad_filter.h"
+#include <linux/input.h>
+
+/*
+ * gammapad_route.h
+ *
+ * Compiled routing table: one lookup from a physical (type, code) to the
+ * output action for the virtual pad.
+ *
+ * Routes are collected at startup in a GpRouteBuilder (from the .kl file,
+ * the GammaPad profile and EVIOCGBIT discovery), then compiled into a
+ * small open-addressed hash table. Anything not in the table is dropped.
+ *
+ * A typical pad (~16 buttons + 6 axes) compiles into 32 slots of 12 bytes,
+ * and a lookup normally touches a single cache line.
+ */
+
+enum GpRouteAction {
+    GP_ROUTE_EMPTY = 0,     /* free hash slot                                   */
+    GP_ROUTE_DROP,          /* explicitly swallowed (only lives in the builder) */
+    GP_ROUTE_KEY,           /* EV_KEY  => EV_KEY outCode, value as-is           */
+    GP_ROUTE_ABS,           /* EV_ABS  => EV_ABS outCode, value as-is           */
+    GP_ROUTE_KEY_TO_ABS,    /* EV_KEY  => EV_ABS outCode: pressed=param, released=0 */
+    GP_ROUTE_ABS_TO_KEY     /* EV_ABS  => EV_KEY outCode: pressed while value crosses
+                               param (>= param if param >= 0, <= param if negative) */
+};
+
+struct GpRoute {
+    __u16 inCode;
+    __u8  inType;       /* EV_KEY or EV_ABS; 0 => empty slot */
+    __u8  action;       /* enum GpRouteAction */
+    __u16 outCode;
+    __u8  state;        /* ABS_TO_KEY: last emitted key state */
+    __u8  mergeSlot;    /* composite pads: index into GpMerge.slots, else GP_MERGE_NONE */
+    __s32 param;        /* KEY_TO_ABS value or ABS_TO_KEY threshold */
+};
+
+struct GpRouteTable {
+    unsigned int    mask;   /* slot count - 1 (power of two) */
+    unsigned int    count;  /* routes stored */
+    struct GpRoute* slots;
+};
+
+#define GP_MERGE_NONE 0xFF
+
+/*
+ * Builder: explicit rules plus the discovered input bitmaps.
+ * Explicit rules win over the identity mapping given to discovered codes.
+ */
+#define GP_ROUTE_MAX_RULES 256
+#define GP_BITS_PER_LONG   (8 * sizeof(unsigned long))
+#define GP_BITMAP_LONGS(n) (((n) + GP_BITS_PER_LONG - 1) / GP_BITS_PER_LONG)
+
+/*
+ * Profile overrides of a physical axis' EVIOCGABS fuzz/flat/resolution
+ * ("absinfo" directive, gammapad_profile.h); applied by discoverAxes().
+ */
+enum {
+    GP_ABS_SET_FUZZ = 1 << 0,
+    GP_ABS_SET_FLAT = 1 << 1,
+    GP_ABS_SET_RES  = 1 << 2
+};
+
+struct GpAbsOverride {
+    int set;            /* GP_ABS_SET_* */
+    int fuzz;
+    int flat;
+    int resolution;
+};
+
+struct GpRouteBuilder {
+    struct GpRoute rules[GP_ROUTE_MAX_RULES];
+    int            ruleCount;
+    unsigned long  keyBits[GP_BITMAP_LONGS(KEY_MAX + 1)];
+    unsigned long  absBits[GP_BITMAP_LONGS(ABS_MAX + 1)];
+    struct GpAbsOverride absOverride[ABS_MAX + 1];
+    struct GpFilterRule  filters[GP_FILTER_MAX_RULES];  /* profile filter/stick lines */
+    int                  filterCount;
+    struct GpCalRule     calib[GP_CAL_MAX_RULES];       /* profile calib/curve lines  */
+    int                  calibCount;
+    int                  outputRateHz;                  /* profile rate line, 0 => off */
+};
+
+static inline int gp_test_bit(const unsigned long* bits, int nr)
+{
+    return (int)((bits[nr / GP_BITS_PER_LONG] >> (nr % GP_BITS_PER_LONG)) & 1UL);
+}
+
+static inline void gp_set_bit(unsigned long* bits, int nr)
+{
+    bits[nr / GP_BITS_PER_LONG] |= 1UL << (nr % GP_BITS_PER_LONG);
+}
+
+static inline void gp_clear_bit(unsigned long* bits, int nr)
+{
+    bits[nr / GP_BITS_PER_LONG] &= ~(1UL << (nr % GP_BITS_PER_LONG));
+}
+
+static inline unsigned int gp_route_hash(unsigned int type, unsigned int code)
+{
+    return ((type << 12) ^ code) * 2654435761u >> 8;
+}
+
+/*
+ * gp_route_lookup => the single per-event lookup. Returns NULL if the
+ * (type, code) pair has no route, i.e. the event must be dropped.
+ */
+static inline struct GpRoute* gp_route_lookup(const struct GpRouteTable* t,
+                                              unsigned int type, unsigned int code)
+{
+    if (!t->slots) return NULL;
+    unsigned int i = gp_route_hash(type, code) & t->mask;
+    for (;;) {
+        struct GpRoute* r = &t->slots[i];
+        if (r->inType == type && r->inCode == code) return r;
+        if (r->inType == 0) return NULL;
+        i = (i + 1) & t->mask;
+    }
+}
+
+void gp_route_builder_reset(struct GpRouteBuilder* b);
+
+/* Add or replace the rule for (inType, inCode). Returns 0, or -1 when full. */
+int  gp_route_builder_set(struct GpRouteBuilder* b,
+                          int inType, int inCode, int action, int outCode, int param);
+
+/* Find the explicit rule for (inType, inCode), or NULL. */
+struct GpRoute* gp_route_builder_find(struct GpRouteBuilder* b, int inType, int inCode);
+
+/*
+ * gp_route_table_build => compile the builder into 't' (replacing any
+ * previous contents). Every discovered key/axis gets its explicit rule or
+ * the identity mapping; DROP rules and undiscovered inputs are left out.
+ */
+int  gp_route_table_build(struct GpRouteTable* t, const struct GpRouteBuilder* b);
+void gp_route_table_free(struct GpRouteTable* t);
+
+/* Iteration helper: i from 0..mask, skip entries with inType == 0. */
+#define GP_ROUTE_FOREACH(t, r) \
+    for (struct GpRoute* r = (t)->slots; (t)->slots && r <= &(t)->slots[(t)->mask]; r++) \
+        if (r->inType)
+
+#endif /* GAMMAPAD_ROUTE_H */
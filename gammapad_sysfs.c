@@ -0,0 +1,143 @@
+/*****************************************************
+ * gammapad_sysfs.c
+ *
+ * sysfs introspection via openat/readlinkat/realpath.
+ * See gammapad_sysfs.h.
+ *****************************************************/
+
+#include "gammapad_sysfs.h"
+
+static char g_sysfsRoot[PATH_MAX];
+
+const char* gp_sysfs_root(void)
+{
+    if (g_sysfsRoot[0]) return g_sysfsRoot;
+    const char* env = getenv("GAMMAPAD_SYSFS_ROOT");
+    return (env && *env) ? env : "/sys";
+}
+
+void gp_sysfs_set_root(const char* root)
+{
+    snprintf(g_sysfsRoot, sizeof(g_sysfsRoot), "%s", root ? root : "");
+    /* "/tmp/fake/" and "/tmp/fake" are the same root */
+    size_t len = strlen(g_sysfsRoot);
+    while (len > 1 && g_sysfsRoot[len - 1] == '/') g_sysfsRoot[--len] = 0;
+}
+
+/*
+ * readAttrAt => one sysfs attribute relative to dirfd, trailing newline
+ * stripped. Returns 0, or -1 if it does not exist / cannot be read.
+ */
+static int readAttrAt(int dirfd, const char* name, char* out, size_t outSize)
+{
+    out[0] = 0;
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    ssize_t n = read(fd, out, outSize - 1);
+    close(fd);
+    if (n < 0) {
+        out[0] = 0;
+        return -1;
+    }
+    out[n] = 0;
+    while (n > 0 && (out[n - 1] == '\n' || out[n - 1] == ' ')) out[--n] = 0;
+    return 0;
+}
+
+static int hasLinkAt(int dirfd, const char* name)
+{
+    char target[8];
+    return readlinkat(dirfd, name, target, sizeof(target)) >= 0;
+}
+
+/* copyStr => bounded copy, always terminated (names are truncated, not rejected) */
+static void copyStr(char* dst, size_t size, const char* src)
+{
+    size_t len = strlen(src);
+    if (len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = 0;
+}
+
+static const char* baseName(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/*
+ * resolveUnder => realpath("<classDir>/<rel>") into out.
+ */
+static int resolveUnder(const char* classDir, const char* rel, char* out, size_t outSize)
+{
+    char path[PATH_MAX];
+    char resolved[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s/%s", classDir, rel) >= (int)sizeof(path)) return -1;
+    if (!realpath(path, resolved)) return -1;
+    if (snprintf(out, outSize, "%s", resolved) >= (int)outSize) return -1;
+    return 0;
+}
+
+int gp_sysfs_identify(const char* eventNode, struct GpSysfsInfo* out)
+{
+    if (!eventNode || !out) return -1;
+    memset(out, 0, sizeof(*out));
+
+    const char* evBase = baseName(eventNode);
+    char classDir[PATH_MAX];
+    if (snprintf(classDir, sizeof(classDir), "%s/class/input/%s", gp_sysfs_root(), evBase)
+            >= (int)sizeof(classDir)) {
+        return -1;
+    }
+
+    int evFd = open(classDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (evFd < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Sysfs] %s => %s\n", classDir, strerror(errno));
+        return -1;
+    }
+    int inputFd = openat(evFd, "device", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    close(evFd);
+    if (inputFd < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Sysfs] %s/device => %s\n", classDir, strerror(errno));
+        return -1;
+    }
+
+    readAttrAt(inputFd, "name", out->name, sizeof(out->name));
+    readAttrAt(inputFd, "phys", out->phys, sizeof(out->phys));
+    readAttrAt(inputFd, "uniq", out->uniq, sizeof(out->uniq));
+
+    /* Which node carries the driver: inputN itself, or (usually) its parent. */
+    const char* bound = NULL;
+    if (hasLinkAt(inputFd, "driver")) {
+        bound = "device";
+    } else if (hasLinkAt(inputFd, "device/driver")) {
+        bound = "device/device";
+    }
+    close(inputFd);
+
+    if (!bound) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[Sysfs] %s: no bound driver\n", evBase);
+        return -1;
+    }
+
+    char rel[64];
+    snprintf(rel, sizeof(rel), "%s/driver", bound);
+    if (resolveUnder(classDir, rel, out->driverPath, sizeof(out->driverPath)) < 0) return -1;
+    if (resolveUnder(classDir, bound, out->devicePath, sizeof(out->devicePath)) < 0) return -1;
+
+    copyStr(out->driverName, sizeof(out->driverName), baseName(out->driverPath));
+    copyStr(out->deviceName, sizeof(out->deviceName), baseName(out->devicePath));
+
+    char subsystem[PATH_MAX];
+    snprintf(rel, sizeof(rel), "%s/subsystem", bound);
+    if (resolveUnder(classDir, rel, subsystem, sizeof(subsystem)) == 0) {
+        copyStr(out->bus, sizeof(out->bus), baseName(subsystem));
+    }
+
+    GP_LOG(GP_LOG_CAPTURE, GP_LOG_INFO,
+        "[Sysfs] %s => driver='%s' device='%s' bus='%s' name='%s' phys='%s' uniq='%s'\n",
+        evBase, out->driverPath, out->deviceName, out->bus, out->name, out->phys, out->uniq);
+    return 0;
+}
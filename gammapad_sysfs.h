@@ -0,0 +1,46 @@
+#ifndef GAMMAPAD_SYSFS_H
+#define GAMMAPAD_SYSFS_H
+
+#include "gammapad.h"
+#include <limits.h>
+
+/*
+ * gammapad_sysfs.h
+ *
+ * sysfs introspection for an evdev node, without spawning processes.
+ *
+ * For "/dev/input/event4" everything is resolved from
+ * <root>/class/input/event4 in one pass:
+ *
+ *   event4/device                  => the inputN node: name, phys, uniq
+ *   event4/device/driver           => bound driver, if inputN itself is bound
+ *   event4/device/device/driver    => otherwise the parent's (usual case);
+ *                                     that parent is the bound device
+ *   <bound device>/subsystem       => its bus ("platform", "usb", "hid", ...)
+ *
+ * <root> is "/sys" unless $GAMMAPAD_SYSFS_ROOT or gp_sysfs_set_root() says
+ * otherwise, so a fake tree (relative symlinks, plain files) works in tests.
+ */
+
+struct GpSysfsInfo {
+    char driverPath[256];   /* e.g. "/sys/bus/platform/drivers/retrogame_joypad" */
+    char driverName[64];    /* e.g. "retrogame_joypad"                          */
+    char devicePath[256];   /* bound device, e.g. "/sys/devices/platform/singleadc-joypad" */
+    char deviceName[128];   /* what goes into driver/unbind, e.g. "singleadc-joypad" */
+    char bus[32];           /* subsystem of the bound device                     */
+    char name[128];         /* inputN/name */
+    char phys[64];          /* inputN/phys */
+    char uniq[64];          /* inputN/uniq */
+};
+
+const char* gp_sysfs_root(void);
+void        gp_sysfs_set_root(const char* root);
+
+/*
+ * gp_sysfs_identify => fill 'out' for 'eventNode' (only its basename is
+ * used). Returns 0 when a bound driver was found, -1 otherwise; the input
+ * attributes (name/phys/uniq) are filled in either way when available.
+ */
+int gp_sysfs_identify(const char* eventNode, struct GpSysfsInfo* out);
+
+#endif /* GAMMAPAD_SYSFS_H */
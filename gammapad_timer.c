@@ -0,0 +1,231 @@
+/*****************************************************
+ * gammapad_timer.c
+ *
+ * Min-heap of deadlines driving one timerfd. See gammapad_timer.h.
+ *****************************************************/
+
+#include "gammapad.h"
+#include "gammapad_timer.h"
+#include <sys/timerfd.h>
+
+/*
+ * Timer ids encode the pool slot (low 8 bits) and a generation counter,
+ * so cancelling an id whose slot was already reused is a harmless no-op.
+ */
+#define GP_TIMER_IDX_BITS 8
+#define GP_TIMER_IDX_MASK ((1 << GP_TIMER_IDX_BITS) - 1)
+
+struct GpTimer {
+    unsigned long long deadlineNs;
+    GpTimerCallback    cb;
+    void*              arg;
+    int                heapPos;   /* -1 => slot free */
+    unsigned int       gen;
+};
+
+static struct GpTimer g_pool[GP_TIMER_MAX];
+static int            g_heap[GP_TIMER_MAX];   /* pool indices, min-heap on deadline */
+static int            g_heapSize = 0;
+static int            g_timerFd  = -1;
+static unsigned long long g_armedNs = 0;      /* deadline the timerfd is set to, 0 => disarmed */
+static unsigned long g_addFailed = 0;          /* adds refused because the heap was full */
+static unsigned long g_failStreak = 0;         /* of those, since the last add that worked */
+
+static int timerLess(int a, int b)
+{
+    return g_pool[g_heap[a]].deadlineNs < g_pool[g_heap[b]].deadlineNs;
+}
+
+static void heapSwap(int a, int b)
+{
+    int t = g_heap[a];
+    g_heap[a] = g_heap[b];
+    g_heap[b] = t;
+    g_pool[g_heap[a]].heapPos = a;
+    g_pool[g_heap[b]].heapPos = b;
+}
+
+static void siftUp(int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timerLess(i, parent)) break;
+        heapSwap(i, parent);
+        i = parent;
+    }
+}
+
+static void siftDown(int i)
+{
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < g_heapSize && timerLess(l, m)) m = l;
+        if (r < g_heapSize && timerLess(r, m)) m = r;
+        if (m == i) break;
+        heapSwap(i, m);
+        i = m;
+    }
+}
+
+static void heapRemoveAt(int i)
+{
+    int idx = g_heap[i];
+    g_heapSize--;
+    if (i != g_heapSize) {
+        g_heap[i] = g_heap[g_heapSize];
+        g_pool[g_heap[i]].heapPos = i;
+        siftDown(i);
+        siftUp(i);
+    }
+    g_pool[idx].heapPos = -1;
+}
+
+/*
+ * rearm => point the timerfd at the earliest deadline (absolute), or
+ * disarm it if nothing is pending. Skips the syscall if nothing changed.
+ */
+static void rearm(void)
+{
+    if (g_timerFd < 0) return;
+
+    unsigned long long next = g_heapSize ? g_pool[g_heap[0]].deadlineNs : 0;
+    if (next == g_armedNs) return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next) {
+        its.it_value.tv_sec  = (time_t)(next / 1000000000ULL);
+        its.it_value.tv_nsec = (long)(next % 1000000000ULL);
+    }
+    if (timerfd_settime(g_timerFd, next ? TFD_TIMER_ABSTIME : 0, &its, NULL) < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[GammaPadTimer] timerfd_settime => %s\n", strerror(errno));
+        return;
+    }
+    g_armedNs = next;
+}
+
+int gp_timer_init(void)
+{
+    if (g_timerFd >= 0) return 0;
+
+    for (int i = 0; i < GP_TIMER_MAX; i++) {
+        g_pool[i].heapPos = -1;
+        g_pool[i].gen     = 1;
+    }
+    g_heapSize = 0;
+    g_armedNs  = 0;
+
+    g_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_timerFd < 0) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_ERROR, "[GammaPadTimer] timerfd_create => %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void gp_timer_shutdown(void)
+{
+    if (g_timerFd >= 0) close(g_timerFd);
+    g_timerFd  = -1;
+    g_heapSize = 0;
+    g_armedNs  = 0;
+    for (int i = 0; i < GP_TIMER_MAX; i++) g_pool[i].heapPos = -1;
+}
+
+int gp_timer_fd(void)
+{
+    return g_timerFd;
+}
+
+int gp_timer_pending(void)
+{
+    return g_heapSize;
+}
+
+unsigned long gp_timer_add_failed(void)
+{
+    return g_addFailed;
+}
+
+int gp_timer_add_ns(unsigned long long delayNs, GpTimerCallback cb, void* arg)
+{
+    if (!cb) return -1;
+    if (g_heapSize >= GP_TIMER_MAX) {
+        /* Can happen once per frame (rate limiter): warn when it starts, count the rest. */
+        g_addFailed++;
+        if (!g_failStreak++) {
+            GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadTimer] pool full (%d pending), timers dropped.\n",
+                   g_heapSize);
+        }
+        return -1;
+    }
+    if (g_failStreak) {
+        GP_LOG(GP_LOG_CAPTURE, GP_LOG_WARN, "[GammaPadTimer] pool has room again, %lu timer(s) were dropped.\n",
+               g_failStreak);
+        g_failStreak = 0;
+    }
+
+    int idx = -1;
+    for (int i = 0; i < GP_TIMER_MAX; i++) {
+        if (g_pool[i].heapPos < 0) { idx = i; break; }
+    }
+    if (idx < 0) return -1;
+
+    struct GpTimer* t = &g_pool[idx];
+    t->deadlineNs = getMonotonicNs() + delayNs;
+    t->cb  = cb;
+    t->arg = arg;
+
+    g_heap[g_heapSize] = idx;
+    t->heapPos = g_heapSize;
+    g_heapSize++;
+    siftUp(t->heapPos);
+    rearm();
+
+    return (int)(((t->gen & 0x7fffffu) << GP_TIMER_IDX_BITS) | (unsigned)idx);
+}
+
+int gp_timer_add_ms(unsigned long long delayMs, GpTimerCallback cb, void* arg)
+{
+    return gp_timer_add_ns(delayMs * 1000000ULL, cb, arg);
+}
+
+int gp_timer_cancel(int id)
+{
+    if (id <= 0) return -1;
+    int idx = id & GP_TIMER_IDX_MASK;
+    if (idx >= GP_TIMER_MAX) return -1;
+
+    struct GpTimer* t = &g_pool[idx];
+    if (t->heapPos < 0) return -1;
+    if ((t->gen & 0x7fffffu) != ((unsigned)id >> GP_TIMER_IDX_BITS)) return -1;
+
+    heapRemoveAt(t->heapPos);
+    t->gen++;
+    rearm();
+    return 0;
+}
+
+void gp_timer_dispatch(void)
+{
+    if (g_timerFd < 0) return;
+
+    unsigned long long expirations;
+    while (read(g_timerFd, &expirations, sizeof(expirations)) > 0) {
+        /* drain => edge-triggered epoll needs the fd empty */
+    }
+    g_armedNs = 0; /* the one-shot setting has fired or is stale */
+
+    unsigned long long now = getMonotonicNs();
+    while (g_heapSize > 0 && g_pool[g_heap[0]].deadlineNs <= now) {
+        int idx = g_heap[0];
+        struct GpTimer* t = &g_pool[idx];
+        GpTimerCallback cb = t->cb;
+        void* arg = t->arg;
+
+        heapRemoveAt(0);
+        t->gen++;
+        cb(arg);
+    }
+    rearm();
+}
@@ -0,0 +1,46 @@
+#ifndef GAMMAPAD_TIMER_H
+#define GAMMAPAD_TIMER_H
+
+/*
+ * gammapad_timer.h
+ *
+ * One-shot timers for the main epoll loop.
+ *
+ * Deadlines live in a min-heap; a single timerfd (CLOCK_MONOTONIC,
+ * absolute) is always armed to the earliest one, or disarmed when the
+ * heap is empty, so an idle daemon never wakes up. Add gp_timer_fd() to
+ * the epoll set and call gp_timer_dispatch() when it becomes readable.
+ *
+ * Callbacks run on the main loop thread and may add or cancel timers.
+ * Not thread-safe: only use from the main loop.
+ */
+
+typedef void (*GpTimerCallback)(void* arg);
+
+/* Maximum number of pending timers. */
+#define GP_TIMER_MAX 256
+
+int  gp_timer_init(void);
+void gp_timer_shutdown(void);
+int  gp_timer_fd(void);
+
+/*
+ * Schedule 'cb(arg)' after delayNs / delayMs. Returns a timer id (> 0)
+ * usable with gp_timer_cancel(), or -1 if the heap is full.
+ */
+int  gp_timer_add_ns(unsigned long long delayNs, GpTimerCallback cb, void* arg);
+int  gp_timer_add_ms(unsigned long long delayMs, GpTimerCallback cb, void* arg);
+
+/* Cancel a pending timer. Returns 0, or -1 if it already fired/was cancelled. */
+int  gp_timer_cancel(int id);
+
+/* Run every expired timer, then re-arm the timerfd. */
+void gp_timer_dispatch(void);
+
+/* Number of timers currently pending. */
+int  gp_timer_pending(void);
+
+/* Adds refused since startup because GP_TIMER_MAX timers were pending. */
+unsigned long gp_timer_add_failed(void);
+
+#endif /* GAMMAPAD_TIMER_H */
@@ -0,0 +1,159 @@
+/*****************************************************
+ * gammapad_trace.c
+ *
+ * Stage histograms + span ring for Chrome trace export.
+ * See gammapad_trace.h.
+ *****************************************************/
+
+#include "gammapad_trace.h"
+#include <stdatomic.h>
+
+#define TR_SUB_BITS   4
+#define TR_SUB        (1 << TR_SUB_BITS)
+#define TR_MAX_EXP    40                                  /* ~18 minutes in ns */
+#define TR_BUCKETS    ((TR_MAX_EXP - TR_SUB_BITS + 2) * TR_SUB)
+
+struct GpTraceHist {
+    _Atomic unsigned int      bucket[TR_BUCKETS];
+    _Atomic unsigned long long count;
+    _Atomic unsigned long long maxNs;
+};
+
+struct GpTraceSpan {
+    unsigned long long startNs;
+    unsigned int       durNs;
+    int                stage;
+};
+
+static const char* const g_stageNames[GP_TR_STAGES] = {
+    "read", "remap", "filter", "coalesce", "write", "total", "ff_upload", "ff_queue", "ff_play"
+};
+
+/* Chrome trace rows: the main loop, and the haptics worker. */
+static const int g_stageTid[GP_TR_STAGES] = { 1, 1, 1, 1, 1, 1, 1, 2, 2 };
+
+int g_gpTraceOn = 0;
+
+static struct GpTraceHist g_hist[GP_TR_STAGES];
+static struct GpTraceSpan g_ring[GP_TRACE_RING];
+static _Atomic unsigned long long g_ringHead;
+
+static unsigned int bucketOf(unsigned long long v)
+{
+    if (v < TR_SUB) return (unsigned int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > TR_MAX_EXP) return TR_BUCKETS - 1;
+    unsigned int sub = (unsigned int)(v >> (e - TR_SUB_BITS)) & (TR_SUB - 1);
+    return (unsigned int)(e - TR_SUB_BITS + 1) * TR_SUB + sub;
+}
+
+/* bucketTop => largest value that lands in bucket b. */
+static unsigned long long bucketTop(unsigned int b)
+{
+    if (b < TR_SUB) return b;
+    int e = (int)(b / TR_SUB) + TR_SUB_BITS - 1;
+    unsigned long long sub = b % TR_SUB;
+    return ((TR_SUB + sub + 1) << (e - TR_SUB_BITS)) - 1;
+}
+
+/* Single writer per stage => a plain increment, published relaxed. */
+static inline void bump(_Atomic unsigned int* c)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void gp_trace_span(int stage, unsigned long long startNs, unsigned long long endNs)
+{
+    if (stage < 0 || stage >= GP_TR_STAGES || !startNs) return;
+    unsigned long long d = endNs > startNs ? endNs - startNs : 0;
+
+    struct GpTraceHist* h = &g_hist[stage];
+    bump(&h->bucket[bucketOf(d)]);
+    atomic_store_explicit(&h->count, atomic_load_explicit(&h->count, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    if (d > atomic_load_explicit(&h->maxNs, memory_order_relaxed)) {
+        atomic_store_explicit(&h->maxNs, d, memory_order_relaxed);
+    }
+
+    /* Two threads record spans, so the ring slot is claimed atomically. */
+    unsigned long long i = atomic_fetch_add_explicit(&g_ringHead, 1, memory_order_relaxed);
+    struct GpTraceSpan* s = &g_ring[i & (GP_TRACE_RING - 1)];
+    s->startNs = startNs;
+    s->durNs   = d > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)d;
+    s->stage   = stage;
+}
+
+int gp_trace_enable(int on)
+{
+#if GAMMAPAD_TRACE
+    g_gpTraceOn = on ? 1 : 0;
+    return 0;
+#else
+    (void)on;
+    return -1;
+#endif
+}
+
+void gp_trace_reset(void)
+{
+    for (int s = 0; s < GP_TR_STAGES; s++) {
+        for (int b = 0; b < TR_BUCKETS; b++) atomic_store(&g_hist[s].bucket[b], 0);
+        atomic_store(&g_hist[s].count, 0);
+        atomic_store(&g_hist[s].maxNs, 0);
+    }
+    atomic_store(&g_ringHead, 0);
+}
+
+static double percentileUs(const struct GpTraceHist* h, unsigned long long count, double q)
+{
+    unsigned long long want = (unsigned long long)(q * (double)count + 0.5);
+    unsigned long long seen = 0;
+    unsigned long long maxNs = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    if (!want) want = 1;
+    for (unsigned int b = 0; b < TR_BUCKETS; b++) {
+        seen += atomic_load_explicit(&h->bucket[b], memory_order_relaxed);
+        if (seen >= want) {
+            unsigned long long top = bucketTop(b);
+            return (double)(top < maxNs ? top : maxNs) / 1e3;
+        }
+    }
+    return (double)maxNs / 1e3;
+}
+
+void gp_trace_print(FILE* out)
+{
+    fprintf(out, "[Trace] %-10s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int s = 0; s < GP_TR_STAGES; s++) {
+        const struct GpTraceHist* h = &g_hist[s];
+        unsigned long long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        if (!count) continue;
+        fprintf(out, "[Trace] %-10s %10llu %10.1f %10.1f %10.1f %10.1f\n", g_stageNames[s], count,
+                percentileUs(h, count, 0.50), percentileUs(h, count, 0.99), percentileUs(h, count, 0.999),
+                (double)atomic_load_explicit(&h->maxNs, memory_order_relaxed) / 1e3);
+    }
+}
+
+int gp_trace_dump(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+
+    unsigned long long head = atomic_load_explicit(&g_ringHead, memory_order_relaxed);
+    unsigned long long first = head > GP_TRACE_RING ? head - GP_TRACE_RING : 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main loop\"}},\n"
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"haptics\"}}");
+    int written = 0;
+    for (unsigned long long i = first; i < head; i++) {
+        const struct GpTraceSpan* s = &g_ring[i & (GP_TRACE_RING - 1)];
+        if (s->stage < 0 || s->stage >= GP_TR_STAGES) continue;
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                g_stageNames[s->stage], s->stage >= GP_TR_FF_UPLOAD ? "ff" : "input",
+                g_stageTid[s->stage], (double)s->startNs / 1e3, (double)s->durNs / 1e3);
+        written++;
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) return -1;
+    return written;
+}
@@ -0,0 +1,79 @@
+#ifndef GAMMAPAD_TRACE_H
+#define GAMMAPAD_TRACE_H
+
+#include "gammapad.h"
+
+/*
+ * gammapad_trace.h
+ *
+ * Per-stage latency tracing of the input and FF pipelines.
+ *
+ * Build with -DGAMMAPAD_TRACE=1 (make TRACE=1) to compile the tracepoints
+ * in; otherwise GP_TRACE_ON() is the constant 0 and every tracepoint is
+ * dropped by the compiler. Compiled in, they stay off until enabled
+ * ("trace on" console command, or --trace), and then cost one flag test
+ * each.
+ *
+ * Every span lands in its stage's log-linear histogram (16 sub-buckets
+ * per power of two, so percentiles are within ~6%) and in a ring of the
+ * last GP_TRACE_RING spans, which gp_trace_dump() writes as Chrome trace
+ * JSON (chrome://tracing, Perfetto).
+ *
+ * Input stages, per physical frame (gammapad_capture):
+ *   read     => kernel timestamp of the SYN_REPORT to read() returning
+ *   remap    => read() returning to the SYN_REPORT being routed
+ *   filter   => the frame's held axes through gammapad_filter (devices
+ *               with filter rules only)
+ *   coalesce => first event of the pad frame to its flush
+ *   write    => the frame write() to the pad
+ *   total    => kernel timestamp to write() returning
+ * FF stages (uinput pad, haptics worker):
+ *   ff_upload => UI_BEGIN_FF_UPLOAD to the effect being stored
+ *   ff_queue  => play queued by the main thread to the worker picking it up
+ *   ff_play   => worker picking it up to the first motor kick (includes
+ *                the effect's replay delay)
+ *
+ * Each stage is recorded by a single thread, so histogram counters use
+ * relaxed load/store rather than atomic read-modify-write.
+ */
+
+#ifndef GAMMAPAD_TRACE
+#define GAMMAPAD_TRACE 0
+#endif
+
+enum GpTraceStage {
+    GP_TR_READ = 0,
+    GP_TR_REMAP,
+    GP_TR_FILTER,
+    GP_TR_COALESCE,
+    GP_TR_WRITE,
+    GP_TR_TOTAL,
+    GP_TR_FF_UPLOAD,
+    GP_TR_FF_QUEUE,
+    GP_TR_FF_PLAY,
+    GP_TR_STAGES
+};
+
+#define GP_TRACE_RING 16384   /* spans kept for gp_trace_dump(), power of two */
+
+#if GAMMAPAD_TRACE
+extern int g_gpTraceOn;
+#define GP_TRACE_ON() __builtin_expect(g_gpTraceOn, 0)
+#else
+#define GP_TRACE_ON() 0
+#endif
+
+/* Record one span; startNs/endNs on CLOCK_MONOTONIC (getMonotonicNs). */
+void gp_trace_span(int stage, unsigned long long startNs, unsigned long long endNs);
+
+/* Turn recording on/off. Returns -1 if tracing is compiled out. */
+int  gp_trace_enable(int on);
+void gp_trace_reset(void);
+
+/* Count and p50/p99/p99.9/max per stage to 'out'. */
+void gp_trace_print(FILE* out);
+
+/* Chrome trace JSON of the spans in the ring. Returns spans written or -1. */
+int  gp_trace_dump(const char* path);
+
+#endif /* GAMMAPAD_TRACE_H */
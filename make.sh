@@ -1,3 +1,9 @@
+# The NEON axis filter kernel (gammapad_filter.c) is only compiled by this
+# build: stop before linking if the compiler has anything to say about it.
+/root/android-ndk-r25c/toolchains/llvm/prebuilt/linux-x86_64/bin/aarch64-linux-android33-clang \
+-O3 -Wall -Werror -fsyntax-only \
+gammapad_filter.c || exit 1
+
 ARCH=arm64 \
 /root/android-ndk-r25c/toolchains/llvm/prebuilt/linux-x86_64/bin/aarch64-linux-android33-clang \
 -O3 \
@@ -7,6 +13,21 @@ gammapad_inputdefs.c \
 gammapad_ff.c \
 gammapad_commands.c \
 gammapad_capture.c \
+gammapad_log.c \
+gammapad_route.c \
+gammapad_profile.c \
+gammapad_timer.c \
+gammapad_hotplug.c \
+gammapad_sysfs.c \
+gammapad_rebind.c \
+gammapad_haptics.c \
+gammapad_ffmix.c \
+gammapad_record.c \
+gammapad_trace.c \
+gammapad_metrics.c \
+gammapad_filter.c \
+gammapad_calib.c \
+-lm \
 -o gammapad
 
 
@@ -14,3 +35,28 @@ gammapad_capture.c \
 -O3 \
 rumbletest.c \
 -o rumbletest
+
+
+# Push it and run './gammapad_microbench --check' on the device before
+# shipping: it checks the NEON kernel against the scalar one.
+/root/android-ndk-r25c/toolchains/llvm/prebuilt/linux-x86_64/bin/aarch64-linux-android33-clang \
+-O3 \
+gammapad_microbench.c \
+gammapad_commands.c \
+gammapad_ff.c \
+gammapad_haptics.c \
+gammapad_ffmix.c \
+gammapad_capture.c \
+gammapad_inputdefs.c \
+gammapad_log.c \
+gammapad_route.c \
+gammapad_profile.c \
+gammapad_timer.c \
+gammapad_sysfs.c \
+gammapad_rebind.c \
+gammapad_record.c \
+gammapad_trace.c \
+gammapad_filter.c \
+gammapad_calib.c \
+-lm \
+-o gammapad_microbench
@@ -1,12 +1,45 @@
+/*
+ * rumbletest: FF demo and benchmark for GammaPad's virtual pad.
+ *
+ *   rumbletest <event_number>
+ *       Plays every effect type for DURATION ms (feel test).
+ *
+ *   rumbletest --bench <event_number> [--iterations=N] [--motor=PATH]
+ *              [--baseline=FILE] [--save-baseline=FILE]
+ *       Measures what a game sees:
+ *         upload-new / upload-update => EVIOCSFF round trip (blocks on
+ *                                       GammaPad's handleFFRequest)
+ *         play-to-motor              => EV_FF play write -> first "1"
+ *                                       written to the motor node
+ *       play-to-motor needs GammaPad started with
+ *       --ff=timed_output --vib-path=PATH, PATH being a FIFO (mkfifo) or a
+ *       plain file, and the same PATH given as --motor here.
+ *       Prints min/p50/p90/p99/p99.9/max in microseconds. With --baseline,
+ *       a p50 or p99 more than BENCH_SLACK_PCT % (and BENCH_SLACK_US) above
+ *       the baseline is reported as a regression and the exit code is 2.
+ */
+
 #include <linux/input.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
 #define DURATION 6000 // Duration of each effect in milliseconds
 
+#define BENCH_DEFAULT_ITERATIONS 2000
+#define BENCH_MOTOR_TIMEOUT_MS   500   // no motor write within this => miss
+#define BENCH_SLACK_PCT          20
+#define BENCH_SLACK_US           50.0  // noise floor for the regression check
+#define BENCH_MAX_RESULTS        8
+
 void play_effect(int fd, struct ff_effect *effect) {
     struct input_event play, stop;
 
@@ -37,21 +70,7 @@ void play_effect(int fd, struct ff_effect *effect) {
     printf("Stopped effect: %d\n", effect->id);
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <event_number>\n", argv[0]);
-        return 1;
-    }
-
-    char device_path[64];
-    snprintf(device_path, sizeof(device_path), "/dev/input/event%s", argv[1]);
-
-    int fd = open(device_path, O_RDWR);
-    if (fd < 0) {
-        perror("Failed to open device");
-        return 1;
-    }
-
+static int run_demo(int fd) {
     struct ff_effect effect;
     memset(&effect, 0, sizeof(effect));
 
@@ -151,6 +170,331 @@ int main(int argc, char *argv[]) {
         perror("FF_INERTIA not supported");
     }
 
+    return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Benchmark                                                              */
+/* ---------------------------------------------------------------------- */
+
+struct bench_result {
+    char   name[32];
+    int    count;
+    int    misses;
+    double min, p50, p90, p99, p999, max;
+};
+
+static struct bench_result g_results[BENCH_MAX_RESULTS];
+static int g_result_count = 0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array.
+static double percentile(const double *v, int n, double q) {
+    int i = (int)(q * n + 0.5) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return v[i];
+}
+
+static void record(const char *name, double *v, int n, int misses) {
+    if (g_result_count >= BENCH_MAX_RESULTS) return;
+    struct bench_result *r = &g_results[g_result_count++];
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->count  = n;
+    r->misses = misses;
+    if (n > 0) {
+        qsort(v, n, sizeof(double), cmp_double);
+        r->min  = v[0];
+        r->p50  = percentile(v, n, 0.50);
+        r->p90  = percentile(v, n, 0.90);
+        r->p99  = percentile(v, n, 0.99);
+        r->p999 = percentile(v, n, 0.999);
+        r->max  = v[n - 1];
+    }
+    printf("%-15s n=%-6d min=%8.1f p50=%8.1f p90=%8.1f p99=%8.1f p99.9=%8.1f max=%8.1f us",
+           r->name, n, r->min, r->p50, r->p90, r->p99, r->p999, r->max);
+    if (misses) printf("  (%d missed)", misses);
+    printf("\n");
+}
+
+/*
+ * bench_upload: new effect (id=-1) and in-place update (same id, new
+ * strength, what games do every frame), erasing after each pair.
+ */
+static void bench_upload(int fd, int iterations) {
+    double *new_us = calloc(iterations, sizeof(double));
+    double *upd_us = calloc(iterations, sizeof(double));
+    int n_new = 0, n_upd = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        struct ff_effect effect;
+        memset(&effect, 0, sizeof(effect));
+        effect.type = FF_RUMBLE;
+        effect.id = -1;
+        effect.u.rumble.strong_magnitude = 0x4000;
+        effect.u.rumble.weak_magnitude = 0x2000;
+        effect.replay.length = 100;
+
+        double t0 = now_us();
+        if (ioctl(fd, EVIOCSFF, &effect) < 0) {
+            perror("EVIOCSFF (new)");
+            break;
+        }
+        new_us[n_new++] = now_us() - t0;
+
+        effect.u.rumble.strong_magnitude = (__u16)(0x1000 + (i & 0x3fff));
+        t0 = now_us();
+        if (ioctl(fd, EVIOCSFF, &effect) == 0) {
+            upd_us[n_upd++] = now_us() - t0;
+        } else {
+            perror("EVIOCSFF (update)");
+        }
+
+        ioctl(fd, EVIOCRMFF, effect.id);
+    }
+
+    record("upload-new", new_us, n_new, iterations - n_new);
+    record("upload-update", upd_us, n_upd, iterations - n_upd);
+    free(new_us);
+    free(upd_us);
+}
+
+/*
+ * Motor probe: watches the node GammaPad's haptics worker writes "1"/"0"
+ * to. A FIFO is read directly; a plain file is watched with inotify and
+ * re-read on every modification.
+ */
+struct motor_probe {
+    int fd;
+    int inotify_fd;   // -1 => FIFO
+};
+
+static int probe_open(struct motor_probe *p, const char *path) {
+    struct stat st;
+    memset(p, 0, sizeof(*p));
+    p->fd = p->inotify_fd = -1;
+    if (stat(path, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    p->fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (p->fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (!S_ISFIFO(st.st_mode)) {
+        p->inotify_fd = inotify_init1(IN_NONBLOCK);
+        if (p->inotify_fd < 0 || inotify_add_watch(p->inotify_fd, path, IN_MODIFY) < 0) {
+            perror("inotify");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void probe_close(struct motor_probe *p) {
+    if (p->fd >= 0) close(p->fd);
+    if (p->inotify_fd >= 0) close(p->inotify_fd);
+}
+
+// Last motor value seen ('0'/'1'), or 0 if nothing new.
+static char probe_read(struct motor_probe *p) {
+    char buf[256];
+    char last = 0;
+    if (p->inotify_fd < 0) {
+        ssize_t n;
+        while ((n = read(p->fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < n; i++) {
+                if (buf[i] == '0' || buf[i] == '1') last = buf[i];
+            }
+        }
+        return last;
+    }
+    int modified = 0;
+    while (read(p->inotify_fd, buf, sizeof(buf)) > 0) modified = 1;
+    if (modified && pread(p->fd, buf, 1, 0) == 1) last = buf[0];
+    return last;
+}
+
+// Wait until the motor is set to 'want'. Returns 0, or -1 on timeout.
+static int probe_wait(struct motor_probe *p, char want, int timeout_ms) {
+    struct pollfd pfd = { p->inotify_fd >= 0 ? p->inotify_fd : p->fd, POLLIN, 0 };
+    double deadline = now_us() + timeout_ms * 1000.0;
+    for (;;) {
+        if (probe_read(p) == want) return 0;
+        int left = (int)((deadline - now_us()) / 1000.0);
+        if (left < 0) return -1;
+        poll(&pfd, 1, left > 0 ? left : 1);
+    }
+}
+
+static int send_ff(int fd, int code, int value) {
+    struct input_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = EV_FF;
+    ev.code = code;
+    ev.value = value;
+    return write(fd, &ev, sizeof(ev)) == sizeof(ev) ? 0 : -1;
+}
+
+static void bench_play(int fd, const char *motor_path, int iterations) {
+    struct motor_probe probe;
+    if (probe_open(&probe, motor_path) < 0) return;
+
+    struct ff_effect effect;
+    memset(&effect, 0, sizeof(effect));
+    effect.type = FF_RUMBLE;
+    effect.id = -1;
+    effect.u.rumble.strong_magnitude = 0x8000;
+    effect.replay.length = 1000;
+    if (ioctl(fd, EVIOCSFF, &effect) < 0) {
+        perror("EVIOCSFF (play bench)");
+        probe_close(&probe);
+        return;
+    }
+
+    double *us = calloc(iterations, sizeof(double));
+    int n = 0, misses = 0;
+    for (int i = 0; i < iterations; i++) {
+        probe_read(&probe);  // drain
+        double t0 = now_us();
+        if (send_ff(fd, effect.id, 1) < 0) {
+            perror("play");
+            break;
+        }
+        if (probe_wait(&probe, '1', BENCH_MOTOR_TIMEOUT_MS) == 0) {
+            us[n++] = now_us() - t0;
+        } else {
+            misses++;
+        }
+        send_ff(fd, effect.id, 0);
+        probe_wait(&probe, '0', BENCH_MOTOR_TIMEOUT_MS);
+    }
+
+    record("play-to-motor", us, n, misses);
+    free(us);
+    ioctl(fd, EVIOCRMFF, effect.id);
+    probe_close(&probe);
+}
+
+static int save_baseline(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "# rumbletest baseline: name p50_us p99_us\n");
+    for (int i = 0; i < g_result_count; i++) {
+        if (g_results[i].count) {
+            fprintf(f, "%s %.1f %.1f\n", g_results[i].name, g_results[i].p50, g_results[i].p99);
+        }
+    }
+    fclose(f);
+    printf("Baseline saved to %s\n", path);
+    return 0;
+}
+
+static int regressed(double now, double base) {
+    return now > base * (100 + BENCH_SLACK_PCT) / 100.0 && now - base > BENCH_SLACK_US;
+}
+
+// Returns the number of regressions, or -1 if the baseline can't be read.
+static int check_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[128], name[32];
+    double p50, p99;
+    int bad = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%31s %lf %lf", name, &p50, &p99) != 3) continue;
+        for (int i = 0; i < g_result_count; i++) {
+            struct bench_result *r = &g_results[i];
+            if (strcmp(r->name, name) || !r->count) continue;
+            if (regressed(r->p50, p50) || regressed(r->p99, p99)) {
+                printf("REGRESSION %-15s p50 %.1f -> %.1f us, p99 %.1f -> %.1f us\n",
+                       name, p50, r->p50, p99, r->p99);
+                bad++;
+            } else {
+                printf("ok         %-15s p50 %.1f -> %.1f us, p99 %.1f -> %.1f us\n",
+                       name, p50, r->p50, p99, r->p99);
+            }
+        }
+    }
+    fclose(f);
+    return bad;
+}
+
+static int open_device(const char *arg) {
+    char device_path[64];
+    if (strchr(arg, '/')) snprintf(device_path, sizeof(device_path), "%s", arg);
+    else snprintf(device_path, sizeof(device_path), "/dev/input/event%s", arg);
+
+    int fd = open(device_path, O_RDWR);
+    if (fd < 0) perror("Failed to open device");
+    return fd;
+}
+
+static int run_bench(int argc, char *argv[]) {
+    const char *device = NULL, *motor = NULL, *baseline = NULL, *save = NULL;
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+
+    for (int i = 2; i < argc; i++) {
+        if (!strncmp(argv[i], "--iterations=", 13)) iterations = atoi(argv[i] + 13);
+        else if (!strncmp(argv[i], "--motor=", 8)) motor = argv[i] + 8;
+        else if (!strncmp(argv[i], "--baseline=", 11)) baseline = argv[i] + 11;
+        else if (!strncmp(argv[i], "--save-baseline=", 16)) save = argv[i] + 16;
+        else device = argv[i];
+    }
+    if (!device || iterations <= 0) {
+        fprintf(stderr, "Usage: %s --bench <event_number> [--iterations=N] [--motor=PATH]"
+                        " [--baseline=FILE] [--save-baseline=FILE]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open_device(device);
+    if (fd < 0) return 1;
+
+    bench_upload(fd, iterations);
+    if (motor) bench_play(fd, motor, iterations);
     close(fd);
+
+    if (save && save_baseline(save) < 0) return 1;
+    if (baseline) {
+        int bad = check_baseline(baseline);
+        if (bad < 0) return 1;
+        if (bad > 0) return 2;
+    }
     return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+        return run_bench(argc, argv);
+    }
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <event_number>\n"
+                        "       %s --bench <event_number> [options]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    int fd = open_device(argv[1]);
+    if (fd < 0) return 1;
+
+    int rc = run_demo(fd);
+    close(fd);
+    return rc;
 }
\ No newline at end of file